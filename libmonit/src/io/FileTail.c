@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "FileTail.h"
+
+
+/**
+ * Implementation of the FileTail interface. The buffer holds the
+ * unconsumed data [start, end). Complete lines are handed out in place,
+ * the partial line is moved to the beginning of the buffer before the
+ * next read if the free space runs low. The buffer is sized for the
+ * line limit plus one read, so a truncated line head always fits.
+ *
+ * A regular file is mapped in windows of up to MAP_WINDOW bytes, each
+ * up to the file size when it is mapped, and the line boundaries are
+ * found with memchr() in the mapping. Only the line itself (truncated
+ * to the limit) is copied to the buffer; the line which continues past
+ * the window is completed in the buffer. If the file cannot be mapped,
+ * it is read with read().
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+// Size of one read
+#define CHUNK_SIZE 65536
+
+// Maximum size of the mapped file window
+#define MAP_WINDOW (32 * 1024 * 1024)
+
+#define T FileTail_T
+struct T {
+        int fd;
+        int limit;
+        int error;
+        boolean_t eof;
+        off_t offset;        // File offset of buffer[end]
+        off_t skipped;       // Bytes dropped from the truncated partial line
+        size_t start;        // Start of the unconsumed data
+        size_t scan;         // Where to continue the newline search
+        size_t end;          // End of the data
+        size_t size;
+        char *buffer;
+        boolean_t mapped;    // The file is read using the mapped windows
+        char *map;           // The current window or NULL
+        size_t mapLength;    // The window length
+        size_t mapPosition;  // The window index of the file offset
+};
+
+
+/* --------------------------------------------------------------- Private */
+
+
+static void _unmap(T F) {
+        if (F->map) {
+                munmap(F->map, F->mapLength);
+                F->map = NULL;
+        }
+}
+
+
+/* Map the window starting at the file offset if the current window was
+ consumed. Returns false on the end of file or if the file cannot be mapped,
+ in which case it is read with read() from the file offset */
+static boolean_t _map(T F) {
+        if (! F->mapped)
+                return false;
+        if (F->map && F->mapPosition < F->mapLength)
+                return true;
+        _unmap(F);
+        struct stat sb;
+        if (fstat(F->fd, &sb) == 0) {
+                if (F->offset >= sb.st_size) {
+                        F->eof = true;
+                        return false;
+                }
+                static long pagesize = 0;
+                if (! pagesize)
+                        pagesize = sysconf(_SC_PAGESIZE);
+                off_t base = F->offset - F->offset % pagesize;
+                size_t length = sb.st_size - base > MAP_WINDOW ? MAP_WINDOW : (size_t)(sb.st_size - base);
+                void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, F->fd, base);
+                if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+                        madvise(map, length, MADV_SEQUENTIAL);
+#endif
+                        F->map = map;
+                        F->mapLength = length;
+                        F->mapPosition = (size_t)(F->offset - base);
+                        return true;
+                }
+        }
+        F->mapped = false;
+        if (lseek(F->fd, F->offset, SEEK_SET) < 0)
+                F->error = errno;
+        return false;
+}
+
+
+/* Read more data. If the partial line exceeds the limit, the bytes past
+ the limit are dropped, they are not part of the line returned. Returns
+ true if data was read, false on eof, error or if the read would block */
+static boolean_t _fill(T F) {
+        if (F->eof || F->error)
+                return false;
+        if (F->end - F->start > (size_t)F->limit - 1) {
+                F->skipped += F->end - (F->start + F->limit - 1);
+                F->scan = F->end = F->start + F->limit - 1;
+        }
+        if (F->size - F->end < CHUNK_SIZE) {
+                size_t length = F->end - F->start;
+                memmove(F->buffer, F->buffer + F->start, length);
+                F->scan -= F->start;
+                F->start = 0;
+                F->end = length;
+        }
+        if (_map(F)) {
+                size_t n = F->mapLength - F->mapPosition;
+                if (n > F->size - F->end - 1)
+                        n = F->size - F->end - 1;
+                memcpy(F->buffer + F->end, F->map + F->mapPosition, n);
+                F->mapPosition += n;
+                F->end += n;
+                F->offset += n;
+                return true;
+        }
+        if (F->eof || F->error)
+                return false;
+        ssize_t n;
+        do {
+                n = read(F->fd, F->buffer + F->end, F->size - F->end - 1);
+        } while (n == -1 && errno == EINTR);
+        if (n > 0) {
+                F->end += n;
+                F->offset += n;
+                return true;
+        }
+        if (n == 0)
+                F->eof = true;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                F->error = errno;
+        return false;
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T FileTail_new(int descriptor, int limit) {
+        assert(limit > 1);
+        T F;
+        NEW(F);
+        F->fd = descriptor;
+        F->limit = limit;
+        F->offset = lseek(descriptor, 0, SEEK_CUR);
+        if (F->offset < 0)
+                F->offset = 0;
+        F->size = limit + 2 * CHUNK_SIZE;
+        F->buffer = ALLOC(F->size);
+        struct stat sb;
+        F->mapped = fstat(descriptor, &sb) == 0 && S_ISREG(sb.st_mode);
+        return F;
+}
+
+
+void FileTail_free(T *F) {
+        assert(F && *F);
+        _unmap(*F);
+        FREE((*F)->buffer);
+        FREE(*F);
+}
+
+
+off_t FileTail_getPosition(T F) {
+        assert(F);
+        return F->offset - (off_t)(F->end - F->start) - F->skipped;
+}
+
+
+int FileTail_getError(T F) {
+        assert(F);
+        return F->error;
+}
+
+
+int FileTail_readLine(T F, const char **line) {
+        assert(F);
+        assert(line);
+        do {
+                if (F->start == F->end && _map(F)) {
+                        // The buffer is empty and the line is complete in the window => copy just the line
+                        const char *data = F->map + F->mapPosition;
+                        const char *eol = memchr(data, '\n', F->mapLength - F->mapPosition);
+                        if (eol) {
+                                size_t length = eol - data;
+                                if (length > (size_t)F->limit - 1)
+                                        length = F->limit - 1;
+                                memcpy(F->buffer, data, length);
+                                F->buffer[length] = 0;
+                                F->start = F->scan = F->end = 0;
+                                F->mapPosition += eol - data + 1;
+                                F->offset += eol - data + 1;
+                                F->skipped = 0;
+                                *line = F->buffer;
+                                return (int)length;
+                        }
+                }
+                char *eol = memchr(F->buffer + F->scan, '\n', F->end - F->scan);
+                if (eol) {
+                        size_t length = eol - (F->buffer + F->start);
+                        if (length > (size_t)F->limit - 1)
+                                length = F->limit - 1;
+                        *line = F->buffer + F->start;
+                        F->buffer[F->start + length] = 0;
+                        F->start = F->scan = eol - F->buffer + 1;
+                        F->skipped = 0;
+                        return (int)length;
+                }
+                F->scan = F->end;
+        } while (_fill(F));
+        return -1;
+}
+
+
+int FileTail_pending(T F, const char **data) {
+        assert(F);
+        assert(data);
+        size_t length = F->end - F->start;
+        if (length > (size_t)F->limit - 1)
+                length = F->limit - 1;
+        *data = F->buffer + F->start;
+        F->buffer[F->start + length] = 0;
+        return (int)length;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#ifndef FILETAIL_INCLUDED
+#define FILETAIL_INCLUDED
+#include <sys/types.h>
+
+
+/**
+ * A <b>FileTail</b> reads text lines from a descriptor, starting at the
+ * descriptor's current offset. Lines are returned as slices of the
+ * internal buffer, i.e. the data is not copied and the line length is
+ * known without strlen(). A line is returned only when its newline was
+ * read, a partial line at the end of the data stays pending and is
+ * available with FileTail_pending(). FileTail_getPosition() returns the
+ * file offset past the last complete line, i.e. where the next tail
+ * should start so the partial line is read again once the writer
+ * completes it.
+ *
+ * Lines longer than the line limit are truncated, the rest of the line
+ * up to the newline is skipped. The reader can be used with a
+ * non-blocking descriptor, a read which would block is handled as the
+ * end of the currently available data. A regular file is mapped to
+ * memory instead of read, so the descriptor offset doesn't change.
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T FileTail_T
+typedef struct T *T;
+
+
+/**
+ * Create a new FileTail object.
+ * @param descriptor The descriptor to read from, reading starts at its
+ * current offset
+ * @param limit The maximum line length including the terminating NUL
+ * character. Longer lines are truncated to limit - 1 characters
+ * @return A FileTail object
+ * @exception AssertException if limit is < 2
+ */
+T FileTail_new(int descriptor, int limit);
+
+
+/**
+ * Destroy a FileTail object and release allocated resources. The
+ * descriptor is not closed.
+ * @param F A FileTail object reference
+ */
+void FileTail_free(T *F);
+
+
+/** @name Properties */
+//@{
+
+/**
+ * Returns the file offset past the last complete line returned by
+ * FileTail_readLine(). If the descriptor's offset is not known (e.g.
+ * a pipe), the position is relative to the start of the tail.
+ * @param F A FileTail object
+ * @return The offset of the first byte which was not consumed
+ */
+off_t FileTail_getPosition(T F);
+
+
+/**
+ * Returns the error number of the failed read or 0 if no error occurred
+ * @param F A FileTail object
+ * @return The errno of the failed read or 0
+ */
+int FileTail_getError(T F);
+
+//@}
+
+
+/**
+ * Read the next complete line. The line is NUL terminated and doesn't
+ * include the newline. The line points to the internal buffer and is
+ * valid until the next call to a FileTail method.
+ * @param F A FileTail object
+ * @param line Output, set to the start of the line
+ * @return The line length or -1 if no complete line is available, i.e.
+ * the end of data was reached, a read would block or a read failed
+ * (see FileTail_getError())
+ */
+int FileTail_readLine(T F, const char **line);
+
+
+/**
+ * Returns the partial line at the end of the data read, i.e. the bytes
+ * after the last newline. The data is NUL terminated and is truncated
+ * like the lines returned by FileTail_readLine(). The partial line is
+ * not consumed, FileTail_getPosition() doesn't change.
+ * @param F A FileTail object
+ * @param data Output, set to the start of the partial line
+ * @return The length of the partial line, 0 if there is none
+ */
+int FileTail_pending(T F, const char **data);
+
+
+#undef T
+#endif
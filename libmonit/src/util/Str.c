@@ -402,6 +402,84 @@ int Str_match(const char *pattern, const char *subject) {
 }
 
 
+char *Str_regexLiteral(const char *pattern, char *buf, int bufsize) {
+        assert(pattern);
+        assert(buf);
+        assert(bufsize > 1);
+        if (strchr(pattern, '|'))
+                return NULL;
+        int depth = 0, length = 0, best = 0;
+        char run[bufsize];
+        for (const char *p = pattern; *p;) {
+                int literal = -1;
+                const char *next = p + 1;
+                if (*p == '\\') {
+                        if (! p[1])
+                                break;
+                        // Only an escaped ERE metacharacter is a literal, other escapes may be GNU anchors or classes such as \< or \w
+                        if (strchr(".[]()*+?{}|^$\\", p[1]))
+                                literal = (unsigned char)p[1];
+                        next = p + 2;
+                } else if (*p == '[') {
+                        // Skip the bracket expression, the ']' may be the first character in the list
+                        next = p + 1;
+                        if (*next == '^')
+                                next++;
+                        if (*next == ']')
+                                next++;
+                        while (*next && *next != ']') {
+                                if (*next == '[' && (next[1] == ':' || next[1] == '.' || next[1] == '=')) {
+                                        char *end = strstr(next + 2, (char[3]){next[1], ']', 0});
+                                        next = end ? end + 1 : next + 1;
+                                }
+                                next++;
+                        }
+                        if (*next)
+                                next++;
+                } else if (*p == '{') {
+                        const char *end = strchr(p, '}');
+                        next = end ? end + 1 : p + 1;
+                } else if (*p == '(') {
+                        depth++;
+                } else if (*p == ')') {
+                        depth--;
+                } else if (! strchr(".^$*+?", *p)) {
+                        literal = (unsigned char)*p;
+                }
+                // The atom followed by '*', '?' or '{' is optional or repeated => it terminates the literal run
+                int quantified = *next == '*' || *next == '?' || *next == '{';
+                if (literal >= 0 && depth == 0 && ! quantified) {
+                        if (length < bufsize - 1)
+                                run[length] = literal;
+                        length++;
+                        if (*next == '+') {
+                                // The atom is present at least once, but the run cannot continue
+                                if (length > best) {
+                                        best = length;
+                                        memcpy(buf, run, length < bufsize - 1 ? length : bufsize - 1);
+                                }
+                                length = 0;
+                        }
+                } else {
+                        if (length > best) {
+                                best = length;
+                                memcpy(buf, run, length < bufsize - 1 ? length : bufsize - 1);
+                        }
+                        length = 0;
+                }
+                p = next;
+        }
+        if (length > best) {
+                best = length;
+                memcpy(buf, run, length < bufsize - 1 ? length : bufsize - 1);
+        }
+        if (best == 0)
+                return NULL;
+        buf[best < bufsize - 1 ? best : bufsize - 1] = 0;
+        return buf;
+}
+
+
 unsigned int Str_hash(const void *x) {
         const char *s = x;
         unsigned long h = 0, g;
@@ -411,6 +411,22 @@ int Str_lim(const char *s, int limit);
 int Str_match(const char *pattern, const char *subject);
 
 
+/**
+ * Find the longest literal string which must be present in every string
+ * matching the given POSIX extended regular expression. The literal can be
+ * used as a cheap prefilter before calling regexec(). Patterns containing
+ * an alternation have no such literal.
+ * <pre>
+ * Str_regexLiteral("^foo[0-9]+ba$", buf, sizeof(buf)) -> "foo"
+ * </pre>
+ * @param pattern The regular expression
+ * @param buf A result buffer, the literal is truncated if it doesn't fit
+ * @param bufsize The size of the result buffer
+ * @return A pointer to buf or NULL if the pattern has no required literal
+ */
+char *Str_regexLiteral(const char *pattern, char *buf, int bufsize);
+
+
 /**
  * UNIX ELF hash algorithm. May be used as the <code>hash</code>
  * function in a Table or a Set. 
@@ -135,6 +135,21 @@ T StringBuffer_vappend(T S, const char *s, va_list ap) {
 }
 
 
+T StringBuffer_appendBytes(T S, const void *b, int length) {
+        assert(S);
+        if (b && length > 0) {
+                if (S->used + length >= S->length) {
+                        S->length = S->used + length + STRLEN;
+                        RESIZE(S->buffer, S->length);
+                }
+                memcpy(S->buffer + S->used, b, length);
+                S->used += length;
+                S->buffer[S->used] = 0;
+        }
+        return S;
+}
+
+
 int StringBuffer_replace(T S, const char *a, const char *b) {
         int n = 0;
         assert(S);
@@ -97,6 +97,19 @@ T StringBuffer_append(T S, const char *s, ...) __attribute__((format (printf, 2,
 T StringBuffer_vappend(T S, const char *s, va_list ap);
 
 
+/**
+ * Append <code>length</code> bytes from <code>b</code> to the contents
+ * of this string buffer. The bytes are copied as is, without format
+ * processing, so the data doesn't need to be NUL terminated.
+ * @param S StringBuffer object
+ * @param b The bytes to append
+ * @param length The number of bytes to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendBytes(T S, const void *b, int length);
+
+
 /**
  * Replace all occurences of <code>a</code> with <code>b</code>. Example: 
  * <pre>
@@ -0,0 +1,217 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "FileTail.h"
+#include "File.h"
+#include "Str.h"
+#include "system/Net.h"
+
+/**
+ * FileTail.c unit tests.
+ */
+
+
+static void _write(int fd, const char *s) {
+        assert(write(fd, s, strlen(s)) == (ssize_t)strlen(s));
+}
+
+
+int main(void) {
+        char path[STRLEN];
+        const char *line;
+        int fd;
+        FileTail_T F = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start FileTail Tests\n\n");
+
+        snprintf(path, STRLEN, "/tmp/.FileTailTest.%d", getpid());
+
+        printf("=> Test1: create/destroy\n");
+        {
+                assert((fd = File_open(path, "w+")) != -1);
+                F = FileTail_new(fd, 16);
+                assert(F);
+                assert(FileTail_getPosition(F) == 0);
+                assert(FileTail_getError(F) == 0);
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_pending(F, &line) == 0);
+                FileTail_free(&F);
+                assert(F == NULL);
+                assert(File_close(fd));
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: read lines and keep the partial line pending\n");
+        {
+                assert((fd = File_open(path, "w+")) != -1);
+                _write(fd, "first\n\nthird line\npart");
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 16);
+                assert(FileTail_readLine(F, &line) == 5);
+                assert(Str_isEqual(line, "first"));
+                assert(FileTail_getPosition(F) == 6);
+                assert(FileTail_readLine(F, &line) == 0);
+                assert(Str_isEqual(line, ""));
+                assert(FileTail_readLine(F, &line) == 10);
+                assert(Str_isEqual(line, "third line"));
+                assert(FileTail_getPosition(F) == 18);
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == 0);
+                assert(FileTail_getPosition(F) == 18);
+                assert(FileTail_pending(F, &line) == 4);
+                assert(Str_isEqual(line, "part"));
+                FileTail_free(&F);
+                // Resume at the start of the partial line once it is complete (the file is mapped, the descriptor offset didn't move)
+                assert(lseek(fd, 0, SEEK_END) == 22);
+                _write(fd, "ial\nlast\n");
+                assert(lseek(fd, 18, SEEK_SET) == 18);
+                F = FileTail_new(fd, 16);
+                assert(FileTail_readLine(F, &line) == 7);
+                assert(Str_isEqual(line, "partial"));
+                assert(FileTail_readLine(F, &line) == 4);
+                assert(Str_isEqual(line, "last"));
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_pending(F, &line) == 0);
+                assert(FileTail_getPosition(F) == 31);
+                FileTail_free(&F);
+                assert(File_close(fd));
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: truncate long lines\n");
+        {
+                assert((fd = File_open(path, "w+")) != -1);
+                _write(fd, "0123456789abcdefghij\nshort\n0123456789abcdefghij");
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 8);
+                assert(FileTail_readLine(F, &line) == 7);
+                assert(Str_isEqual(line, "0123456"));
+                assert(FileTail_getPosition(F) == 21);
+                assert(FileTail_readLine(F, &line) == 5);
+                assert(Str_isEqual(line, "short"));
+                assert(FileTail_readLine(F, &line) == -1);
+                // The position stays at the start of the truncated partial line
+                assert(FileTail_getPosition(F) == 27);
+                assert(FileTail_pending(F, &line) == 7);
+                assert(Str_isEqual(line, "0123456"));
+                FileTail_free(&F);
+                assert(File_close(fd));
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: lines spanning several reads\n");
+        {
+                assert((fd = File_open(path, "w+")) != -1);
+                char *big = ALLOC(200001);
+                memset(big, 'x', 200000);
+                big[200000] = 0;
+                for (int i = 0; i < 3; i++) {
+                        _write(fd, big);
+                        _write(fd, "\n");
+                }
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 300000);
+                for (int i = 0; i < 3; i++) {
+                        assert(FileTail_readLine(F, &line) == 200000);
+                        assert(line[0] == 'x' && line[199999] == 'x' && line[200000] == 0);
+                }
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getPosition(F) == 600003);
+                FileTail_free(&F);
+                // Truncated lines longer than the buffer
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 10);
+                for (int i = 0; i < 3; i++) {
+                        assert(FileTail_readLine(F, &line) == 9);
+                        assert(Str_isEqual(line, "xxxxxxxxx"));
+                }
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getPosition(F) == 600003);
+                FileTail_free(&F);
+                FREE(big);
+                assert(File_close(fd));
+        }
+        printf("=> Test4: OK\n\n");
+
+        printf("=> Test5: non-blocking pipe\n");
+        {
+                int p[2];
+                assert(pipe(p) == 0);
+                assert(Net_setNonBlocking(p[0]));
+                F = FileTail_new(p[0], 32);
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == 0);
+                _write(p[1], "line1\nli");
+                assert(FileTail_readLine(F, &line) == 5);
+                assert(Str_isEqual(line, "line1"));
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == 0);
+                _write(p[1], "ne2\n");
+                assert(FileTail_readLine(F, &line) == 5);
+                assert(Str_isEqual(line, "line2"));
+                close(p[1]);
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == 0);
+                FileTail_free(&F);
+                close(p[0]);
+        }
+        printf("=> Test5: OK\n\n");
+
+        printf("=> Test6: read error\n");
+        {
+                assert((fd = File_open(path, "w")) != -1);
+                _write(fd, "data\n");
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 16);
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == EBADF);
+                FileTail_free(&F);
+                assert(File_close(fd));
+        }
+        printf("=> Test6: OK\n\n");
+
+        printf("=> Test7: many lines of various length\n");
+        {
+                assert((fd = File_open(path, "w+")) != -1);
+                char *data = ALLOC(100000);
+                off_t size = 0;
+                for (int i = 0; i < 2000; i++) {
+                        int length = (i * 7919) % 1000;
+                        memset(data, 'a' + i % 26, length);
+                        data[length] = '\n';
+                        assert(write(fd, data, length + 1) == length + 1);
+                        size += length + 1;
+                }
+                assert(lseek(fd, 0, SEEK_SET) == 0);
+                F = FileTail_new(fd, 512);
+                for (int i = 0; i < 2000; i++) {
+                        int length = (i * 7919) % 1000;
+                        int n = FileTail_readLine(F, &line);
+                        assert(n == (length > 511 ? 511 : length));
+                        assert(n == 0 || (line[0] == 'a' + i % 26 && line[n - 1] == 'a' + i % 26));
+                        assert(line[n] == 0);
+                }
+                assert(FileTail_readLine(F, &line) == -1);
+                assert(FileTail_getError(F) == 0);
+                assert(FileTail_getPosition(F) == size);
+                FileTail_free(&F);
+                FREE(data);
+                assert(File_close(fd));
+        }
+        printf("=> Test7: OK\n\n");
+
+        File_delete(path);
+
+        printf("============> FileTail Tests: OK\n\n");
+
+        return 0;
+}
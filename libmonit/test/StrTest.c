@@ -418,6 +418,30 @@ int main(void) {
         }
         printf("=> Test24: OK\n\n");
 
+        printf("=> Test25: Str_regexLiteral\n");
+        {
+                char buf[STRLEN];
+                assert(Str_isEqual(Str_regexLiteral("^foo[0-9]+ba$", buf, sizeof(buf)), "foo"));
+                assert(Str_isEqual(Str_regexLiteral("/usr/sbin/sshd -D", buf, sizeof(buf)), "/usr/sbin/sshd -D"));
+                assert(Str_isEqual(Str_regexLiteral("ab?cdef", buf, sizeof(buf)), "cdef"));
+                assert(Str_isEqual(Str_regexLiteral("x(abc)+yz", buf, sizeof(buf)), "yz"));
+                assert(Str_isEqual(Str_regexLiteral("a\\.b\\[c", buf, sizeof(buf)), "a.b[c"));
+                assert(Str_regexLiteral("foo|bar", buf, sizeof(buf)) == NULL);
+                assert(Str_regexLiteral(".*", buf, sizeof(buf)) == NULL);
+                // GNU anchors and classes are not literals
+                assert(Str_isEqual(Str_regexLiteral("\\<foo\\>", buf, sizeof(buf)), "foo"));
+                assert(Str_isEqual(Str_regexLiteral("\\`foo\\'", buf, sizeof(buf)), "foo"));
+                assert(Str_isEqual(Str_regexLiteral("\\bfoo\\B", buf, sizeof(buf)), "foo"));
+                assert(Str_isEqual(Str_regexLiteral("a\\wfoo\\sb", buf, sizeof(buf)), "foo"));
+                assert(Str_isEqual(Str_regexLiteral("ab\\Wfoo\\Sbc", buf, sizeof(buf)), "foo"));
+                assert(Str_match("\\<foo\\>", "a foo b"));
+                assert(strstr("a foo b", Str_regexLiteral("\\<foo\\>", buf, sizeof(buf))));
+                // Truncated to the buffer size
+                char small[4];
+                assert(Str_isEqual(Str_regexLiteral("abcdef", small, sizeof(small)), "abc"));
+        }
+        printf("=> Test25: OK\n\n");
+
         printf("============> Str Tests: OK\n\n");
         return 0;
 }
@@ -388,6 +388,24 @@ int main(void) {
         }
         printf("=> Test15: OK\n\n");
 #endif
+
+        printf("=> Test16: appendBytes\n");
+        {
+                sb = StringBuffer_create(4);
+                StringBuffer_appendBytes(sb, "abc\0def", 3);
+                assert(StringBuffer_length(sb) == 3);
+                assert(Str_isEqual(StringBuffer_toString(sb), "abc"));
+                StringBuffer_appendBytes(sb, "defghijklmnopqrstuvwxyz", 23);
+                assert(StringBuffer_length(sb) == 26);
+                assert(Str_isEqual(StringBuffer_toString(sb), "abcdefghijklmnopqrstuvwxyz"));
+                StringBuffer_appendBytes(sb, NULL, 10);
+                StringBuffer_appendBytes(sb, "x", 0);
+                assert(StringBuffer_length(sb) == 26);
+                StringBuffer_free(&sb);
+                assert(sb == NULL);
+        }
+        printf("=> Test16: OK\n\n");
+
         printf("============> StringBuffer Tests: OK\n\n");
 
         return 0;
@@ -14,6 +14,7 @@ DirTest && \
 InputStreamTest && \
 OutputStreamTest && \
 FileTest && \
+FileTailTest && \
 ExceptionTest && \
 NetTest && \
 CommandTest
@@ -138,6 +138,7 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, int6
                 }
                 Process_T P = Command_execute(C);
                 Command_free(&C);
+                ProcessTree_invalidate(); // The program may start or stop processes
                 if (P) {
                         do {
                                 Time_usleep(RETRY_INTERVAL);
@@ -170,6 +171,7 @@ static Process_Status _waitProcessStart(Service_T s, int64_t *timeout) {
         long wait = RETRY_INTERVAL;
         do {
                 Time_usleep(wait);
+                ProcessTree_invalidate(); // The process may be starting => don't use the cached process tree
                 pid_t pid = ProcessTree_findProcess(s);
                 if (pid) {
                         ProcessTree_init(ProcessEngine_None);
@@ -27,9 +27,31 @@
 
 
 boolean_t filesystem_usage(Service_T);
+
+
+/**
+ * Start a new check cycle. The filesystem statistics shared by several services (e.g. the disk usage of the same
+ * filesystem or the block devices statistics table) are collected once per cycle.
+ */
+void Filesystem_initCycle(void);
+
+
+/**
+ * @return The current check cycle
+ */
+int Filesystem_getCycle(void);
+
 boolean_t Filesystem_getByMountpoint(Info_T inf, const char *path);
 boolean_t Filesystem_getByDevice(Info_T inf, const char *path);
 
 
+/**
+ * Get the type of the filesystem with the given device id (the st_dev of the files in it)
+ * @param id The device id
+ * @return The filesystem type or NULL if not known or not supported on this platform
+ */
+const char *Filesystem_typeById(dev_t id);
+
+
 #endif
 
@@ -63,6 +63,25 @@
 #include "device.h"
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+static int _cycle = 0;
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Filesystem_initCycle() {
+        _cycle++;
+}
+
+
+int Filesystem_getCycle() {
+        return _cycle;
+}
+
+
 boolean_t filesystem_usage(Service_T s) {
         ASSERT(s);
         struct stat sb;
@@ -54,6 +54,14 @@
 # include <sys/types.h>
 #endif
 
+#ifdef HAVE_SYS_SYSMACROS_H
+# include <sys/sysmacros.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
 #endif
@@ -71,6 +79,7 @@
 #endif
 
 #include "monit.h"
+#include "device.h"
 
 // libmonit
 #include "io/File.h"
@@ -82,6 +91,7 @@
 
 
 #define MOUNTS   "/proc/self/mounts"
+#define MOUNTINFO "/proc/self/mountinfo"
 #define CIFSSTAT "/proc/fs/cifs/Stats"
 #define DISKSTAT "/proc/diskstats"
 #define NFSSTAT  "/proc/self/mountstats"
@@ -90,20 +100,115 @@
 static struct {
         int fd;                                    // /proc/self/mounts filedescriptor (needed for mount/unmount notification)
         int generation;                            // Increment each time the mount table is changed
-        boolean_t (*getBlockDiskActivity)(void *); // Disk activity callback: _getProcfsBlockDiskActivity (old kernels), _getSysfsBlockDiskActivity (new kernels)
         boolean_t (*getCifsDiskActivity)(void *);  // Disk activity callback: _getCifsDiskActivity if /proc/fs/cifs/Stats is present, otherwise _getDummyDiskActivity
 } _statistics = {};
 
 
+typedef struct DiskStat_T {
+        char name[256];
+        boolean_t hasTime;                         // Old kernels (< 2.6.25) provide just 4 statistics for partitions, without the read/write time
+        uint64_t readOperations;
+        uint64_t readSectors;
+        uint64_t readTime;
+        uint64_t writeOperations;
+        uint64_t writeSectors;
+        uint64_t writeTime;
+} DiskStat_T;
+
+
+/* The block devices statistics, read from /proc/diskstats once per cycle and sorted by device name */
+static struct {
+        int cycle;                                 // The cycle the table was loaded in, -1 = not loaded
+        boolean_t available;
+        uint64_t timestamp;
+        int count;
+        int capacity;
+        DiskStat_T *list;
+} _diskStats = {.cycle = -1};
+
+
+typedef struct DiskUsage_T {
+        dev_t id;
+        int cycle;
+        struct statvfs usage;
+} DiskUsage_T;
+
+
+/* The disk usage per filesystem device id: the statvfs() is called once per cycle for each filesystem, even if several services point to it (e.g. bind mounts) */
+static struct {
+        int count;
+        int capacity;
+        DiskUsage_T *list;
+} _diskUsage = {};
+
+
+typedef enum {
+        Mount_Mountpoint = 0,
+        Mount_Device,
+        Mount_RealDevice,
+        Mount_Id,
+        Mount_Indexes
+} __attribute__((__packed__)) Mount_Index;
+
+
+typedef struct MountEntry_T {
+        char *device;                              // Mounted device or connection string (mnt_fsname)
+        char *realdevice;                          // Dereferenced device path (e.g. /dev/mapper/centos-root -> /dev/dm-1), NULL if not resolved
+        char *mountpoint;
+        char *type;
+        char *options;
+        dev_t id;                                  // The st_dev of files in this filesystem, 0 if unknown
+} MountEntry_T;
+
+
+/* The mount table shared by all filesystem lookups. It is loaded once per mount table generation and indexed by mountpoint, device and device id. The
+ * index slots hold the entry index + 1 (0 = empty slot), if multiple entries have the same key (overlay mounts), the index points to the last one */
+static struct {
+        int generation;                            // The mount table generation this cache was loaded for, 0 = not loaded
+        boolean_t resolved;                        // The realdevice of all entries was resolved (done on demand by the first lookup by device)
+        int count;
+        int capacity;
+        int size;                                  // Size of each index (power of 2)
+        MountEntry_T *entries;
+        int *index[Mount_Indexes];
+} _mounts = {};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
 static boolean_t _getDiskUsage(void *_inf) {
         Info_T inf = _inf;
+        DiskUsage_T *cache = NULL;
+        int cycle = Filesystem_getCycle();
+        if (inf->filesystem->object.id) {
+                for (int i = 0; i < _diskUsage.count; i++) {
+                        if (_diskUsage.list[i].id == inf->filesystem->object.id) {
+                                cache = &_diskUsage.list[i];
+                                break;
+                        }
+                }
+                if (! cache) {
+                        if (_diskUsage.count == _diskUsage.capacity) {
+                                _diskUsage.capacity = _diskUsage.capacity ? _diskUsage.capacity * 2 : 16;
+                                RESIZE(_diskUsage.list, _diskUsage.capacity * sizeof(DiskUsage_T));
+                        }
+                        cache = &_diskUsage.list[_diskUsage.count++];
+                        *cache = (DiskUsage_T){.id = inf->filesystem->object.id, .cycle = -1};
+                }
+        }
         struct statvfs usage;
-        if (statvfs(inf->filesystem->object.mountpoint, &usage) != 0) {
-                LogError("Error getting usage statistics for filesystem '%s' -- %s\n", inf->filesystem->object.mountpoint, STRERROR);
-                return false;
+        if (cache && cache->cycle == cycle) {
+                usage = cache->usage;
+        } else {
+                if (statvfs(inf->filesystem->object.mountpoint, &usage) != 0) {
+                        LogError("Error getting usage statistics for filesystem '%s' -- %s\n", inf->filesystem->object.mountpoint, STRERROR);
+                        return false;
+                }
+                if (cache) {
+                        cache->usage = usage;
+                        cache->cycle = cycle;
+                }
         }
         inf->filesystem->f_bsize = usage.f_frsize;
         inf->filesystem->f_blocks = usage.f_blocks;
@@ -229,141 +334,254 @@ static boolean_t _getZfsDiskActivity(void *_inf) {
 }
 
 
-static boolean_t _getSysfsBlockDiskActivity(void *_inf) {
-        Info_T inf = _inf;
-        char path[PATH_MAX];
-        snprintf(path, sizeof(path), "/sys/class/block/%s/stat", inf->filesystem->object.key);
-        FILE *f = fopen(path, "r");
-        if (f) {
-                uint64_t now = Time_milli();
-                uint64_t readOperations = 0ULL, readSectors = 0ULL, readTime = 0ULL;
-                uint64_t writeOperations = 0ULL, writeSectors = 0ULL, writeTime = 0ULL;
-                if (fscanf(f, "%"PRIu64" %*u %"PRIu64" %"PRIu64" %"PRIu64" %*u %"PRIu64" %"PRIu64" %*u %*u %*u", &readOperations, &readSectors, &readTime, &writeOperations, &writeSectors, &writeTime) != 6) {
-                        fclose(f);
-                        LogError("filesystem statistic error: cannot parse %s -- %s\n", path, STRERROR);
-                        return false;
+static int _compareDiskStat(const void *a, const void *b) {
+        return strcmp(((const DiskStat_T *)a)->name, ((const DiskStat_T *)b)->name);
+}
+
+
+/**
+ * Load the statistics of all block devices in one pass over /proc/diskstats, if it wasn't loaded in this cycle yet. The file has the same
+ * 11+ statistics format as /sys/class/block/<NAME>/stat on kernels >= 2.6.25, older kernels provide just 4 statistics for partitions.
+ */
+static boolean_t _diskStatsLoad() {
+        int cycle = Filesystem_getCycle();
+        if (_diskStats.cycle == cycle)
+                return _diskStats.available;
+        _diskStats.cycle = cycle;
+        _diskStats.count = 0;
+        _diskStats.available = false;
+        FILE *f = fopen(DISKSTAT, "r");
+        if (! f) {
+                LogError("filesystem statistic error: cannot read %s -- %s\n", DISKSTAT, STRERROR);
+                return false;
+        }
+        _diskStats.timestamp = Time_milli();
+        char line[PATH_MAX];
+        while (fgets(line, sizeof(line), f)) {
+                if (_diskStats.count == _diskStats.capacity) {
+                        _diskStats.capacity = _diskStats.capacity ? _diskStats.capacity * 2 : 64;
+                        RESIZE(_diskStats.list, _diskStats.capacity * sizeof(DiskStat_T));
                 }
-                Statistics_update(&(inf->filesystem->time.read), now, readTime);
-                Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
-                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                Statistics_update(&(inf->filesystem->time.write), now, writeTime);
-                Statistics_update(&(inf->filesystem->write.bytes), now, writeSectors * 512);
-                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                fclose(f);
-                return true;
+                DiskStat_T *d = &_diskStats.list[_diskStats.count];
+                uint64_t v[8];
+                int n = sscanf(line, " %*u %*u %255s %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64, d->name, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+                if (n == 9) {
+                        d->hasTime = true;
+                        d->readOperations = v[0];
+                        d->readSectors = v[2];
+                        d->readTime = v[3];
+                        d->writeOperations = v[4];
+                        d->writeSectors = v[6];
+                        d->writeTime = v[7];
+                } else if (n == 5) {
+                        d->hasTime = false;
+                        d->readOperations = v[0];
+                        d->readSectors = v[1];
+                        d->writeOperations = v[2];
+                        d->writeSectors = v[3];
+                } else {
+                        continue;
+                }
+                _diskStats.count++;
         }
-        LogError("filesystem statistic error: cannot read %s -- %s\n", path, STRERROR);
-        return false;
+        fclose(f);
+        qsort(_diskStats.list, _diskStats.count, sizeof(DiskStat_T), _compareDiskStat);
+        _diskStats.available = true;
+        return true;
 }
 
 
-static boolean_t _getProcfsBlockDiskActivity(void *_inf) {
+static boolean_t _getBlockDiskActivity(void *_inf) {
         Info_T inf = _inf;
-        FILE *f = fopen(DISKSTAT, "r");
-        if (f) {
-                uint64_t now = Time_milli();
-                uint64_t readOperations = 0ULL, readSectors = 0ULL;
-                uint64_t writeOperations = 0ULL, writeSectors = 0ULL;
-                char line[PATH_MAX];
-                while (fgets(line, sizeof(line), f)) {
-                        char name[256] = {};
-                        // Fallback for kernels < 2.6.25: the /proc/diskstats used to have just 4 statistics, the file is present on >= 2.6.25 too and has 11 fields (same format as /sys/class/block/<NAME>/stat), but we use sysfs for it
-                        // as we read the given partition directly instead of traversing the whole filesystems list. In this function we expect the old 4-statistics format - if it should be ever used as main data collector, it needs to
-                        // be modified to support >= 2.6.25 format too.
-                        if (fscanf(f, " %*d %*d %255s %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64, name, &readOperations, &readSectors, &writeOperations, &writeSectors) == 5 && Str_isEqual(name, inf->filesystem->object.key)) {
-                                Statistics_update(&(inf->filesystem->read.bytes), now, readSectors * 512);
-                                Statistics_update(&(inf->filesystem->read.operations), now, readOperations);
-                                Statistics_update(&(inf->filesystem->write.bytes), now, writeSectors * 512);
-                                Statistics_update(&(inf->filesystem->write.operations), now, writeOperations);
-                                break;
+        if (_diskStatsLoad()) {
+                // The device name longer than the diskstats name field cannot be in the table => skip the lookup rather than match a truncated name
+                DiskStat_T key = {}, *d = NULL;
+                size_t length = strlen(inf->filesystem->object.key);
+                if (length < sizeof(key.name)) {
+                        memcpy(key.name, inf->filesystem->object.key, length + 1);
+                        d = bsearch(&key, _diskStats.list, _diskStats.count, sizeof(DiskStat_T), _compareDiskStat);
+                }
+                if (d) {
+                        if (d->hasTime) {
+                                Statistics_update(&(inf->filesystem->time.read), _diskStats.timestamp, d->readTime);
+                                Statistics_update(&(inf->filesystem->time.write), _diskStats.timestamp, d->writeTime);
                         }
+                        Statistics_update(&(inf->filesystem->read.bytes), _diskStats.timestamp, d->readSectors * 512);
+                        Statistics_update(&(inf->filesystem->read.operations), _diskStats.timestamp, d->readOperations);
+                        Statistics_update(&(inf->filesystem->write.bytes), _diskStats.timestamp, d->writeSectors * 512);
+                        Statistics_update(&(inf->filesystem->write.operations), _diskStats.timestamp, d->writeOperations);
+                        return true;
                 }
-                fclose(f);
-                return true;
+                LogError("filesystem statistic error: block device %s not found in %s\n", inf->filesystem->object.key, DISKSTAT);
         }
-        LogError("filesystem statistic error: cannot read %s -- %s\n", DISKSTAT, STRERROR);
         return false;
 }
 
 
-static boolean_t _compareMountpoint(const char *mountpoint, struct mntent *mnt) {
-        return IS(mountpoint, mnt->mnt_dir);
+static unsigned int _mountHash(MountEntry_T *e, Mount_Index index) {
+        if (index == Mount_Id)
+                return (unsigned int)((uint64_t)e->id * 0x9E3779B97F4A7C15ULL >> 32);
+        unsigned int hash = 5381;
+        for (const unsigned char *key = (const unsigned char *)(index == Mount_Mountpoint ? e->mountpoint : index == Mount_Device ? e->device : e->realdevice); *key; key++)
+                hash = (hash << 5) + hash + *key;
+        return hash;
 }
 
 
-static boolean_t _compareDevice(const char *device, struct mntent *mnt) {
-        char target[PATH_MAX] = {};
-        // The device listed in /etc/mtab can be a device mapper symlink (e.g. /dev/mapper/centos-root -> /dev/dm-1) ... lookup the device as is first (support for NFS/CIFS/SSHFS/etc.) and fallback to realpath if it didn't match
-        return (Str_isEqual(device, mnt->mnt_fsname) || (realpath(mnt->mnt_fsname, target) && Str_isEqual(device, target)));
+static boolean_t _mountEquals(MountEntry_T *a, MountEntry_T *b, Mount_Index index) {
+        switch (index) {
+                case Mount_Mountpoint:
+                        return IS(a->mountpoint, b->mountpoint);
+                case Mount_Device:
+                        return IS(a->device, b->device);
+                case Mount_RealDevice:
+                        return IS(a->realdevice, b->realdevice);
+                default:
+                        return a->id == b->id;
+        }
 }
 
 
-static boolean_t _setDevice(Info_T inf, const char *path, boolean_t (*compare)(const char *path, struct mntent *mnt)) {
+static void _mountIndexAdd(Mount_Index index, int entry) {
+        MountEntry_T *e = &_mounts.entries[entry];
+        for (unsigned int i = _mountHash(e, index) & (_mounts.size - 1); ; i = (i + 1) & (_mounts.size - 1)) {
+                int slot = _mounts.index[index][i];
+                if (slot == 0 || _mountEquals(&_mounts.entries[slot - 1], e, index)) {
+                        _mounts.index[index][i] = entry + 1;
+                        return;
+                }
+        }
+}
+
+
+static MountEntry_T *_mountIndexGet(Mount_Index index, MountEntry_T *key) {
+        if (! _mounts.size)
+                return NULL;
+        for (unsigned int i = _mountHash(key, index) & (_mounts.size - 1); ; i = (i + 1) & (_mounts.size - 1)) {
+                int slot = _mounts.index[index][i];
+                if (slot == 0)
+                        return NULL;
+                if (_mountEquals(&_mounts.entries[slot - 1], key, index))
+                        return &_mounts.entries[slot - 1];
+        }
+}
+
+
+static void _mountsFree() {
+        for (int i = 0; i < _mounts.count; i++) {
+                FREE(_mounts.entries[i].device);
+                FREE(_mounts.entries[i].realdevice);
+                FREE(_mounts.entries[i].mountpoint);
+                FREE(_mounts.entries[i].type);
+                FREE(_mounts.entries[i].options);
+        }
+        _mounts.count = 0;
+        _mounts.resolved = false;
+        _mounts.generation = 0;
+}
+
+
+// Decode the octal escapes used by the kernel for white-space and backslash in the mount table fields
+static void _unescape(char *s) {
+        char *d = s;
+        while (*s) {
+                if (s[0] == '\\' && s[1] >= '0' && s[1] <= '7' && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+                        *d++ = (char)(((s[1] - '0') << 6) | ((s[2] - '0') << 3) | (s[3] - '0'));
+                        s += 4;
+                } else {
+                        *d++ = *s++;
+                }
+        }
+        *d = 0;
+}
+
+
+// The /proc/self/mounts doesn't provide the device id, read it from /proc/self/mountinfo and map it to the mount table entries by mountpoint
+static void _mountsLoadIds() {
+        FILE *f = fopen(MOUNTINFO, "r");
+        if (! f) {
+                DEBUG("Cannot open %s -- %s\n", MOUNTINFO, STRERROR);
+                return;
+        }
+        char line[PATH_MAX * 2];
+        char mountpoint[PATH_MAX];
+        unsigned int major, minor;
+        while (fgets(line, sizeof(line), f)) {
+                if (sscanf(line, "%*d %*d %u:%u %*s %4095s", &major, &minor, mountpoint) == 3) {
+                        _unescape(mountpoint);
+                        MountEntry_T *e = _mountIndexGet(Mount_Mountpoint, &(MountEntry_T){.mountpoint = mountpoint});
+                        if (e)
+                                e->id = makedev(major, minor);
+                }
+        }
+        fclose(f);
+        for (int i = 0; i < _mounts.count; i++)
+                if (_mounts.entries[i].id)
+                        _mountIndexAdd(Mount_Id, i);
+}
+
+
+static boolean_t _mountsLoad() {
         FILE *f = setmntent(MOUNTS, "r");
         if (! f) {
                 LogError("Cannot open %s\n", MOUNTS);
                 return false;
         }
-        inf->filesystem->object.generation = _statistics.generation;
-        boolean_t mounted = false;
+        _mountsFree();
         struct mntent *mnt;
-        char flags[STRLEN];
         while ((mnt = getmntent(f))) {
-                // Scan all entries for overlay mounts (common for rootfs)
-                if (compare(path, mnt)) {
-                        snprintf(inf->filesystem->object.device, sizeof(inf->filesystem->object.device), "%s", mnt->mnt_fsname);
-                        snprintf(inf->filesystem->object.mountpoint, sizeof(inf->filesystem->object.mountpoint), "%s", mnt->mnt_dir);
-                        snprintf(inf->filesystem->object.type, sizeof(inf->filesystem->object.type), "%s", mnt->mnt_type);
-                        snprintf(flags, sizeof(flags), "%s", mnt->mnt_opts);
-                        inf->filesystem->object.getDiskUsage = _getDiskUsage; // The disk usage method is common for all filesystem types
-                        inf->filesystem->object.getDiskActivity = _getDummyDiskActivity; // Set to dummy IO statistics method by default (can be overriden bellow if statistics method is available for this filesystem)
-                        if (Str_startsWith(mnt->mnt_type, "nfs")) {
-                                // NFS
-                                inf->filesystem->object.getDiskActivity = _getNfsDiskActivity;
-                        } else if (IS(mnt->mnt_type, "cifs")) {
-                                // CIFS
-                                inf->filesystem->object.getDiskActivity = _statistics.getCifsDiskActivity;
-                                // Need Windows style name - replace '/' with '\' so we can lookup the filesystem activity in /proc/fs/cifs/Stats
-                                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
-                                Str_replaceChar(inf->filesystem->object.key, '/', '\\');
-                        } else if (IS(mnt->mnt_type, "zfs")) {
-                                // ZFS
-                                inf->filesystem->object.getDiskActivity = _getZfsDiskActivity;
-                                // Need base zpool name for /proc/spl/kstat/zfs/<NAME>/io lookup:
-                                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
-                                Str_replaceChar(inf->filesystem->object.key, '/', 0);
-                        } else {
-                                if (realpath(mnt->mnt_fsname, inf->filesystem->object.key)) {
-                                        // Need base name for /sys/class/block/<NAME>/stat or /proc/diskstats lookup:
-                                        snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", File_basename(inf->filesystem->object.key));
-                                        // Test if block device statistics are available for the given filesystem
-                                        if (_statistics.getBlockDiskActivity(inf)) {
-                                                // Block device
-                                                inf->filesystem->object.getDiskActivity = _statistics.getBlockDiskActivity;
-                                        }
-                                }
-                        }
-                        mounted = true;
+                if (_mounts.count == _mounts.capacity) {
+                        _mounts.capacity = _mounts.capacity ? _mounts.capacity * 2 : 64;
+                        RESIZE(_mounts.entries, _mounts.capacity * sizeof(MountEntry_T));
                 }
+                _mounts.entries[_mounts.count++] = (MountEntry_T){
+                        .device = Str_dup(mnt->mnt_fsname),
+                        .mountpoint = Str_dup(mnt->mnt_dir),
+                        .type = Str_dup(mnt->mnt_type),
+                        .options = Str_dup(mnt->mnt_opts)
+                };
         }
         endmntent(f);
-        inf->filesystem->object.mounted = mounted;
-        if (! mounted) {
-                LogError("Lookup for '%s' filesystem failed  -- not found in %s\n", path, MOUNTS);
-        } else {
-                // Evaluate filesystem flags for the last matching mount (overlay mounts for the same filesystem may have different mount flags)
-                if (! IS(flags, inf->filesystem->flags)) {
-                        if (*(inf->filesystem->flags)) {
-                                inf->filesystem->flagsChanged = true;
+        // Keep the load factor <= 0.5
+        int size = 16;
+        while (size < _mounts.count * 2)
+                size *= 2;
+        if (size != _mounts.size) {
+                _mounts.size = size;
+                for (int i = 0; i < Mount_Indexes; i++)
+                        RESIZE(_mounts.index[i], size * sizeof(int));
+        }
+        for (int i = 0; i < Mount_Indexes; i++)
+                memset(_mounts.index[i], 0, size * sizeof(int));
+        for (int i = 0; i < _mounts.count; i++) {
+                _mountIndexAdd(Mount_Mountpoint, i);
+                _mountIndexAdd(Mount_Device, i);
+        }
+        _mountsLoadIds();
+        _mounts.generation = _statistics.generation;
+        DEBUG("Mount table loaded: %d entries\n", _mounts.count);
+        return true;
+}
+
+
+// The device listed in /etc/mtab can be a device mapper symlink (e.g. /dev/mapper/centos-root -> /dev/dm-1) ... the device lookup falls back to realpath
+// if the device didn't match as is. The realpath is expensive with large mount tables (containers), so we resolve it only once per generation, when needed
+static void _mountsResolve() {
+        if (! _mounts.resolved) {
+                char target[PATH_MAX];
+                for (int i = 0; i < _mounts.count; i++) {
+                        MountEntry_T *e = &_mounts.entries[i];
+                        if (*e->device == '/' && realpath(e->device, target)) {
+                                e->realdevice = Str_dup(target);
+                                _mountIndexAdd(Mount_RealDevice, i);
                         }
-                        snprintf(inf->filesystem->flags, sizeof(inf->filesystem->flags), "%s", flags);
                 }
+                _mounts.resolved = true;
         }
-        return mounted;
 }
 
 
-static boolean_t _getDevice(Info_T inf, const char *path, boolean_t (*compare)(const char *path, struct mntent *mnt)) {
+static void _checkGeneration() {
         // Mount/unmount notification: open the /proc/self/mounts file if we're in daemon mode and keep it open until monit
         // stops, so we can poll for mount table changes
         // FIXME: when libev is added register the mount table handler in libev and stop polling here
@@ -381,9 +599,91 @@ static boolean_t _getDevice(Info_T inf, const char *path, boolean_t (*compare)(c
                         LogError("Mount table polling failed -- %s\n", STRERROR);
                 }
         }
+}
+
+
+/**
+ * Returns true if the shared mount table is loaded and current. Without the mount table change notification (not in daemon mode) the table is reloaded
+ * on each filesystem lookup.
+ */
+static boolean_t _mountsCurrent() {
+        if (_mounts.generation == _statistics.generation && _statistics.fd != -1)
+                return true;
+        return _mountsLoad();
+}
+
+
+static MountEntry_T *_findByMountpoint(const char *path) {
+        return _mountIndexGet(Mount_Mountpoint, &(MountEntry_T){.mountpoint = (char *)path});
+}
+
+
+static MountEntry_T *_findByDevice(const char *path) {
+        // Lookup the device as is first (support for NFS/CIFS/SSHFS/etc.) and the dereferenced device path too, the last mount table entry matching either wins (same as for overlay mounts)
+        MountEntry_T *e = _mountIndexGet(Mount_Device, &(MountEntry_T){.device = (char *)path});
+        _mountsResolve();
+        MountEntry_T *r = _mountIndexGet(Mount_RealDevice, &(MountEntry_T){.realdevice = (char *)path});
+        return r > e ? r : e;
+}
+
+
+static boolean_t _setDevice(Info_T inf, const char *path, MountEntry_T *(*find)(const char *path)) {
+        inf->filesystem->object.generation = _statistics.generation;
+        MountEntry_T *mnt = _mountsCurrent() ? find(path) : NULL;
+        if (! mnt) {
+                inf->filesystem->object.mounted = false;
+                LogError("Lookup for '%s' filesystem failed  -- not found in %s\n", path, MOUNTS);
+                return false;
+        }
+        snprintf(inf->filesystem->object.device, sizeof(inf->filesystem->object.device), "%s", mnt->device);
+        snprintf(inf->filesystem->object.mountpoint, sizeof(inf->filesystem->object.mountpoint), "%s", mnt->mountpoint);
+        snprintf(inf->filesystem->object.type, sizeof(inf->filesystem->object.type), "%s", mnt->type);
+        inf->filesystem->object.id = mnt->id;
+        inf->filesystem->object.getDiskUsage = _getDiskUsage; // The disk usage method is common for all filesystem types
+        inf->filesystem->object.getDiskActivity = _getDummyDiskActivity; // Set to dummy IO statistics method by default (can be overriden bellow if statistics method is available for this filesystem)
+        if (Str_startsWith(mnt->type, "nfs")) {
+                // NFS
+                inf->filesystem->object.getDiskActivity = _getNfsDiskActivity;
+        } else if (IS(mnt->type, "cifs")) {
+                // CIFS
+                inf->filesystem->object.getDiskActivity = _statistics.getCifsDiskActivity;
+                // Need Windows style name - replace '/' with '\' so we can lookup the filesystem activity in /proc/fs/cifs/Stats
+                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
+                Str_replaceChar(inf->filesystem->object.key, '/', '\\');
+        } else if (IS(mnt->type, "zfs")) {
+                // ZFS
+                inf->filesystem->object.getDiskActivity = _getZfsDiskActivity;
+                // Need base zpool name for /proc/spl/kstat/zfs/<NAME>/io lookup:
+                snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", inf->filesystem->object.device);
+                Str_replaceChar(inf->filesystem->object.key, '/', 0);
+        } else {
+                if (realpath(mnt->device, inf->filesystem->object.key)) {
+                        // Need base name for /sys/class/block/<NAME>/stat or /proc/diskstats lookup:
+                        snprintf(inf->filesystem->object.key, sizeof(inf->filesystem->object.key), "%s", File_basename(inf->filesystem->object.key));
+                        // Test if block device statistics are available for the given filesystem
+                        if (_getBlockDiskActivity(inf)) {
+                                // Block device
+                                inf->filesystem->object.getDiskActivity = _getBlockDiskActivity;
+                        }
+                }
+        }
+        inf->filesystem->object.mounted = true;
+        // Evaluate filesystem flags for the last matching mount (overlay mounts for the same filesystem may have different mount flags)
+        if (! IS(mnt->options, inf->filesystem->flags)) {
+                if (*(inf->filesystem->flags)) {
+                        inf->filesystem->flagsChanged = true;
+                }
+                snprintf(inf->filesystem->flags, sizeof(inf->filesystem->flags), "%s", mnt->options);
+        }
+        return true;
+}
+
+
+static boolean_t _getDevice(Info_T inf, const char *path, MountEntry_T *(*find)(const char *path)) {
+        _checkGeneration();
         if (inf->filesystem->object.generation != _statistics.generation || _statistics.fd == -1) {
                 DEBUG("Reloading mount information for filesystem '%s'\n", path);
-                _setDevice(inf, path, compare);
+                _setDevice(inf, path, find);
         }
         if (inf->filesystem->object.mounted) {
                 return (inf->filesystem->object.getDiskUsage(inf) && inf->filesystem->object.getDiskActivity(inf));
@@ -399,7 +699,6 @@ static void __attribute__ ((constructor)) _constructor() {
         struct stat sb;
         _statistics.fd = -1;
         _statistics.generation++; // First generation
-        _statistics.getBlockDiskActivity = stat("/sys/class/block", &sb) == 0 ? _getSysfsBlockDiskActivity : _getProcfsBlockDiskActivity;
         _statistics.getCifsDiskActivity = stat(CIFSSTAT, &sb) == 0 ? _getCifsDiskActivity : _getDummyDiskActivity;
 }
 
@@ -408,6 +707,12 @@ static void __attribute__ ((destructor)) _destructor() {
         if (_statistics.fd > -1) {
                   close(_statistics.fd);
         }
+        _mountsFree();
+        FREE(_mounts.entries);
+        FREE(_diskStats.list);
+        FREE(_diskUsage.list);
+        for (int i = 0; i < Mount_Indexes; i++)
+                FREE(_mounts.index[i]);
 }
 
 
@@ -417,13 +722,24 @@ static void __attribute__ ((destructor)) _destructor() {
 boolean_t Filesystem_getByMountpoint(Info_T inf, const char *path) {
         ASSERT(inf);
         ASSERT(path);
-        return _getDevice(inf, path, _compareMountpoint);
+        return _getDevice(inf, path, _findByMountpoint);
 }
 
 
 boolean_t Filesystem_getByDevice(Info_T inf, const char *path) {
         ASSERT(inf);
         ASSERT(path);
-        return _getDevice(inf, path, _compareDevice);
+        return _getDevice(inf, path, _findByDevice);
+}
+
+
+const char *Filesystem_typeById(dev_t id) {
+        _checkGeneration();
+        if (_mountsCurrent()) {
+                MountEntry_T *e = _mountIndexGet(Mount_Id, &(MountEntry_T){.id = id});
+                if (e)
+                        return e->type;
+        }
+        return NULL;
 }
 
@@ -283,3 +283,8 @@ boolean_t Filesystem_getByDevice(Info_T inf, const char *path) {
         return _getDevice(inf, path, _compareDevice);
 }
 
+
+const char *Filesystem_typeById(dev_t id) {
+        return NULL;
+}
+
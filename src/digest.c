@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#include "monit.h"
+#include "util.h"
+#include "md5.h"
+#include "sha1.h"
+#include "digest.h"
+
+
+/**
+ * Implementation of the Digest. The OpenSSL EVP digest is preferred, the
+ * bundled MD5 and SHA1 code is used as a fallback if the EVP digest is not
+ * available (no SSL support or e.g. MD5 in FIPS mode).
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define DIGEST_BLOCKSIZE 1048576
+
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+
+typedef struct Xxh64_T {
+        uint64_t total;                                 /**< Total data length */
+        uint64_t v[4];                                       /**< Accumulators */
+        unsigned char buffer[32];                     /**< Unprocessed stripe */
+        size_t length;                          /**< Unprocessed stripe length */
+} Xxh64_T;
+
+
+#define T Digest_T
+struct T {
+        Hash_Type type;
+#ifdef HAVE_OPENSSL
+        EVP_MD_CTX *evp;                /**< The EVP context or NULL if not used */
+#endif
+        union {
+                md5_context_t md5;
+                sha1_context_t sha1;
+                Xxh64_T xxh64;
+        } context;
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static inline uint64_t _rotl64(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t _read64(const unsigned char *p) {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+
+static inline uint64_t _read32(const unsigned char *p) {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+}
+
+
+static inline uint64_t _xxh64Round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME64_2;
+        acc = _rotl64(acc, 31);
+        return acc * PRIME64_1;
+}
+
+
+static inline uint64_t _xxh64Merge(uint64_t acc, uint64_t value) {
+        acc ^= _xxh64Round(0, value);
+        return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+static void _xxh64Init(Xxh64_T *x) {
+        *x = (Xxh64_T){.v = {PRIME64_1 + PRIME64_2, PRIME64_2, 0, -PRIME64_1}};
+}
+
+
+static void _xxh64Stripe(Xxh64_T *x, const unsigned char *p) {
+        for (int i = 0; i < 4; i++)
+                x->v[i] = _xxh64Round(x->v[i], _read64(p + i * 8));
+}
+
+
+static void _xxh64Update(Xxh64_T *x, const unsigned char *data, size_t length) {
+        x->total += length;
+        if (x->length) {
+                size_t n = MIN(length, 32 - x->length);
+                memcpy(x->buffer + x->length, data, n);
+                x->length += n;
+                data += n;
+                length -= n;
+                if (x->length < 32)
+                        return;
+                _xxh64Stripe(x, x->buffer);
+                x->length = 0;
+        }
+        for (; length >= 32; data += 32, length -= 32)
+                _xxh64Stripe(x, data);
+        if (length) {
+                memcpy(x->buffer, data, length);
+                x->length = length;
+        }
+}
+
+
+static void _xxh64Finish(Xxh64_T *x, unsigned char digest[8]) {
+        uint64_t h;
+        if (x->total >= 32) {
+                h = _rotl64(x->v[0], 1) + _rotl64(x->v[1], 7) + _rotl64(x->v[2], 12) + _rotl64(x->v[3], 18);
+                for (int i = 0; i < 4; i++)
+                        h = _xxh64Merge(h, x->v[i]);
+        } else {
+                h = x->v[2] + PRIME64_5; // v[2] holds the seed
+        }
+        h += x->total;
+        const unsigned char *p = x->buffer, *end = x->buffer + x->length;
+        for (; p + 8 <= end; p += 8)
+                h = _rotl64(h ^ _xxh64Round(0, _read64(p)), 27) * PRIME64_1 + PRIME64_4;
+        if (p + 4 <= end) {
+                h = _rotl64(h ^ (_read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+                p += 4;
+        }
+        for (; p < end; p++)
+                h = _rotl64(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        // Canonical (big endian) representation
+        for (int i = 7; i >= 0; i--, h >>= 8)
+                digest[i] = h & 0xff;
+}
+
+
+#ifdef HAVE_OPENSSL
+static const EVP_MD *_evp(Hash_Type type) {
+        switch (type) {
+                case Hash_Md5:
+                        return EVP_md5();
+                case Hash_Sha1:
+                        return EVP_sha1();
+                case Hash_Sha256:
+                        return EVP_sha256();
+                default:
+                        return NULL;
+        }
+}
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T Digest_new(Hash_Type type) {
+        if (! Digest_length(type))
+                return NULL;
+        T D;
+        NEW(D);
+        D->type = type;
+#ifdef HAVE_OPENSSL
+        const EVP_MD *md = _evp(type);
+        if (md) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+                D->evp = EVP_MD_CTX_create();
+#else
+                D->evp = EVP_MD_CTX_new();
+#endif
+                if (D->evp && ! EVP_DigestInit_ex(D->evp, md, NULL)) {
+                        // The digest is not available (e.g. MD5 in FIPS mode) => use the bundled implementation
+                        DEBUG("Digest: %s is not available in OpenSSL, using the builtin implementation\n", checksumnames[type]);
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+                        EVP_MD_CTX_destroy(D->evp);
+#else
+                        EVP_MD_CTX_free(D->evp);
+#endif
+                        D->evp = NULL;
+                }
+                if (! D->evp && type == Hash_Sha256) {
+                        FREE(D);
+                        return NULL;
+                }
+        }
+#endif
+        Digest_reset(D);
+        return D;
+}
+
+
+void Digest_free(T *D) {
+        ASSERT(D && *D);
+#ifdef HAVE_OPENSSL
+        if ((*D)->evp) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+                EVP_MD_CTX_destroy((*D)->evp);
+#else
+                EVP_MD_CTX_free((*D)->evp);
+#endif
+        }
+#endif
+        FREE(*D);
+}
+
+
+void Digest_reset(T D) {
+        ASSERT(D);
+#ifdef HAVE_OPENSSL
+        if (D->evp) {
+                EVP_DigestInit_ex(D->evp, _evp(D->type), NULL);
+                return;
+        }
+#endif
+        switch (D->type) {
+                case Hash_Md5:
+                        md5_init(&D->context.md5);
+                        break;
+                case Hash_Sha1:
+                        sha1_init(&D->context.sha1);
+                        break;
+                case Hash_Xxh64:
+                        _xxh64Init(&D->context.xxh64);
+                        break;
+                default:
+                        break;
+        }
+}
+
+
+void Digest_update(T D, const void *data, size_t length) {
+        ASSERT(D);
+#ifdef HAVE_OPENSSL
+        if (D->evp) {
+                EVP_DigestUpdate(D->evp, data, length);
+                return;
+        }
+#endif
+        switch (D->type) {
+                case Hash_Md5:
+                        // The bundled md5_append() takes int length
+                        for (const unsigned char *p = data; length > 0; ) {
+                                int n = (int)MIN(length, DIGEST_BLOCKSIZE);
+                                md5_append(&D->context.md5, (const md5_byte_t *)p, n);
+                                p += n;
+                                length -= n;
+                        }
+                        break;
+                case Hash_Sha1:
+                        sha1_append(&D->context.sha1, data, length);
+                        break;
+                case Hash_Xxh64:
+                        _xxh64Update(&D->context.xxh64, data, length);
+                        break;
+                default:
+                        break;
+        }
+}
+
+
+char *Digest_finish(T D, MD_T result) {
+        ASSERT(D);
+        ASSERT(result);
+        unsigned char digest[64];
+        int length = Digest_length(D->type);
+#ifdef HAVE_OPENSSL
+        if (D->evp) {
+                unsigned int n = 0;
+                EVP_DigestFinal_ex(D->evp, digest, &n);
+                return Util_digest2Bytes(digest, n, result);
+        }
+#endif
+        switch (D->type) {
+                case Hash_Md5:
+                        md5_finish(&D->context.md5, digest);
+                        break;
+                case Hash_Sha1:
+                        sha1_finish(&D->context.sha1, digest);
+                        break;
+                case Hash_Xxh64:
+                        _xxh64Finish(&D->context.xxh64, digest);
+                        break;
+                default:
+                        break;
+        }
+        return Util_digest2Bytes(digest, length, result);
+}
+
+
+boolean_t Digest_read(int fd, T *digests, int count) {
+        ASSERT(digests);
+        void *buffer;
+#ifdef HAVE_POSIX_MEMALIGN
+        if (posix_memalign(&buffer, 4096, DIGEST_BLOCKSIZE) != 0)
+                return false;
+#else
+        buffer = ALLOC(DIGEST_BLOCKSIZE);
+#endif
+#ifdef HAVE_POSIX_FADVISE
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        boolean_t rv = true;
+        ssize_t n;
+        while ((n = read(fd, buffer, DIGEST_BLOCKSIZE)) != 0) {
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        rv = false;
+                        break;
+                }
+                for (int i = 0; i < count; i++)
+                        Digest_update(digests[i], buffer, n);
+        }
+        int _errno = errno;
+        free(buffer);
+        errno = _errno;
+        return rv;
+}
+
+
+Hash_Type Digest_getType(T D) {
+        ASSERT(D);
+        return D->type;
+}
+
+
+int Digest_length(Hash_Type type) {
+        switch (type) {
+                case Hash_Md5:
+                        return 16;
+                case Hash_Sha1:
+                        return 20;
+#ifdef HAVE_OPENSSL
+                case Hash_Sha256:
+                        return 32;
+#endif
+                case Hash_Xxh64:
+                        return 8;
+                default:
+                        return 0;
+        }
+}
+
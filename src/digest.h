@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#ifndef MONIT_DIGEST_H
+#define MONIT_DIGEST_H
+
+
+/**
+ * A message <b>Digest</b> computation. The digest uses the OpenSSL EVP
+ * interface if Monit was built with SSL support (so the hardware hash
+ * instructions are used if available), otherwise the bundled MD5 and SHA1
+ * implementations. The SHA256 digest requires OpenSSL. The XXH64 digest
+ * is a fast non-cryptographic hash, suitable for change detection only.
+ *
+ * @file
+ */
+
+
+#define T Digest_T
+typedef struct T *T;
+
+
+/**
+ * Create a new Digest
+ * @param type The hash type
+ * @return A new Digest object or NULL if the hash type is not supported
+ */
+T Digest_new(Hash_Type type);
+
+
+/**
+ * Destroy the Digest and set *D to NULL
+ * @param D A Digest object reference
+ */
+void Digest_free(T *D);
+
+
+/**
+ * Restart the digest computation
+ * @param D A Digest object
+ */
+void Digest_reset(T D);
+
+
+/**
+ * Add the data to the digest
+ * @param D A Digest object
+ * @param data The data
+ * @param length The data length
+ */
+void Digest_update(T D, const void *data, size_t length);
+
+
+/**
+ * Finish the digest computation. The Digest has to be reset before reuse.
+ * @param D A Digest object
+ * @param result The buffer for the hex encoded digest
+ * @return The result buffer
+ */
+char *Digest_finish(T D, MD_T result);
+
+
+/**
+ * Read the file to its end and add its content to the digests. The file
+ * is read sequentially in large blocks.
+ * @param fd The file descriptor
+ * @param digests The array of Digest objects
+ * @param count The number of digests
+ * @return true on success, false on read error (errno is set)
+ */
+boolean_t Digest_read(int fd, T *digests, int count);
+
+
+/**
+ * Get the Digest hash type
+ * @param D A Digest object
+ * @return The hash type
+ */
+Hash_Type Digest_getType(T D);
+
+
+/**
+ * Get the digest length
+ * @param type The hash type
+ * @return The length of the (binary) digest or 0 if the hash type is not supported
+ */
+int Digest_length(Hash_Type type);
+
+
+#undef T
+#endif
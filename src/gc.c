@@ -39,6 +39,7 @@
 #include "protocol.h"
 #include "ProcessTree.h"
 #include "engine.h"
+#include "digest.h"
 
 
 /* Private prototypes */
@@ -56,6 +57,7 @@ static void _gc_action(Action_T *);
 static void _gc_eventaction(EventAction_T *);
 static void _gcpdl(Dependant_T *);
 static void _gcso(Size_T *);
+static void _gctree(Tree_T *);
 static void _gclinkstatus(LinkStatus_T *);
 static void _gclinkspeed(LinkSpeed_T *);
 static void _gclinksaturation(LinkSaturation_T *);
@@ -209,6 +211,8 @@ static void _gc_service(Service_T *s) {
                 _gcparl(&(*s)->actionratelist);
         if ((*s)->sizelist)
                 _gcso(&(*s)->sizelist);
+        if ((*s)->treelist)
+                _gctree(&(*s)->treelist);
         if ((*s)->linkstatuslist)
                 _gclinkstatus(&(*s)->linkstatuslist);
         if ((*s)->linkspeedlist)
@@ -227,6 +231,8 @@ static void _gc_service(Service_T *s) {
                 _gcmatch(&(*s)->matchlist);
         if ((*s)->matchignorelist)
                 _gcmatch(&(*s)->matchignorelist);
+        if ((*s)->matchfilter)
+                Prefilter_free(&(*s)->matchfilter);
         if ((*s)->checksum)
                 _gcchecksum(&(*s)->checksum);
         if ((*s)->perm)
@@ -275,6 +281,8 @@ static void _gc_service(Service_T *s) {
                 _gcsecattr(&(*s)->secattrlist);
         switch ((*s)->type) {
                 case Service_Directory:
+                        if ((*s)->inf.directory->snapshot)
+                                Snapshot_free(&(*s)->inf.directory->snapshot);
                         FREE((*s)->inf.directory);
                         break;
                 case Service_Fifo:
@@ -320,6 +328,8 @@ static void _gc_request(Request_T *r) {
         if ((*r)->regex)
                 regfree((*r)->regex);
         FREE((*r)->regex);
+        if ((*r)->prefilter)
+                Prefilter_free(&(*r)->prefilter);
         FREE(*r);
 }
 
@@ -380,6 +390,8 @@ static void _gcportlist(Port_T *p) {
                 _gcssloptions(&((*p)->target.net.ssl.options));
         FREE((*p)->hostname);
         FREE((*p)->outgoing.ip);
+        if ((*p)->pooled)
+                Socket_free(&(*p)->pooled);
         if ((*p)->protocol->check == check_http) {
                 FREE((*p)->parameters.http.username);
                 FREE((*p)->parameters.http.password);
@@ -479,6 +491,16 @@ static void _gcso(Size_T *s) {
         FREE(*s);
 }
 
+
+static void _gctree(Tree_T *t) {
+        ASSERT(t);
+        if ((*t)->next)
+                _gctree(&(*t)->next);
+        if ((*t)->action)
+                _gc_eventaction(&(*t)->action);
+        FREE(*t);
+}
+
 static void _gclinkstatus(LinkStatus_T *l) {
         ASSERT(l);
         if ((*l)->next)
@@ -538,6 +560,9 @@ static void _gcchecksum(Checksum_T *s) {
         ASSERT(s);
         if ((*s)->action)
                 _gc_eventaction(&(*s)->action);
+        if ((*s)->digest)
+                Digest_free(&(*s)->digest);
+        FREE((*s)->cache);
         FREE(*s);
 }
 
@@ -85,6 +85,7 @@
 #include "protocol.h"
 #include "Color.h"
 #include "Box.h"
+#include "resolver.h"
 
 
 #define ACTION(c) ! strncasecmp(req->url, c, sizeof(c))
@@ -157,6 +158,7 @@ static void print_service_rules_timestamp(HttpResponse, Service_T);
 static void print_service_rules_fsflags(HttpResponse, Service_T);
 static void print_service_rules_filesystem(HttpResponse, Service_T);
 static void print_service_rules_size(HttpResponse, Service_T);
+static void print_service_rules_tree(HttpResponse, Service_T);
 static void print_service_rules_linkstatus(HttpResponse, Service_T);
 static void print_service_rules_linkspeed(HttpResponse, Service_T);
 static void print_service_rules_linksaturation(HttpResponse, Service_T);
@@ -232,6 +234,15 @@ static char *_getUptime(time_t delta, char s[256]) {
 }
 
 
+/* Describe the connect and request time of the keep-alive port separately, as the response time doesn't include the connect when the kept connection was reused */
+static char *_portTiming(Port_T p, char *buf, int bufsize) {
+        *buf = 0;
+        if (p->protocol->check == check_http && p->parameters.http.keepalive && p->is_available == Connection_Ok)
+                snprintf(buf, bufsize, " (connect %s, request %s)", p->timing.connect > 0. ? Fmt_time2str(p->timing.connect, (char[11]){}) : "reused", Fmt_time2str(p->timing.request, (char[11]){}));
+        return buf;
+}
+
+
 static void _formatStatus(const char *name, Event_Type errorType, Output_Type type, HttpResponse res, Service_T s, boolean_t validValue, const char *value, ...) {
         if (type == HTML) {
                 StringBuffer_append(res->outputbuffer, "<tr><td>%c%s</td>", toupper(name[0]), name + 1);
@@ -339,6 +350,12 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("access timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.access > 0, "%s", Time_string(s->inf.directory->timestamp.access, (char[32]){}));
                                 _formatStatus("change timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.change > 0, "%s", Time_string(s->inf.directory->timestamp.change, (char[32]){}));
                                 _formatStatus("modify timestamp", Event_Timestamp, type, res, s, s->inf.directory->timestamp.modify > 0, "%s", Time_string(s->inf.directory->timestamp.modify, (char[32]){}));
+                                if (s->treelist) {
+                                        _formatStatus("entries", Event_Size, type, res, s, s->inf.directory->tree.entries >= 0, "%d", s->inf.directory->tree.entries);
+                                        _formatStatus("total size", Event_Size, type, res, s, s->inf.directory->tree.entries >= 0, "%s", Fmt_bytes2str(s->inf.directory->tree.size, (char[10]){}));
+                                        _formatStatus("oldest entry", Event_Timestamp, type, res, s, s->inf.directory->tree.oldest > 0, "%s", Time_string(s->inf.directory->tree.oldest, (char[32]){}));
+                                        _formatStatus("changed entries", Event_Timestamp, type, res, s, s->inf.directory->tree.entries >= 0, "%d", s->inf.directory->tree.changed);
+                                }
                                 break;
 
                         case Service_Fifo:
@@ -459,14 +476,14 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 char buf[STRLEN] = {};
                                 if (p->target.net.ssl.options.flags)
                                         snprintf(buf, sizeof(buf), "using TLS (certificate valid for %d days) ", p->target.net.ssl.certificate.validDays);
-                                _formatStatus("port response time", p->target.net.ssl.certificate.validDays < p->target.net.ssl.certificate.minimumDays ? Event_Timestamp : Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s %sprotocol %s", Fmt_time2str(p->response, (char[11]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), buf, p->protocol->name);
+                                _formatStatus("port response time", p->target.net.ssl.certificate.validDays < p->target.net.ssl.certificate.minimumDays ? Event_Timestamp : Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s %sprotocol %s%s", Fmt_time2str(p->response, (char[11]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), buf, p->protocol->name, _portTiming(p, (char[STRLEN]){}, STRLEN));
                         }
                 }
                 for (Port_T p = s->socketlist; p; p = p->next) {
                         if (p->is_available == Connection_Failed) {
                                 _formatStatus("unix socket response time", Event_Connection, type, res, s, true, "FAILED to %s type %s protocol %s", p->target.unix.pathname, Util_portTypeDescription(p), p->protocol->name);
                         } else {
-                                _formatStatus("unix socket response time", Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s type %s protocol %s", Fmt_time2str(p->response, (char[11]){}), p->target.unix.pathname, Util_portTypeDescription(p), p->protocol->name);
+                                _formatStatus("unix socket response time", Event_Null, type, res, s, p->is_available != Connection_Init, "%s to %s type %s protocol %s%s", Fmt_time2str(p->response, (char[11]){}), p->target.unix.pathname, Util_portTypeDescription(p), p->protocol->name, _portTiming(p, (char[STRLEN]){}, STRLEN));
                         }
                 }
         }
@@ -825,6 +842,12 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for service stop timeout</td><td>%s</td></tr>", Fmt_time2str(Run.limits.stopTimeout, (char[11]){}));
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for service start timeout</td><td>%s</td></tr>", Fmt_time2str(Run.limits.startTimeout, (char[11]){}));
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for service restart timeout</td><td>%s</td></tr>", Fmt_time2str(Run.limits.restartTimeout, (char[11]){}));
+        StringBuffer_append(res->outputbuffer, "<tr><td>Limit for DNS cache TTL</td><td>%s</td></tr>", Fmt_time2str(Run.limits.dnsTTL, (char[11]){}));
+        Resolver_Statistics_T resolver;
+        Resolver_statistics(&resolver);
+        StringBuffer_append(res->outputbuffer,
+                            "<tr><td>DNS cache</td><td>%d entries, %llu hits, %llu stale hits, %llu misses, %llu errors</td></tr>",
+                            resolver.entries, resolver.hits, resolver.stale, resolver.misses, resolver.errors);
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>On reboot</td><td>%s</td></tr>", onrebootnames[Run.onreboot]);
         StringBuffer_append(res->outputbuffer,
@@ -1128,6 +1151,8 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
                         StringBuffer_append(res->outputbuffer, "every <code>\"%s\"</code>", s->every.spec.cron);
                 else if (s->every.type == Every_NotInCron)
                         StringBuffer_append(res->outputbuffer, "not every <code>\"%s\"</code>", s->every.spec.cron);
+                else if (s->every.type == Every_Interval)
+                        StringBuffer_append(res->outputbuffer, "every %d seconds", s->every.spec.interval.seconds);
                 StringBuffer_append(res->outputbuffer, "</td></tr>");
         }
         _printStatus(HTML, res, s);
@@ -1147,6 +1172,7 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         print_service_rules_fsflags(res, s);
         print_service_rules_filesystem(res, s);
         print_service_rules_size(res, s);
+        print_service_rules_tree(res, s);
         print_service_rules_linkstatus(res, s);
         print_service_rules_linkspeed(res, s);
         print_service_rules_linksaturation(res, s);
@@ -2048,6 +2074,31 @@ static void print_service_rules_size(HttpResponse res, Service_T s) {
 }
 
 
+static void print_service_rules_tree(HttpResponse res, Service_T s) {
+        for (Tree_T t = s->treelist; t; t = t->next) {
+                switch (t->type) {
+                        case Tree_Entries:
+                                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Entries</td><td>");
+                                Util_printRule(res->outputbuffer, t->action, "If %s %llu", operatornames[t->operator], t->limit);
+                                break;
+                        case Tree_Size:
+                                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Total size</td><td>");
+                                Util_printRule(res->outputbuffer, t->action, "If %s %s", operatornames[t->operator], Fmt_bytes2str(t->limit, (char[10]){}));
+                                break;
+                        case Tree_Oldest:
+                                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Oldest entry</td><td>");
+                                Util_printRule(res->outputbuffer, t->action, "If %s %s", operatornames[t->operator], Fmt_time2str(t->limit * 1000., (char[11]){}));
+                                break;
+                        case Tree_Changed:
+                                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Entries</td><td>");
+                                Util_printRule(res->outputbuffer, t->action, "If changed");
+                                break;
+                }
+                StringBuffer_append(res->outputbuffer, "</td></tr>");
+        }
+}
+
+
 static void print_service_rules_linkstatus(HttpResponse res, Service_T s) {
         for (LinkStatus_T l = s->linkstatuslist; l; l = l->next) {
                 StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Link status</td><td>");
@@ -209,8 +209,10 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                             S->doaction);
         if (S->every.type != Every_Cycle) {
                 StringBuffer_append(B, "<every><type>%d</type>", S->every.type);
-                if (S->every.type == 1)
+                if (S->every.type == Every_SkipCycles)
                         StringBuffer_append(B, "<counter>%d</counter><number>%d</number>", S->every.spec.cycle.counter, S->every.spec.cycle.number);
+                else if (S->every.type == Every_Interval)
+                        StringBuffer_append(B, "<interval>%d</interval>", S->every.spec.interval.seconds);
                 else
                         StringBuffer_append(B, "<cron>%s</cron>", S->every.spec.cron);
                 StringBuffer_append(B, "</every>");
@@ -255,6 +257,18 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                         S->inf.directory->timestamp.access,
                                         S->inf.directory->timestamp.change,
                                         S->inf.directory->timestamp.modify);
+                                if (S->treelist && S->inf.directory->tree.entries >= 0)
+                                        StringBuffer_append(B,
+                                                "<tree>"
+                                                "<entries>%d</entries>"
+                                                "<size>%llu</size>"
+                                                "<oldest>%"PRIu64"</oldest>"
+                                                "<changed>%d</changed>"
+                                                "</tree>",
+                                                S->inf.directory->tree.entries,
+                                                S->inf.directory->tree.size,
+                                                (uint64_t)S->inf.directory->tree.oldest,
+                                                S->inf.directory->tree.changed);
                                 break;
 
                         case Service_Fifo:
@@ -74,6 +74,10 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #include "monit.h"
 #include "net.h"
 #include "ProcessTree.h"
@@ -82,6 +86,7 @@
 #include "engine.h"
 #include "client.h"
 #include "MMonit.h"
+#include "watch.h"
 
 // libmonit
 #include "Bootstrap.h"
@@ -140,7 +145,7 @@ static volatile boolean_t heartbeatRunning = false;
 char *actionnames[] = {"ignore", "alert", "restart", "stop", "exec", "unmonitor", "start", "monitor", ""};
 char *modenames[] = {"active", "passive"};
 char *onrebootnames[] = {"start", "nostart", "laststate"};
-char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1"};
+char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1", "SHA256", "XXH64"};
 char *operatornames[] = {"less than", "less than or equal to", "greater than", "greater than or equal to", "equal to", "not equal to", "changed"};
 char *operatorshortnames[] = {"<", "<=", ">", ">=", "=", "!=", "<>"};
 char *servicetypes[] = {"Filesystem", "Directory", "File", "Process", "Remote Host", "System", "Fifo", "Program", "Network"};
@@ -212,6 +217,25 @@ static void _validateOnce() {
 }
 
 
+/**
+ * Sleep for the given number of seconds. If the file change notification is active, wake up when some watched file changes and test it.
+ * The changed files are tested once per second at maximum, so a busy file such as a log doesn't keep Monit busy.
+ */
+static void _sleep(time_t seconds) {
+        int fd = Watch_getDescriptor();
+        if (fd != -1) {
+                struct pollfd notify = {.fd = fd, .events = POLLIN};
+                if (poll(&notify, 1, (int)seconds * 1000) > 0) {
+                        validate_changed();
+                        if (seconds > 1)
+                                sleep(1);
+                }
+        } else {
+                sleep((unsigned int)seconds);
+        }
+}
+
+
 /**
  * Initialize this application - Register signal handlers,
  * Parse the control file and initialize the program's
@@ -356,6 +380,10 @@ static void do_reinit() {
 
         /* Run the garbage collector */
         gc();
+        ProcessTree_reload();
+#ifdef HAVE_OPENSSL
+        Ssl_clearCache();
+#endif
 
         if (! parse(Run.files.control)) {
                 LogError("%s stopped -- error parsing configuration file\n", prog);
@@ -392,6 +420,8 @@ static void do_reinit() {
         if (can_http())
                 monit_http(Httpd_Start);
 
+        Watch_init();
+
         /* send the monit startup notification */
         Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit reloaded");
 
@@ -574,6 +604,8 @@ static void do_default() {
                 if (can_http())
                         monit_http(Httpd_Start);
 
+                Watch_init();
+
                 /* send the monit startup notification */
                 Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit %s started", VERSION);
 
@@ -585,9 +617,18 @@ static void do_default() {
                 while (true) {
                         validate();
 
-                        /* In the case that there is no pending action then sleep */
-                        if (! (Run.flags & Run_ActionPending) && ! interrupt())
-                                sleep(Run.polltime);
+                        /* In the case that there is no pending action then sleep until the next cycle, wake up earlier to check the services with their own check interval */
+                        time_t cycle = Time_now() + Run.polltime;
+                        while (! (Run.flags & Run_ActionPending) && ! (Run.flags & Run_DoWakeup) && ! interrupt()) {
+                                time_t now = Time_now();
+                                if (now >= cycle)
+                                        break;
+                                time_t deadline = validate_deadline();
+                                if (deadline && deadline <= now)
+                                        validate_due();
+                                else
+                                        _sleep((deadline && deadline < cycle ? deadline : cycle) - now);
+                        }
 
                         if (Run.flags & Run_DoWakeup) {
                                 Run.flags &= ~Run_DoWakeup;
@@ -821,8 +862,9 @@ static void help() {
                " -t            Run syntax check for the control file\n"
                " -v            Verbose mode, work noisy (diagnostic output)\n"
                " -vv           Very verbose mode, same as -v plus log stacktrace on error\n"
-               " -H [filename] Print SHA1 and MD5 hashes of the file or of stdin if the\n"
-               "               filename is omited; monit will exit afterwards\n"
+               " -H [filename] Print SHA1, MD5, SHA256 and XXH64 hashes of the file or of\n"
+               "               stdin if the filename is omited; monit will exit afterwards\n"
+               "               (use -v -H to print the throughput of each hash too)\n"
                " -V            Print version number and patchlevel\n"
                " -h            Print this text\n"
                "Optional commands are as follows:\n"
@@ -121,6 +121,8 @@ typedef enum {
 
 #include "Ssl.h"
 #include "Address.h"
+#include "prefilter.h"
+#include "snapshot.h"
 
 
 // libmonit
@@ -197,7 +199,8 @@ typedef enum {
         Every_Cycle = 0,
         Every_SkipCycles,
         Every_Cron,
-        Every_NotInCron
+        Every_NotInCron,
+        Every_Interval
 } __attribute__((__packed__)) Every_Type;
 
 
@@ -230,6 +233,14 @@ typedef enum {
 } __attribute__((__packed__)) Timestamp_Type;
 
 
+typedef enum {
+        Tree_Entries = 0,
+        Tree_Size,
+        Tree_Oldest,
+        Tree_Changed
+} __attribute__((__packed__)) Tree_Type;
+
+
 typedef enum {
         Httpd_Disabled                    = 0x0,
         Httpd_Net                         = 0x1,  // IP
@@ -360,6 +371,8 @@ typedef enum {
         Hash_Unknown = 0,
         Hash_Md5,
         Hash_Sha1,
+        Hash_Sha256,
+        Hash_Xxh64,
         Hash_Default = Hash_Md5
 } __attribute__((__packed__)) Hash_Type;
 
@@ -398,6 +411,9 @@ typedef enum {
 #define LIMIT_STOPTIMEOUT       30000
 #define LIMIT_STARTTIMEOUT      30000
 #define LIMIT_RESTARTTIMEOUT    30000
+#define LIMIT_CHECKSUMBUDGET    0
+#define LIMIT_TREEBUDGET        10000
+#define LIMIT_DNSTTL            60000
 
 
 #include "socket.h"
@@ -453,6 +469,9 @@ typedef struct Limits_T {
         uint32_t stopTimeout;                     /**< Default stop timeout [ms] */
         uint32_t startTimeout;                   /**< Default start timeout [ms] */
         uint32_t restartTimeout;               /**< Default restart timeout [ms] */
+        uint32_t checksumBudget;   /**< Checksum bytes hashed per cycle (0 = all) [B] */
+        uint32_t treeBudget;    /**< Directory tree entries walked per cycle (0 = all) */
+        uint32_t dnsTTL;        /**< Resolver cache entry lifetime (0 = no cache) [ms] */
 } Limits_T;
 
 
@@ -511,6 +530,7 @@ typedef struct Request_T {
         URL_T url;                                               /**< URL request */
         Operator_Type operator;         /**< Response content comparison operator */
         regex_t *regex;                   /* regex used to test the response body */
+        Prefilter_T prefilter;                   /* literal prefilter of the regex */
 } *Request_T;
 
 
@@ -645,7 +665,21 @@ typedef struct Port_T {
         int timeout;      /**< The timeout in [ms] to wait for connect or read i/o */
         int retry;       /**< Number of connection retry before reporting an error */
         volatile int socket;                       /**< Socket used for connection */
+        struct {
+                boolean_t started;  /**< true if Socket_connectAll() connected the port */
+                int socket;               /**< The connected socket or -1 if failed */
+                int error;                   /**< The connect errno if the connect failed */
+                double response;                         /**< The connect time [ms] */
+                int64_t connected;            /**< The time when the connect completed [us] */
+                struct addrinfo *result;            /**< The resolved host addresses */
+                struct addrinfo *address;        /**< The address connected to */
+        } preconnect;
+        Socket_T pooled;       /**< Connection kept open for the next test (keep-alive) */
         double response;                 /**< Socket connection response time [ms] */
+        struct {
+                double connect;           /**< Connect time [ms], 0 if the connection was reused */
+                double request;                       /**< Protocol test (request) time [ms] */
+        } timing;
         Socket_Type type;           /**< Socket type used for connection (UDP/TCP) */
         Socket_Family family;    /**< Socket family used for connection (NET/UNIX) */
         Connection_State is_available;               /**< Server/port availability */
@@ -691,6 +725,7 @@ typedef struct Port_T {
                         char *request;                                          /**< HTTP request */
                         char *checksum;                         /**< Document checksum (optional) */
                         List_T headers;      /**< List of headers to send with request (optional) */
+                        boolean_t keepalive;   /**< Reuse the connection for the next test */
                 } http;
                 struct {
                         char *username;
@@ -732,6 +767,10 @@ typedef struct Icmp_T {
         Socket_Family family;                 /**< ICMP family used for connection */
         double response;                         /**< ICMP ECHO response time [ms] */
         Outgoing_T outgoing;                                 /**< Outgoing address */
+        struct {
+                boolean_t started;    /**< true if icmp_echoAll() pinged the host */
+                double response;  /**< The response time [ms], -1 or -2 if failed */
+        } echo;
         EventAction_T action;  /**< Description of the action upon event occurence */
 
         /** For internal use */
@@ -788,13 +827,17 @@ typedef struct ActionRate_T {
 /** Defines when to run a check for a service. This type suports both the old
  cycle based every statement and the new cron-format version */
 typedef struct Every_T {
-        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron */
+        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron, 4 = interval */
         time_t last_run;
         union {
                 struct {
                         int number; /**< Check this program at a given cycles */
                         int counter; /**< Counter for number. When counter == number, check */
                 } cycle; /**< Old cycle based every check */
+                struct {
+                        int seconds; /**< Check the service every given seconds, independently of the poll cycle */
+                        time_t next; /**< Time of the next check */
+                } interval;
                 char *cron; /* A crontab format string */
         } spec;
 } Every_T;
@@ -895,9 +938,25 @@ typedef struct Checksum_T {
         int   length;                                      /**< Length of the hash */
         MD_T  hash;                     /**< A checksum hash computed for the path */
         EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct ChecksumCache_T *cache;  /**< Cached digest and incremental state */
+        struct Digest_T *digest;             /**< The digest computation context */
 } *Checksum_T;
 
 
+/** Defines directory tree object */
+typedef struct Tree_T {
+        Tree_Type type;                                        /**< The tested value */
+        Operator_Type operator;                           /**< Comparison operator */
+        unsigned long long limit;        /**< Entries, size [B] or oldest age [s] */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct Tree_T *next;                               /**< next tree in chain */
+} *Tree_T;
+
+
 /** Defines permission object */
 typedef struct Perm_T {
         boolean_t test_changes;       /**< true if we only should test for changes */
@@ -1000,6 +1059,7 @@ typedef struct Device_T {
         boolean_t mounted;
         int generation;
         int instance;
+        dev_t id;
         char partition;
         char device[PATH_MAX];
         char mountpoint[PATH_MAX];
@@ -1056,6 +1116,7 @@ typedef struct FileInfo_T {
         off_t readpos;                        /**< Position for regex matching */
         ino_t inode;                                                /**< Inode */
         ino_t inode_prev;               /**< Previous inode for regex matching */
+        dev_t device;                          /**< Device id of the filesystem */
         MD_T  cs_sum;                                            /**< Checksum */ //FIXME: allocate dynamically only when necessary
 } *FileInfo_T;
 
@@ -1065,6 +1126,13 @@ typedef struct DirectoryInfo_T {
         int mode;                                              /**< Permission */
         int uid;                                              /**< Owner's uid */
         int gid;                                              /**< Owner's gid */
+        struct {
+                int entries;                  /**< Number of entries, -1 = unknown */
+                int changed;            /**< Number of changed entries since last walk */
+                unsigned long long size;            /**< Total size of the files */
+                time_t oldest;                   /**< The oldest entry timestamp */
+        } tree;
+        Snapshot_T snapshot;                    /**< The directory tree snapshot */
 } *DirectoryInfo_T;
 
 
@@ -1154,7 +1222,9 @@ typedef struct Service_T {
         Uptime_T    uptimelist;                             /**< Uptime check list */
         Match_T     matchlist;                             /**< Content Match list */
         Match_T     matchignorelist;                /**< Content Match ignore list */
+        Prefilter_T matchfilter;    /**< Prefilter of the ignore and match patterns */
         Timestamp_T timestamplist;                       /**< Timestamp check list */
+        Tree_T      treelist;                        /**< Directory tree check list */
         Pid_T       pidlist;                                   /**< Pid check list */
         Pid_T       ppidlist;                                 /**< PPid check list */
         Status_T    statuslist;           /**< Program execution status check list */
@@ -1214,6 +1284,7 @@ typedef struct Service_T {
 
         /** For internal use */
         Mutex_T mutex;                  /**< Mutex used for action synchronization */
+        int stateSlot;            /**< Index of the service record in the state file */
         struct Service_T *next;                         /**< next service in chain */
         struct Service_T *next_conf;      /**< next service according to conf file */
         struct Service_T *next_depend;           /**< next depend service in chain */
@@ -1251,6 +1322,8 @@ struct Run_T {
         struct SslOptions_T ssl;                          /**< Default SSL options */
         int  polltime;        /**< In deamon mode, the sleeptime (sec) between run */
         int  startdelay;                    /**< the sleeptime (sec) after startup */
+        int  parallel;          /**< Number of concurrent service check workers */
+        boolean_t inotify;       /**< Watch the files with the change notification */
         int  facility;              /** The facility to use when running openlog() */
         int  eventlist_slots;          /**< The event queue size - number of slots */
         int mailserver_timeout; /**< Connect and read timeout ms for a SMTP server */
@@ -1367,6 +1440,9 @@ void vsyslog (int, const char *, va_list);
 #endif /* HAVE_SYSLOG */
 #endif /* HAVE_VSYSLOG */
 int   validate(void);
+int   validate_due(void);
+int   validate_changed(void);
+time_t validate_deadline(void);
 void  daemonize(void);
 void  gc(void);
 void  gc_mail_list(Mail_T *);
@@ -24,6 +24,10 @@
 
 #include "config.h"
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #ifdef HAVE_STDIO_H
 #include <stdio.h>
 #endif
@@ -138,6 +142,7 @@
 
 #include "monit.h"
 #include "net.h"
+#include "resolver.h"
 
 // libmonit
 #include "util/Fmt.h"
@@ -154,6 +159,30 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct PingSocket_T {
+        int family;
+        Outgoing_T *outgoing;
+        int socket;
+        int error;                                 // errno if the socket cannot be created
+} PingSocket_T;
+
+
+typedef struct PingHost_T {
+        Icmp_T icmp;
+        const char *hostname;
+        struct addrinfo *result;
+        struct addrinfo *address;
+        PingSocket_T *socket;
+        boolean_t pending;
+        boolean_t sent;
+        int attempt;
+        int64_t deadline;
+} PingHost_T;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -325,7 +354,7 @@ static void _setPingOptions(int socket, struct addrinfo *addr) {
 }
 
 
-static boolean_t _sendPing(const char *hostname, int socket, struct addrinfo *addr, int size, int retry, int maxretries, int id, int64_t started) {
+static boolean_t _sendPing(const char *hostname, int socket, struct addrinfo *addr, int size, int retry, int maxretries, int id, int sequence, int64_t started) {
         char buf[ICMP_MAXSIZE] = {};
         int header_len = 0;
         int out_len = 0;
@@ -341,7 +370,7 @@ static boolean_t _sendPing(const char *hostname, int socket, struct addrinfo *ad
                         out_icmp4->icmp_code = 0;
                         out_icmp4->icmp_cksum = 0;
                         out_icmp4->icmp_id = htons(id);
-                        out_icmp4->icmp_seq = htons(retry);
+                        out_icmp4->icmp_seq = htons(sequence);
                         memcpy((int64_t *)(out_icmp4->icmp_data), &started, sizeof(int64_t)); // set data to timestamp
                         header_len = offsetof(struct icmp, icmp_data);
                         out_len = header_len + size;
@@ -355,7 +384,7 @@ static boolean_t _sendPing(const char *hostname, int socket, struct addrinfo *ad
                         out_icmp6->icmp6_code = 0;
                         out_icmp6->icmp6_cksum = 0;
                         out_icmp6->icmp6_id = htons(id);
-                        out_icmp6->icmp6_seq = htons(retry);
+                        out_icmp6->icmp6_seq = htons(sequence);
                         memcpy((int64_t *)(out_icmp6 + 1), &started, sizeof(int64_t)); // set data to timestamp
                         header_len = sizeof(struct icmp6_hdr);
                         out_len = header_len + size;
@@ -465,28 +494,199 @@ static double _receivePing(const char *hostname, int socket, struct addrinfo *ad
 }
 
 
-double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int maxretries) {
-        ASSERT(hostname);
-        ASSERT(size > 0);
-        double response = -1.;
-        struct addrinfo *result, hints = {};
+/*
+ * Translate the socket family to the address family used for the ping or return -1 if the family is not valid
+ */
+static int _pingFamily(Socket_Family family) {
         switch (family) {
                 case Socket_Ip:
-                        hints.ai_family = AF_UNSPEC;
-                        break;
+                        return AF_UNSPEC;
                 case Socket_Ip4:
-                        hints.ai_family = AF_INET;
-                        break;
+                        return AF_INET;
 #ifdef HAVE_IPV6
                 case Socket_Ip6:
-                        hints.ai_family = AF_INET6;
-                        break;
+                        return AF_INET6;
 #endif
                 default:
                         LogError("Invalid socket family %d\n", family);
-                        return response;
+                        return -1;
+        }
+}
+
+
+static int _pingSocketNew(int family) {
+        switch (family) {
+                case AF_INET:
+                        return socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+#ifdef HAVE_IPV6
+                case AF_INET6:
+                        return socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
+#endif
+                default:
+                        errno = EAFNOSUPPORT;
+                        return -1;
         }
-        int status = getaddrinfo(hostname, NULL, &hints, &result);
+}
+
+
+/*
+ * Returns the shared ping socket for the address family and outgoing address of the host. The socket is created on first use, if it
+ * cannot be created, the socket descriptor is -1 and the error is set to errno
+ */
+static PingSocket_T *_pingSocket(PingSocket_T *sockets, int *count, struct addrinfo *addr, Outgoing_T *outgoing) {
+        for (int i = 0; i < *count; i++) {
+                PingSocket_T *s = &sockets[i];
+                if (s->family == addr->ai_family) {
+                        if (! outgoing->ip && ! s->outgoing->ip)
+                                return s;
+                        if (outgoing->ip && s->outgoing->ip && outgoing->addrlen == s->outgoing->addrlen && memcmp(&(outgoing->addr), &(s->outgoing->addr), outgoing->addrlen) == 0)
+                                return s;
+                }
+        }
+        PingSocket_T *s = &sockets[(*count)++];
+        s->family = addr->ai_family;
+        s->outgoing = outgoing;
+        if ((s->socket = _pingSocketNew(s->family)) < 0) {
+                s->error = errno;
+                if (s->error != EACCES && s->error != EPERM)
+                        LogError("Ping -- cannot create socket: %s\n", STRERROR);
+        } else if (outgoing->ip && bind(s->socket, (struct sockaddr *)&(outgoing->addr), outgoing->addrlen) < 0) {
+                s->error = errno;
+                LogError("Cannot bind to outgoing address -- %s\n", STRERROR);
+                Net_close(s->socket);
+                s->socket = -1;
+        } else if (! Net_setNonBlocking(s->socket)) {
+                s->error = errno;
+                LogError("Ping -- cannot set nonblocking socket: %s\n", STRERROR);
+                Net_close(s->socket);
+                s->socket = -1;
+        } else {
+                _setPingOptions(s->socket, addr);
+        }
+        return s;
+}
+
+
+/*
+ * Select the next address of the host which matches the outgoing address length (the first one if no address was tried yet) and which
+ * has a usable socket, and reset the attempts for it. Returns false if no such address is left (the same fallback as in icmp_echo())
+ */
+static boolean_t _pingNextAddress(PingHost_T *h, PingSocket_T *sockets, int *socketsCount) {
+        for (struct addrinfo *addr = h->address ? h->address->ai_next : h->result; addr; addr = addr->ai_next) {
+                if (h->icmp->outgoing.addrlen == 0 || h->icmp->outgoing.addrlen == addr->ai_addrlen) {
+                        h->address = addr;
+                        h->socket = _pingSocket(sockets, socketsCount, addr, &(h->icmp->outgoing));
+                        if (h->socket->socket >= 0) {
+                                h->icmp->echo.response = -1.;
+                                h->attempt = 0;
+                                h->sent = false;
+                                h->deadline = 0;
+                                return true;
+                        }
+                        if (h->socket->error == EACCES || h->socket->error == EPERM) {
+                                DEBUG("Ping for %s -- cannot create socket: %s\n", h->hostname, System_getError(h->socket->error));
+                                h->icmp->echo.response = -2.;
+                        }
+                }
+        }
+        return false;
+}
+
+
+/*
+ * Read all ICMP messages queued on the shared socket and match the echo replies to the hosts by the id and sequence number (the sequence
+ * is the host index). Messages which belong to other conversations are skipped. Returns the number of hosts which got the reply
+ */
+static int _pingReceive(PingSocket_T *s, PingHost_T *hosts, int count, uint16_t id) {
+        int replies = 0;
+        char buf[ICMP_MAXSIZE];
+        while (true) {
+                struct sockaddr_storage in_addr;
+                socklen_t addrlen = sizeof(in_addr);
+                ssize_t n = recvfrom(s->socket, buf, sizeof(buf), 0, (struct sockaddr *)&in_addr, &addrlen);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                                LogError("Ping response failed -- %s\n", STRERROR);
+                        break;
+                }
+                int64_t stopped = Time_micro();
+                boolean_t in_echoreply = false;
+                uint16_t in_id = 0, in_seq = 0;
+                unsigned char *data = NULL;
+                struct ip *in_iphdr4;
+                struct icmp *in_icmp4;
+#ifdef HAVE_IPV6
+                struct icmp6_hdr *in_icmp6;
+#endif
+                switch (in_addr.ss_family) {
+                        case AF_INET:
+                                in_iphdr4 = (struct ip *)buf;
+                                if (n >= in_iphdr4->ip_hl * 4 + offsetof(struct icmp, icmp_data) + sizeof(int64_t)) {
+                                        in_icmp4 = (struct icmp *)(buf + in_iphdr4->ip_hl * 4);
+                                        in_echoreply = in_icmp4->icmp_type == ICMP_ECHOREPLY ? true : false;
+                                        in_id = ntohs(in_icmp4->icmp_id);
+                                        in_seq = ntohs(in_icmp4->icmp_seq);
+                                        data = (unsigned char *)in_icmp4->icmp_data;
+                                }
+                                break;
+#ifdef HAVE_IPV6
+                        case AF_INET6:
+                                if (n >= sizeof(struct icmp6_hdr) + sizeof(int64_t)) {
+                                        in_icmp6 = (struct icmp6_hdr *)buf;
+                                        in_echoreply = in_icmp6->icmp6_type == ICMP6_ECHO_REPLY ? true : false;
+                                        in_id = ntohs(in_icmp6->icmp6_id);
+                                        in_seq = ntohs(in_icmp6->icmp6_seq);
+                                        data = (unsigned char *)(in_icmp6 + 1);
+                                }
+                                break;
+#endif
+                        default:
+                                break;
+                }
+                if (! in_echoreply || in_id != id || in_seq >= count)
+                        continue;
+                PingHost_T *h = &hosts[in_seq];
+                if (! h->pending || h->socket != s || in_addr.ss_family != h->address->ai_family)
+                        continue;
+                boolean_t in_addrmatch = false;
+                switch (in_addr.ss_family) {
+                        case AF_INET:
+                                in_addrmatch = memcmp(&((struct sockaddr_in *)&in_addr)->sin_addr, &((struct sockaddr_in *)(h->address->ai_addr))->sin_addr, sizeof(struct in_addr)) ? false : true;
+                                break;
+#ifdef HAVE_IPV6
+                        case AF_INET6:
+                                in_addrmatch = memcmp(&((struct sockaddr_in6 *)&in_addr)->sin6_addr, &((struct sockaddr_in6 *)(h->address->ai_addr))->sin6_addr, sizeof(struct in6_addr)) ? false : true;
+                                break;
+#endif
+                        default:
+                                break;
+                }
+                if (in_addrmatch) {
+                        // The reply may belong to some previous attempt, the request timestamp is in the data
+                        int64_t started;
+                        memcpy(&started, data, sizeof(int64_t));
+                        h->icmp->echo.response = (double)(stopped - started) / 1000.; // Convert microseconds to milliseconds
+                        h->pending = false;
+                        replies++;
+                        DEBUG("Ping response for %s %d/%d succeeded -- received id=%d sequence=%d response_time=%s\n", h->hostname, h->attempt, h->icmp->count, in_id, in_seq, Fmt_time2str(h->icmp->echo.response, (char[11]){}));
+                }
+        }
+        return replies;
+}
+
+
+double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int maxretries) {
+        ASSERT(hostname);
+        ASSERT(size > 0);
+        double response = -1.;
+        struct addrinfo *result, hints = {
+                .ai_family = _pingFamily(family)
+        };
+        if (hints.ai_family == -1)
+                return response;
+        int status = Resolver_getaddrinfo(hostname, NULL, &hints, &result);
         if (status) {
                 LogError("Ping for %s -- getaddrinfo failed: %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return response;
@@ -494,19 +694,7 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
         int s = -1;
         for (struct addrinfo *addr = result; addr && response < 0.; addr = addr->ai_next) {
                 if (outgoing->addrlen == 0 || outgoing->addrlen == addr->ai_addrlen) {
-                        switch (addr->ai_family) {
-                                case AF_INET:
-                                        s = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
-                                        break;
-#ifdef HAVE_IPV6
-                                case AF_INET6:
-                                        s = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
-                                        break;
-#endif
-                                default:
-                                        break;
-                        }
-                        if (s >= 0) {
+                        if ((s = _pingSocketNew(addr->ai_family)) >= 0) {
                                 if (outgoing->ip && bind(s, (struct sockaddr *)&(outgoing->addr), outgoing->addrlen) < 0) {
                                         LogError("Cannot bind to outgoing address -- %s\n", STRERROR);
                                 } else {
@@ -514,7 +702,7 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
                                         uint16_t id = getpid() & 0xFFFF;
                                         for (int retry = 1; retry <= maxretries && ! (Run.flags & Run_Stopped); retry++) {
                                                 int64_t started = Time_micro();
-                                                if (_sendPing(hostname, s, addr, size, retry, maxretries, id, started) && (response = _receivePing(hostname, s, addr, retry, maxretries, id, started, timeout)) >= 0.) {
+                                                if (_sendPing(hostname, s, addr, size, retry, maxretries, id, retry, started) && (response = _receivePing(hostname, s, addr, retry, maxretries, id, started, timeout)) >= 0.) {
                                                         // Success
                                                         break;
                                                 }
@@ -534,7 +722,108 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
                 }
         }
 error:
-        freeaddrinfo(result);
+        Resolver_freeaddrinfo(result);
         return response;
 }
 
+
+
+void icmp_echoAll(Icmp_T icmps[], const char *hostnames[], int count) {
+        ASSERT(icmps);
+        ASSERT(hostnames);
+        count = MIN(count, 0x10000); // The host index is used as the echo sequence number, the rest is left for icmp_echo()
+        if (count <= 0)
+                return;
+        int pending = 0, socketsCount = 0;
+        uint16_t id = getpid() & 0xFFFF;
+        PingHost_T *hosts = CALLOC(count, sizeof(PingHost_T));
+        PingSocket_T *sockets = CALLOC(2 * count, sizeof(PingSocket_T)); // The host may fall back to the other address family
+        for (int i = 0; i < count; i++) {
+                PingHost_T *h = &hosts[i];
+                h->icmp = icmps[i];
+                h->hostname = hostnames[i];
+                h->icmp->echo.started = true;
+                h->icmp->echo.response = -1.;
+                struct addrinfo hints = {
+                        .ai_family = _pingFamily(h->icmp->family)
+                };
+                if (hints.ai_family == -1)
+                        continue;
+                int status = Resolver_getaddrinfo(h->hostname, NULL, &hints, &(h->result));
+                if (status) {
+                        LogError("Ping for %s -- getaddrinfo failed: %s\n", h->hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                        h->result = NULL;
+                        continue;
+                }
+                if (! _pingNextAddress(h, sockets, &socketsCount))
+                        continue;
+                h->pending = true;
+                pending++;
+        }
+        struct pollfd *fds = CALLOC(2 * count, sizeof(struct pollfd));
+        while (pending > 0 && ! (Run.flags & Run_Stopped)) {
+                // Send the next request to the hosts which reached their timeout and wait up to the nearest deadline of the rest
+                int64_t now = Time_micro();
+                int64_t next = 0;
+                for (int i = 0; i < count; i++) {
+                        PingHost_T *h = &hosts[i];
+                        if (! h->pending)
+                                continue;
+                        if (h->deadline <= now) {
+                                if (h->sent)
+                                        _LogWarningOrError(h->attempt, h->icmp->count, "Ping response for %s %d/%d timed out -- no response within %s\n", h->hostname, h->attempt, h->icmp->count, Fmt_time2str(h->icmp->timeout, (char[11]){}));
+                                if (h->attempt >= h->icmp->count) {
+                                        // No response from this address => try the next address of the host
+                                        if (! _pingNextAddress(h, sockets, &socketsCount)) {
+                                                h->pending = false;
+                                                pending--;
+                                                continue;
+                                        }
+                                }
+                                h->attempt++;
+                                int64_t started = Time_micro();
+                                // If the request cannot be sent, try the next attempt right away
+                                h->sent = _sendPing(h->hostname, h->socket->socket, h->address, h->icmp->size, h->attempt, h->icmp->count, id, i, started);
+                                h->deadline = h->sent ? started + (int64_t)h->icmp->timeout * 1000LL : started;
+                        }
+                        if (! next || h->deadline < next)
+                                next = h->deadline;
+                }
+                if (! pending)
+                        break;
+                int n = 0;
+                for (int i = 0; i < socketsCount; i++) {
+                        if (sockets[i].socket >= 0) {
+                                fds[n].fd = sockets[i].socket;
+                                fds[n].events = POLLIN;
+                                fds[n].revents = 0;
+                                n++;
+                        }
+                }
+                int rv = poll(fds, n, next > now ? (int)((next - now + 999) / 1000) : 0);
+                if (rv == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("Ping -- poll failed: %s\n", STRERROR);
+                        break;
+                }
+                for (int i = 0, j = 0; i < socketsCount && rv > 0; i++) {
+                        if (sockets[i].socket >= 0) {
+                                if (fds[j++].revents) {
+                                        pending -= _pingReceive(&sockets[i], hosts, count, id);
+                                        rv--;
+                                }
+                        }
+                }
+        }
+        for (int i = 0; i < socketsCount; i++)
+                if (sockets[i].socket >= 0)
+                        Net_close(sockets[i].socket);
+        for (int i = 0; i < count; i++)
+                if (hosts[i].result)
+                        Resolver_freeaddrinfo(hosts[i].result);
+        FREE(fds);
+        FREE(sockets);
+        FREE(hosts);
+}
+
@@ -78,4 +78,21 @@ int create_server_socket_unix(const char *path, int backlog, char error[STRLEN])
  */
 double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoing, int size, int timeout, int count);
 
+
+/**
+ * Ping several hosts at once. One raw socket per address family (and
+ * outgoing address) is shared by all hosts: the echo requests are sent
+ * to every host up front, the replies are matched to the hosts by the
+ * ICMP id and sequence number, so the unresponsive hosts wait for their
+ * timeout in parallel. Each host uses the size, timeout, count, family
+ * and outgoing address of its Icmp_T object. The result is stored in
+ * icmps[i]->echo: the started flag is set and the response is the
+ * response time on success, -1 on error or -2 if the raw socket cannot
+ * be created due to missing permission (same as icmp_echo()).
+ * @param icmps The ping tests
+ * @param hostnames The host of the ping test with the same index
+ * @param count The number of hosts
+ */
+void icmp_echoAll(Icmp_T icmps[], const char *hostnames[], int count);
+
 #endif
@@ -125,6 +125,7 @@
 #include "ProcessTree.h"
 #include "device.h"
 #include "processor.h"
+#include "digest.h"
 
 // libmonit
 #include "io/File.h"
@@ -182,6 +183,7 @@ static struct Exist_T existset = {};
 static struct Status_T statusset = {};
 static struct Perm_T permset = {};
 static struct Size_T sizeset = {};
+static struct Tree_T treeset = {};
 static struct Uptime_T uptimeset = {};
 static struct LinkStatus_T linkstatusset = {};
 static struct LinkSpeed_T linkspeedset = {};
@@ -228,6 +230,7 @@ static void  addresource(Resource_T);
 static void  addtimestamp(Timestamp_T);
 static void  addactionrate(ActionRate_T);
 static void  addsize(Size_T);
+static void  addtree(Tree_T);
 static void  adduptime(Uptime_T);
 static void  addpid(Pid_T);
 static void  addppid(Pid_T);
@@ -275,6 +278,7 @@ static void  reset_resourceset(void);
 static void  reset_timestampset(void);
 static void  reset_actionrateset(void);
 static void  reset_sizeset(void);
+static void  reset_treeset(void);
 static void  reset_uptimeset(void);
 static void  reset_pidset(void);
 static void  reset_ppidset(void);
@@ -317,11 +321,11 @@ static void addsecurityattribute(char *, Action_Type, Action_Type);
 
 %token IF ELSE THEN FAILED
 %token SET LOGFILE FACILITY DAEMON SYSLOG MAILSERVER HTTPD ALLOW REJECTOPT ADDRESS INIT TERMINAL BATCH
-%token READONLY CLEARTEXT MD5HASH SHA1HASH CRYPT DELAY
+%token READONLY CLEARTEXT MD5HASH SHA1HASH SHA256HASH XXH64HASH CRYPT DELAY
 %token PEMFILE ENABLE DISABLE SSL CIPHER CLIENTPEMFILE ALLOWSELFCERTIFICATION SELFSIGNED VERIFY CERTIFICATE CACERTIFICATEFILE CACERTIFICATEPATH VALID
 %token INTERFACE LINK PACKET BYTEIN BYTEOUT PACKETIN PACKETOUT SPEED SATURATION UPLOAD DOWNLOAD TOTAL
 %token IDFILE STATEFILE SEND EXPECT CYCLE COUNT REMINDER REPEAT
-%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT PROGRAMTIMEOUT STARTTIMEOUT STOPTIMEOUT RESTARTTIMEOUT
+%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT PROGRAMTIMEOUT STARTTIMEOUT STOPTIMEOUT RESTARTTIMEOUT CHECKSUMBUDGET TREEBUDGET DNSTTL
 %token PIDFILE START STOP PATHTOK
 %token HOST HOSTNAME PORT IPV4 IPV6 TYPE UDP TCP TCPSSL PROTOCOL CONNECTION
 %token ALERT NOALERT MAILFORMAT UNIXSOCKET SIGNATURE
@@ -338,12 +342,13 @@ static void addsecurityattribute(char *, Action_Type, Action_Type);
 %token THREADS CHILDREN METHOD GET HEAD STATUS ORIGIN VERSIONOPT READ WRITE OPERATION SERVICETIME DISK
 %token RESOURCE MEMORY TOTALMEMORY LOADAVG1 LOADAVG5 LOADAVG15 SWAP
 %token MODE ACTIVE PASSIVE MANUAL ONREBOOT NOSTART LASTSTATE CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT
-%token GROUP REQUEST DEPENDS BASEDIR SLOT EVENTQUEUE SECRET HOSTHEADER
+%token GROUP REQUEST DEPENDS BASEDIR SLOT EVENTQUEUE SECRET HOSTHEADER KEEPALIVE
 %token UID EUID GID MMONIT INSTANCE USERNAME PASSWORD
 %token TIME ATIME CTIME MTIME CHANGED MILLISECOND SECOND MINUTE HOUR DAY MONTH
 %token SSLAUTO SSLV2 SSLV3 TLSV1 TLSV11 TLSV12 TLSV13 CERTMD5 AUTO
 %token BYTE KILOBYTE MEGABYTE GIGABYTE
 %token INODE SPACE TFREE PERMISSION SIZE MATCH NOT IGNORE ACTION UPTIME
+%token ENTRIES OLDEST
 %token EXEC UNMONITOR PING PING4 PING6 ICMP ICMPECHO NONEXIST EXIST INVALID DATA RECOVERED PASSED SUCCEEDED
 %token URL CONTENT PID PPID FSFLAG
 %token REGISTER CREDENTIALS
@@ -352,6 +357,7 @@ static void addsecurityattribute(char *, Action_Type, Action_Type);
 %token <string> TARGET TIMESPEC HTTPHEADER
 %token <number> MAXFORWARD
 %token FIPS
+%token PARALLEL INOTIFY
 %token SECURITY ATTRIBUTE
 
 %left GREATER GREATEROREQUAL LESS LESSOREQUAL EQUAL NOTEQUAL
@@ -369,6 +375,8 @@ statement_list  : statement
 statement       : setalert
                 | setssl
                 | setdaemon
+                | setparallel
+                | setinotify
                 | setterminal
                 | setlog
                 | seteventqueue
@@ -482,6 +490,7 @@ optdir          : start
                 | restart
                 | exist
                 | timestamp
+                | tree
                 | actionrate
                 | every
                 | alert
@@ -613,6 +622,18 @@ setdaemon       : SET DAEMON NUMBER startdelay {
                   }
                 ;
 
+setparallel     : SET PARALLEL NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of parallel workers must be greater than zero");
+                        Run.parallel = $3;
+                  }
+                ;
+
+setinotify      : SET INOTIFY {
+                        Run.inotify = true;
+                  }
+                ;
+
 setterminal     : SET TERMINAL BATCH {
                         Run.flags |= Run_Batch;
                   }
@@ -667,6 +688,18 @@ limit           : SENDEXPECTBUFFER ':' NUMBER unit {
                 | PROGRAMOUTPUT ':' NUMBER unit {
                         Run.limits.programOutput = $3 * $<number>4;
                   }
+                | CHECKSUMBUDGET ':' NUMBER unit {
+                        Run.limits.checksumBudget = $3 * $<number>4;
+                  }
+                | TREEBUDGET ':' NUMBER {
+                        Run.limits.treeBudget = $3;
+                  }
+                | DNSTTL ':' NUMBER MILLISECOND {
+                        Run.limits.dnsTTL = $3;
+                  }
+                | DNSTTL ':' NUMBER SECOND {
+                        Run.limits.dnsTTL = $3 * 1000;
+                  }
                 | NETWORKTIMEOUT ':' NUMBER MILLISECOND {
                         Run.limits.networkTimeout = $3;
                   }
@@ -855,8 +888,11 @@ sslchecksum     : CERTIFICATE CHECKSUM checksumoperator STRING {
                                 case 40:
                                         sslset.checksumType = Hash_Sha1;
                                         break;
+                                case 64:
+                                        sslset.checksumType = Hash_Sha256;
+                                        break;
                                 default:
-                                        yyerror2("Unknown checksum type: [%s] is not MD5 nor SHA1", sslset.checksum);
+                                        yyerror2("Unknown checksum type: [%s] is not MD5, SHA1 nor SHA256", sslset.checksum);
                         }
                   }
                 | CERTIFICATE CHECKSUM MD5HASH checksumoperator STRING {
@@ -873,6 +909,13 @@ sslchecksum     : CERTIFICATE CHECKSUM checksumoperator STRING {
                                 yyerror2("Unknown checksum type: [%s] is not SHA1", sslset.checksum);
                         sslset.checksumType = Hash_Sha1;
                   }
+                | CERTIFICATE CHECKSUM SHA256HASH checksumoperator STRING {
+                        sslset.flags = SSL_Enabled;
+                        sslset.checksum = $<string>5;
+                        if (cleanup_hash_string(sslset.checksum) != 64)
+                                yyerror2("Unknown checksum type: [%s] is not SHA256", sslset.checksum);
+                        sslset.checksumType = Hash_Sha256;
+                  }
                 ;
 
 checksumoperator : /* EMPTY */
@@ -1735,6 +1778,9 @@ http            : username {
                 | status
                 | method
                 | hostheader
+                | KEEPALIVE {
+                        portset.parameters.http.keepalive = true;
+                  }
                 | '[' httpheaderlist ']'
                 ;
 
@@ -2057,6 +2103,12 @@ every           : EVERY NUMBER CYCLE {
                         current->every.type = Every_SkipCycles;
                         current->every.spec.cycle.counter = current->every.spec.cycle.number = $2;
                  }
+                | EVERY NUMBER SECOND {
+                        if ($2 < 1)
+                                yyerror2("The check interval must be greater than zero");
+                        current->every.type = Every_Interval;
+                        current->every.spec.interval.seconds = $2;
+                 }
                 | EVERY TIMESPEC {
                         current->every.type = Every_Cron;
                         current->every.spec.cron = $2;
@@ -2472,6 +2524,8 @@ checksum        : IF FAILED hashtype CHECKSUM rate1 THEN action1 recovery {
 hashtype        : /* EMPTY */ { checksumset.type = Hash_Unknown; }
                 | MD5HASH     { checksumset.type = Hash_Md5; }
                 | SHA1HASH    { checksumset.type = Hash_Sha1; }
+                | SHA256HASH  { checksumset.type = Hash_Sha256; }
+                | XXH64HASH   { checksumset.type = Hash_Xxh64; }
                 ;
 
 inode           : IF INODE operator NUMBER rate1 THEN action1 recovery {
@@ -2688,6 +2742,35 @@ size            : IF SIZE operator NUMBER unit rate1 THEN action1 recovery {
                   }
                 ;
 
+tree            : IF ENTRIES operator NUMBER rate1 THEN action1 recovery {
+                        treeset.type = Tree_Entries;
+                        treeset.operator = $<number>3;
+                        treeset.limit = $4;
+                        addeventaction(&(treeset).action, $<number>7, $<number>8);
+                        addtree(&treeset);
+                  }
+                | IF TOTAL SIZE operator NUMBER unit rate1 THEN action1 recovery {
+                        treeset.type = Tree_Size;
+                        treeset.operator = $<number>4;
+                        treeset.limit = ((unsigned long long)$5 * $<number>6);
+                        addeventaction(&(treeset).action, $<number>9, $<number>10);
+                        addtree(&treeset);
+                  }
+                | IF OLDEST operator NUMBER time rate1 THEN action1 recovery {
+                        treeset.type = Tree_Oldest;
+                        treeset.operator = $<number>3;
+                        treeset.limit = ((unsigned long long)$4 * $<number>5);
+                        addeventaction(&(treeset).action, $<number>8, $<number>9);
+                        addtree(&treeset);
+                  }
+                | IF CHANGED ENTRIES rate1 THEN action1 {
+                        treeset.type = Tree_Changed;
+                        treeset.operator = Operator_Changed;
+                        addeventaction(&(treeset).action, $<number>6, Action_Ignored);
+                        addtree(&treeset);
+                  }
+                ;
+
 uid             : IF FAILED UID STRING rate1 THEN action1 recovery {
                         uidset.uid = get_uid($4, 0);
                         addeventaction(&(uidset).action, $<number>7, $<number>8);
@@ -3002,7 +3085,12 @@ static void preparse() {
         Run.limits.stopTimeout       = LIMIT_STOPTIMEOUT;
         Run.limits.startTimeout      = LIMIT_STARTTIMEOUT;
         Run.limits.restartTimeout    = LIMIT_RESTARTTIMEOUT;
+        Run.limits.checksumBudget    = LIMIT_CHECKSUMBUDGET;
+        Run.limits.treeBudget        = LIMIT_TREEBUDGET;
+        Run.limits.dnsTTL            = LIMIT_DNSTTL;
         Run.onreboot                 = Onreboot_Start;
+        Run.parallel                 = 0;
+        Run.inotify                  = false;
         Run.mmonitcredentials        = NULL;
         Run.httpd.flags              = Httpd_Disabled | Httpd_Signature;
         Run.httpd.credentials        = NULL;
@@ -3030,6 +3118,7 @@ static void preparse() {
         reset_gidset();
         reset_statusset();
         reset_sizeset();
+        reset_treeset();
         reset_mailset();
         reset_sslset();
         reset_mailserverset();
@@ -3273,6 +3362,15 @@ static void addservice(Service_T s) {
                         break;
         }
 
+        /* Compile the content match patterns prefilter: the ignore patterns first, then the match patterns (the order in which they're evaluated) */
+        if (s->matchlist && s->type != Service_Process) {
+                s->matchfilter = Prefilter_new();
+                for (Match_T m = s->matchignorelist; m; m = m->next)
+                        Prefilter_add(s->matchfilter, m->match_string);
+                for (Match_T m = s->matchlist; m; m = m->next)
+                        Prefilter_add(s->matchfilter, m->match_string);
+        }
+
         /* Add the service to the end of the service list */
         if (tail != NULL) {
                 tail->next = s;
@@ -3397,12 +3495,25 @@ static void addport(Port_T *list, Port_T port) {
         if (p->protocol->check == check_http) {
                 if (p->parameters.http.checksum) {
                         cleanup_hash_string(p->parameters.http.checksum);
-                        if (strlen(p->parameters.http.checksum) == 32)
-                                p->parameters.http.hashtype = Hash_Md5;
-                        else if (strlen(p->parameters.http.checksum) == 40)
-                                p->parameters.http.hashtype = Hash_Sha1;
-                        else
-                                yyerror2("invalid checksum [%s]", p->parameters.http.checksum);
+                        switch (strlen(p->parameters.http.checksum)) {
+                                case 16:
+                                        p->parameters.http.hashtype = Hash_Xxh64;
+                                        break;
+                                case 32:
+                                        p->parameters.http.hashtype = Hash_Md5;
+                                        break;
+                                case 40:
+                                        p->parameters.http.hashtype = Hash_Sha1;
+                                        break;
+                                case 64:
+                                        p->parameters.http.hashtype = Hash_Sha256;
+                                        break;
+                                default:
+                                        yyerror2("invalid checksum [%s]", p->parameters.http.checksum);
+                                        break;
+                        }
+                        if (p->parameters.http.hashtype && ! Digest_length(p->parameters.http.hashtype))
+                                yyerror2("%s checksum is not supported -- Monit was not built with SSL support", checksumnames[p->parameters.http.hashtype]);
                 } else {
                         p->parameters.http.hashtype = Hash_Unknown;
                 }
@@ -3532,6 +3643,26 @@ static void addsize(Size_T ss) {
 }
 
 
+/*
+ * Add a new Tree object to the current service tree list
+ */
+static void addtree(Tree_T ts) {
+        ASSERT(ts);
+
+        Tree_T t;
+        NEW(t);
+        t->type     = ts->type;
+        t->operator = ts->operator;
+        t->limit    = ts->limit;
+        t->action   = ts->action;
+
+        t->next = current->treelist;
+        current->treelist = t;
+
+        reset_treeset();
+}
+
+
 /*
  * Add a new Uptime object to the current service uptime list
  */
@@ -3639,12 +3770,18 @@ static void addchecksum(Checksum_T cs) {
 
         cs->initialized = true;
 
+        if (cs->type != Hash_Unknown && ! Digest_length(cs->type)) {
+                yyerror2("%s checksum is not supported -- Monit was not built with SSL support", checksumnames[cs->type]);
+                reset_checksumset();
+                return;
+        }
+
         if (STR_UNDEF(cs->hash)) {
                 if (cs->type == Hash_Unknown)
                         cs->type = Hash_Default;
                 if (! (Util_getChecksum(current->path, cs->type, cs->hash, sizeof(cs->hash)))) {
                         /* If the file doesn't exist, set dummy value */
-                        snprintf(cs->hash, sizeof(cs->hash), cs->type == Hash_Md5 ? "00000000000000000000000000000000" : "0000000000000000000000000000000000000000");
+                        snprintf(cs->hash, sizeof(cs->hash), "%.*s", Digest_length(cs->type) * 2, "0000000000000000000000000000000000000000000000000000000000000000");
                         cs->initialized = false;
                         yywarning2("Cannot compute a checksum for file %s", current->path);
                 }
@@ -3656,12 +3793,16 @@ static void addchecksum(Checksum_T cs) {
                         cs->type = Hash_Md5;
                 } else if (len == 40) {
                         cs->type = Hash_Sha1;
+                } else if (len == 64 && Digest_length(Hash_Sha256)) {
+                        cs->type = Hash_Sha256;
+                } else if (len == 16) {
+                        cs->type = Hash_Xxh64;
                 } else {
                         yyerror2("Unknown checksum type [%s] for file %s", cs->hash, current->path);
                         reset_checksumset();
                         return;
                 }
-        } else if ((cs->type == Hash_Md5 && len != 32) || (cs->type == Hash_Sha1 && len != 40)) {
+        } else if (len != Digest_length(cs->type) * 2) {
                 yyerror2("Invalid checksum [%s] for file %s", cs->hash, current->path);
                 reset_checksumset();
                 return;
@@ -4127,6 +4268,8 @@ static void  seturlrequest(int operator, char *regex) {
                 regerror(reg_return, urlrequest->regex, errbuf, STRLEN);
                 yyerror2("Regex parsing error: %s", errbuf);
         }
+        urlrequest->prefilter = Prefilter_new();
+        Prefilter_add(urlrequest->prefilter, regex);
 }
 
 
@@ -4595,6 +4738,17 @@ static void reset_sizeset() {
 }
 
 
+/*
+ * Reset the Tree set to default values
+ */
+static void reset_treeset() {
+        treeset.type = Tree_Entries;
+        treeset.operator = Operator_Equal;
+        treeset.limit = 0ULL;
+        treeset.action = NULL;
+}
+
+
 /*
  * Reset the Uptime set to default values
  */
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "util.h"
+#include "prefilter.h"
+
+
+/**
+ * Implementation of the Prefilter: Aho-Corasick automaton over the required
+ * literals of the regular expressions. The trie uses a sparse edge list,
+ * except for the root, which has a full transition table.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct Node_T {
+        int fail;                               /**< Failure link */
+        int output;         /**< First pattern whose literal ends here, -1 = none */
+        int dictionary;  /**< Nearest node with output on the failure chain, 0 = none */
+        int edge;                            /**< First outgoing edge, -1 = none */
+} Node_T;
+
+
+typedef struct Edge_T {
+        unsigned char c;
+        int target;
+        int next;
+} Edge_T;
+
+
+#define T Prefilter_T
+struct T {
+        boolean_t compiled;                    /**< The failure links are valid */
+        int count;                                      /**< Number of patterns */
+        int words;                          /**< Size of the bitmaps in 64-bit words */
+        int *next;                  /**< Next pattern with the same literal, -1 = none */
+        uint64_t *always;              /**< The patterns without required literal */
+        uint64_t *candidates;             /**< The candidates of the last scan */
+        int root[256];                             /**< Root transitions, 0 = none */
+        struct {
+                int count;
+                int capacity;
+                Node_T *list;
+        } nodes;
+        struct {
+                int count;
+                int capacity;
+                Edge_T *list;
+        } edges;
+};
+
+
+/* --------------------------------------------------------------- Private */
+
+
+static int _newNode(T P) {
+        if (P->nodes.count == P->nodes.capacity) {
+                P->nodes.capacity = P->nodes.capacity ? P->nodes.capacity * 2 : 64;
+                RESIZE(P->nodes.list, P->nodes.capacity * sizeof(Node_T));
+        }
+        P->nodes.list[P->nodes.count] = (Node_T){.fail = 0, .output = -1, .dictionary = 0, .edge = -1};
+        return P->nodes.count++;
+}
+
+
+static int _child(T P, int node, unsigned char c) {
+        if (node == 0)
+                return P->root[c] ? P->root[c] : -1;
+        for (int e = P->nodes.list[node].edge; e >= 0; e = P->edges.list[e].next)
+                if (P->edges.list[e].c == c)
+                        return P->edges.list[e].target;
+        return -1;
+}
+
+
+static int _addChild(T P, int node, unsigned char c) {
+        int child = _newNode(P);
+        if (node == 0) {
+                P->root[c] = child;
+        } else {
+                if (P->edges.count == P->edges.capacity) {
+                        P->edges.capacity = P->edges.capacity ? P->edges.capacity * 2 : 64;
+                        RESIZE(P->edges.list, P->edges.capacity * sizeof(Edge_T));
+                }
+                P->edges.list[P->edges.count] = (Edge_T){.c = c, .target = child, .next = P->nodes.list[node].edge};
+                P->nodes.list[node].edge = P->edges.count++;
+        }
+        return child;
+}
+
+
+// The transition function: follow the failure links until some node has the edge (the root accepts all characters)
+static int _goto(T P, int node, unsigned char c) {
+        int next;
+        while ((next = _child(P, node, c)) < 0) {
+                if (node == 0)
+                        return 0;
+                node = P->nodes.list[node].fail;
+        }
+        return next;
+}
+
+
+// Compute the failure and dictionary links in breadth-first order
+static void _compile(T P) {
+        int *queue = CALLOC(P->nodes.count, sizeof(int));
+        int head = 0, tail = 0;
+        for (int c = 0; c < 256; c++) {
+                if (P->root[c]) {
+                        P->nodes.list[P->root[c]].fail = 0;
+                        P->nodes.list[P->root[c]].dictionary = 0;
+                        queue[tail++] = P->root[c];
+                }
+        }
+        while (head < tail) {
+                int node = queue[head++];
+                for (int e = P->nodes.list[node].edge; e >= 0; e = P->edges.list[e].next) {
+                        int child = P->edges.list[e].target;
+                        int fail = _goto(P, P->nodes.list[node].fail, P->edges.list[e].c);
+                        P->nodes.list[child].fail = fail;
+                        P->nodes.list[child].dictionary = P->nodes.list[fail].output >= 0 ? fail : P->nodes.list[fail].dictionary;
+                        queue[tail++] = child;
+                }
+        }
+        FREE(queue);
+        P->compiled = true;
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T Prefilter_new() {
+        T P;
+        NEW(P);
+        _newNode(P); // Root
+        return P;
+}
+
+
+void Prefilter_free(T *P) {
+        ASSERT(P && *P);
+        FREE((*P)->next);
+        FREE((*P)->always);
+        FREE((*P)->candidates);
+        FREE((*P)->nodes.list);
+        FREE((*P)->edges.list);
+        FREE(*P);
+}
+
+
+int Prefilter_add(T P, const char *pattern) {
+        ASSERT(P);
+        ASSERT(pattern);
+        int index = P->count++;
+        int words = (P->count + 63) / 64;
+        if (words > P->words) {
+                RESIZE(P->always, words * sizeof(uint64_t));
+                RESIZE(P->candidates, words * sizeof(uint64_t));
+                P->always[P->words] = P->candidates[P->words] = 0ULL;
+                P->words = words;
+        }
+        RESIZE(P->next, P->count * sizeof(int));
+        P->next[index] = -1;
+        char literal[64];
+        if (! Str_regexLiteral(pattern, literal, sizeof(literal)) || ! *literal) {
+                P->always[index / 64] |= 1ULL << (index % 64);
+        } else {
+                int node = 0;
+                for (const unsigned char *c = (const unsigned char *)literal; *c; c++) {
+                        int child = _child(P, node, *c);
+                        node = child >= 0 ? child : _addChild(P, node, *c);
+                }
+                P->next[index] = P->nodes.list[node].output;
+                P->nodes.list[node].output = index;
+                P->compiled = false;
+        }
+        return index;
+}
+
+
+void Prefilter_scan(T P, const char *text, size_t length) {
+        ASSERT(P);
+        ASSERT(text);
+        if (! P->count)
+                return;
+        if (! P->compiled)
+                _compile(P);
+        memcpy(P->candidates, P->always, P->words * sizeof(uint64_t));
+        int node = 0;
+        for (size_t i = 0; i < length; i++) {
+                node = _goto(P, node, (unsigned char)text[i]);
+                for (int n = P->nodes.list[node].output >= 0 ? node : P->nodes.list[node].dictionary; n; n = P->nodes.list[n].dictionary)
+                        for (int p = P->nodes.list[n].output; p >= 0; p = P->next[p])
+                                P->candidates[p / 64] |= 1ULL << (p % 64);
+        }
+}
+
+
+boolean_t Prefilter_candidate(T P, int index) {
+        ASSERT(P);
+        ASSERT(index >= 0 && index < P->count);
+        return P->candidates[index / 64] & (1ULL << (index % 64)) ? true : false;
+}
+
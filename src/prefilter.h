@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#ifndef MONIT_PREFILTER_H
+#define MONIT_PREFILTER_H
+
+
+/**
+ * A multi-pattern <b>Prefilter</b> for regular expressions. The longest
+ * literal string required by each regular expression is added to an
+ * Aho-Corasick automaton, so one pass over the text finds all patterns
+ * which can possibly match it. The full regexec() has to run only for
+ * these candidate patterns. Patterns without a required literal (such
+ * as alternations) are always candidates.
+ *
+ * @file
+ */
+
+
+#define T Prefilter_T
+typedef struct T *T;
+
+
+/**
+ * Create a new empty Prefilter
+ * @return A new Prefilter object
+ */
+T Prefilter_new(void);
+
+
+/**
+ * Destroy the Prefilter and set *P to NULL
+ * @param P A Prefilter object reference
+ */
+void Prefilter_free(T *P);
+
+
+/**
+ * Add the regular expression to the prefilter. The patterns are numbered
+ * in the order they were added, starting from 0.
+ * @param P A Prefilter object
+ * @param pattern The extended regular expression
+ * @return The index of the pattern
+ */
+int Prefilter_add(T P, const char *pattern);
+
+
+/**
+ * Scan the text and record the candidate patterns, which can be tested
+ * with Prefilter_candidate() until the next scan
+ * @param P A Prefilter object
+ * @param text The text to scan
+ * @param length The text length
+ */
+void Prefilter_scan(T P, const char *text, size_t length);
+
+
+/**
+ * Test if the pattern may match the text of the last Prefilter_scan()
+ * @param P A Prefilter object
+ * @param index The pattern index
+ * @return true if the pattern may match, false if it cannot match
+ */
+boolean_t Prefilter_candidate(T P, int index);
+
+
+#undef T
+#endif
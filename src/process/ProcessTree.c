@@ -60,6 +60,18 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_COREFOUNDATION_COREFOUNDATION_H
 #include <CoreFoundation/CoreFoundation.h>
 #endif
@@ -85,22 +97,123 @@
 /* ------------------------------------------------------------- Definitions */
 
 
+/* Open addressing hash table mapping the PID to the process tree index */
+typedef struct PidIndex_T {
+        int count;
+        unsigned mask;
+        int *slots;                               /**< Process tree index + 1, zero marks an empty slot */
+} PidIndex_T;
+
+
+/* The process tree strings (command line, security attribute) are allocated from the chunked arena which is released at once with the tree */
+#define STRINGS_CHUNK 65536
+
+
+typedef struct StringChunk_T {
+        size_t used;
+        size_t size;
+        struct StringChunk_T *next;
+        char data[];
+} *StringChunk_T;
+
+
 static int ptreesize = 0;
 static ProcessTree_T *ptree = NULL;
+static PidIndex_T ptreeindex = {};
+static StringChunk_T ptreestrings = NULL;
+static int *ptreechildren = NULL; // The children of all processes, the children.list of each process points to its contiguous range
+
+
+/* The process tree snapshot is stamped with the validation cycle in which it was taken, so the process services checked in the same cycle can share it */
+static struct {
+        unsigned long cycle;              /**< The current validation cycle */
+        unsigned long stamp;              /**< The cycle in which the process tree was collected, 0 if outdated */
+        ProcessEngine_Flags flags;        /**< The process engine flags used for collecting the tree */
+        unsigned long generation;         /**< Incremented each time the process tree is collected */
+} snapshot = {.cycle = 1};
+
+
+/* The process events reported by the system since the process tree was collected. If available, the process tree can be trusted without
+ * a rescan until some process forks, executes a new program or exits */
+static struct {
+        boolean_t available;
+        boolean_t lost;                   /**< Some events were lost, the process tree state is unknown */
+        unsigned long changes;            /**< The number of process events since the process tree was collected */
+} events = {};
+
+
+/* The process descriptors (Linux pidfd) of the processes monitored by the process services. The descriptor refers to the process, not to the
+ * PID number, so the exit is detected reliably even if the PID was reused, and the liveness of all monitored processes is tested by one poll() */
+typedef struct PidFd_T {
+        Service_T service;
+        pid_t pid;
+        int fd;
+        boolean_t polled;                 /**< The descriptor was polled since the last process change made by Monit */
+        boolean_t exited;
+} PidFd_T;
+
+
+static struct {
+        boolean_t available;
+        int count;
+        int capacity;
+        PidFd_T *list;
+} pidfds = {.available = true};
+
+
+/* The processes selected for all process services using the pattern match, computed in one pass over the process tree */
+typedef struct MatchEntry_T {
+        Service_T service;
+        regex_t *regex;
+        int found;                        /**< The process tree index of the selected process or -1 */
+} MatchEntry_T;
+
+
+static struct {
+        unsigned long generation;         /**< The process tree generation the index was built for */
+        int count;
+        int capacity;
+        MatchEntry_T *entries;
+        Prefilter_T prefilter;            /**< The literals which must be present in the matching command line */
+} matchindex = {};
 
 
 /* ----------------------------------------------------------------- Private */
 
 
+/**
+ * Release the process tree strings. If the previous tree needed more than one chunk, the chunks are merged into one large enough
+ * to hold all strings, so the next tree will be collected without additional allocations.
+ * @param release true if the memory should be freed completely
+ */
+static void _stringsReset(boolean_t release) {
+        size_t total = 0;
+        if (ptreestrings) {
+                if (! release && ! ptreestrings->next) {
+                        ptreestrings->used = 0;
+                        return;
+                }
+                for (StringChunk_T c = ptreestrings, next; c; c = next) {
+                        next = c->next;
+                        total += c->size;
+                        FREE(c);
+                }
+                ptreestrings = NULL;
+        }
+        if (! release && total) {
+                ptreestrings = ALLOC(sizeof(struct StringChunk_T) + total);
+                ptreestrings->used = 0;
+                ptreestrings->size = total;
+                ptreestrings->next = NULL;
+        }
+}
+
+
 static void _delete(ProcessTree_T **pt, int *size) {
         ASSERT(pt);
         ProcessTree_T *_pt = *pt;
         if (_pt) {
-                for (int i = 0; i < *size; i++) {
-                        FREE(_pt[i].cmdline);
-                        FREE(_pt[i].children.list);
-                        FREE(_pt[i].secattr);
-                }
+                FREE(ptreechildren);
                 FREE(_pt);
                 *pt = NULL;
                 *size = 0;
@@ -108,38 +221,127 @@ static void _delete(ProcessTree_T **pt, int *size) {
 }
 
 
+static inline unsigned _pidHash(pid_t pid) {
+        return (unsigned)pid * 2654435761U; // Knuth's multiplicative hash
+}
+
+
+static void _indexFree(PidIndex_T *index) {
+        FREE(index->slots);
+        index->count = 0;
+        index->mask = 0;
+}
+
+
+static void _indexPut(PidIndex_T *index, ProcessTree_T *pt, int entry) {
+        unsigned slot = _pidHash(pt[entry].pid) & index->mask;
+        while (index->slots[slot])
+                slot = (slot + 1) & index->mask;
+        index->slots[slot] = entry + 1;
+        index->count++;
+}
+
+
+/**
+ * Index the first size entries of the process tree. The table is kept at most half full, so the probe sequences stay short
+ * @param index The index to (re)build
+ * @param pt The process tree
+ * @param size The number of entries to index
+ */
+static void _indexBuild(PidIndex_T *index, ProcessTree_T *pt, int size) {
+        unsigned capacity = 64;
+        while (capacity < 2 * (unsigned)size + 2)
+                capacity <<= 1;
+        _indexFree(index);
+        index->slots = CALLOC(capacity, sizeof(int));
+        index->mask = capacity - 1;
+        for (int i = 0; i < size; i++)
+                _indexPut(index, pt, i);
+}
+
+
+/**
+ * Add the entry to the index, the entries 0 .. entry - 1 must be indexed already
+ */
+static void _indexAdd(PidIndex_T *index, ProcessTree_T *pt, int entry) {
+        if (2 * (unsigned)(index->count + 1) > index->mask + 1)
+                _indexBuild(index, pt, entry);
+        _indexPut(index, pt, entry);
+}
+
+
 /**
  * Search a leaf in the processtree
  * @param pid  pid of the process
  * @param pt  processtree
- * @param treesize  size of the processtree
+ * @param index  PID index of the processtree
  * @return process index if succeeded otherwise -1
  */
-static int _findProcess(int pid, ProcessTree_T *pt, int size) {
-        if (size > 0) {
-                for (int i = 0; i < size; i++)
-                        if (pid == pt[i].pid)
-                                return i;
+static int _findProcess(pid_t pid, ProcessTree_T *pt, PidIndex_T *index) {
+        if (index->slots) {
+                for (unsigned slot = _pidHash(pid) & index->mask; index->slots[slot]; slot = (slot + 1) & index->mask)
+                        if (pt[index->slots[slot] - 1].pid == pid)
+                                return index->slots[slot] - 1;
         }
         return -1;
 }
 
 
 /**
- * Fill data in the process tree by recusively walking through it
+ * Connect the children to their parents. The children are counted first, so all children lists can be stored in one array
  * @param pt process tree
- * @param i process index
+ * @param size process tree size
  */
-static void _fillProcessTree(ProcessTree_T *pt, int index) {
-        if (! pt[index].visited) {
-                pt[index].visited = true;
-                pt[index].children.total = pt[index].children.count;
-                pt[index].threads.children = 0;
-                pt[index].cpu.usage.children = 0.;
-                pt[index].memory.usage_total = pt[index].memory.usage;
-                for (int i = 0; i < pt[index].children.count; i++) {
-                        _fillProcessTree(pt, pt[index].children.list[i]);
+static void _linkChildren(ProcessTree_T *pt, int size) {
+        for (int i = 0; i < size; i++)
+                pt[i].children.count = 0;
+        for (int i = 0; i < size; i++)
+                if (pt[i].parent != -1 && pt[i].parent != i)
+                        pt[pt[i].parent].children.count++;
+        FREE(ptreechildren);
+        ptreechildren = CALLOC(size, sizeof(int));
+        for (int i = 0, offset = 0; i < size; i++) {
+                pt[i].children.list = ptreechildren + offset;
+                offset += pt[i].children.count;
+                pt[i].children.count = 0;
+        }
+        for (int i = 0; i < size; i++) {
+                if (pt[i].parent != -1 && pt[i].parent != i) {
+                        ProcessTree_T *parent = &pt[pt[i].parent];
+                        parent->children.list[parent->children.count++] = i;
                 }
+        }
+}
+
+
+/**
+ * Fill data in the process tree. The processes reachable from the root are ordered breadth-first, so walking the order backwards
+ * visits the children before their parent and the totals can be accumulated in one pass without recursion
+ * @param pt process tree
+ * @param size process tree size
+ * @param root root process index
+ */
+static void _fillProcessTree(ProcessTree_T *pt, int size, int root) {
+        int *order = CALLOC(size, sizeof(int));
+        int count = 0;
+        order[count++] = root;
+        pt[root].visited = true;
+        for (int head = 0; head < count; head++) {
+                ProcessTree_T *p = &pt[order[head]];
+                p->children.total = p->children.count;
+                p->threads.children = 0;
+                p->cpu.usage.children = 0.;
+                p->memory.usage_total = p->memory.usage;
+                for (int i = 0; i < p->children.count; i++) {
+                        int child = p->children.list[i];
+                        if (! pt[child].visited) {
+                                pt[child].visited = true;
+                                order[count++] = child;
+                        }
+                }
+        }
+        for (int i = count - 1; i >= 0; i--) {
+                int index = order[i];
                 if (pt[index].parent != -1 && pt[index].parent != index) {
                         ProcessTree_T *parent_pt = &pt[pt[index].parent];
                         parent_pt->children.total += pt[index].children.total;
@@ -153,6 +355,7 @@ static void _fillProcessTree(ProcessTree_T *pt, int index) {
                         parent_pt->memory.usage_total  += pt[index].memory.usage_total;
                 }
         }
+        FREE(order);
 }
 
 
@@ -196,6 +399,231 @@ static int _match(regex_t *regex) {
 }
 
 
+/**
+ * Evaluate the patterns of all process services against the process tree. Each command line is scanned once for the literal strings required
+ * by all patterns and the regex runs only for the patterns whose literal was found. The result is the oldest matching process whose parent
+ * doesn't match the pattern.
+ */
+static void _buildMatchIndex() {
+        matchindex.count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                if (s->type == Service_Process && s->matchlist) {
+                        if (matchindex.count == matchindex.capacity) {
+                                matchindex.capacity = matchindex.capacity ? matchindex.capacity * 2 : 16;
+                                RESIZE(matchindex.entries, matchindex.capacity * sizeof(MatchEntry_T));
+                        }
+                        MatchEntry_T *entry = &matchindex.entries[matchindex.count++];
+                        entry->service = s;
+                        entry->regex = s->matchlist->regex_comp;
+                        entry->found = -1;
+                }
+        }
+        // The prefilter index of the pattern is the same as the match index entry index
+        if (matchindex.prefilter)
+                Prefilter_free(&matchindex.prefilter);
+        matchindex.prefilter = Prefilter_new();
+        for (int j = 0; j < matchindex.count; j++)
+                Prefilter_add(matchindex.prefilter, matchindex.entries[j].service->matchlist->match_string);
+        matchindex.generation = snapshot.generation;
+        if (matchindex.count) {
+                // Bitmap of the patterns matching each process
+                int words = (matchindex.count + 63) / 64;
+                uint64_t *matches = CALLOC(ptreesize * words, sizeof(uint64_t));
+                for (int i = 0; i < ptreesize; i++) {
+                        if (ptree[i].cmdline) {
+                                Prefilter_scan(matchindex.prefilter, ptree[i].cmdline, strlen(ptree[i].cmdline));
+                                for (int j = 0; j < matchindex.count; j++)
+                                        if (Prefilter_candidate(matchindex.prefilter, j) && regexec(matchindex.entries[j].regex, ptree[i].cmdline, 0, NULL, 0) == 0)
+                                                matches[i * words + j / 64] |= 1ULL << (j % 64);
+                        }
+                }
+                for (int i = 0; i < ptreesize; i++) {
+                        uint64_t *self = &matches[i * words];
+                        uint64_t *parent = &matches[ptree[i].parent * words];
+                        for (int j = 0; j < matchindex.count; j++) {
+                                uint64_t bit = 1ULL << (j % 64);
+                                if ((self[j / 64] & bit) && (i == ptree[i].parent || ! (parent[j / 64] & bit))) {
+                                        MatchEntry_T *entry = &matchindex.entries[j];
+                                        if (entry->found == -1 || ptree[entry->found].uptime < ptree[i].uptime)
+                                                entry->found = i;
+                                }
+                        }
+                }
+                FREE(matches);
+        }
+}
+
+
+/**
+ * Find the process matching the service pattern using the match index of the current process tree
+ * @param s The process service
+ * @return The PID of the matching process or -1 if not found
+ */
+static int _matchService(Service_T s) {
+        if (matchindex.generation != snapshot.generation)
+                _buildMatchIndex();
+        for (int i = 0; i < matchindex.count; i++)
+                if (matchindex.entries[i].service == s)
+                        return matchindex.entries[i].found >= 0 ? ptree[matchindex.entries[i].found].pid : -1;
+        // The service is not in the index (such as a service created on the fly by reload)
+        return _match(s->matchlist->regex_comp);
+}
+
+
+static void _processEvent(ProcessEvent_Type type, pid_t pid) {
+        switch (type) {
+                case ProcessEvent_Exit:
+                        {
+                                int leaf = _findProcess(pid, ptree, &ptreeindex);
+                                if (leaf != -1)
+                                        ptree[leaf].exited = true;
+                        }
+                        events.changes++;
+                        break;
+                case ProcessEvent_Fork:
+                case ProcessEvent_Exec:
+                        events.changes++;
+                        break;
+                case ProcessEvent_Lost:
+                        events.lost = true;
+                        break;
+        }
+}
+
+
+/**
+ * Consume the pending process events
+ */
+static void _processEvents() {
+        events.available = processevents_sysdep(_processEvent) >= 0;
+}
+
+
+/**
+ * Poll the process descriptors, the descriptor becomes readable when the process exits
+ */
+static void _pidfdPoll(PidFd_T *list, int count) {
+        if (count > 0) {
+                struct pollfd *fds = CALLOC(count, sizeof(struct pollfd));
+                for (int i = 0; i < count; i++) {
+                        fds[i].fd = list[i].fd;
+                        fds[i].events = POLLIN;
+                }
+                int rv;
+                do {
+                        rv = poll(fds, count, 0);
+                } while (rv < 0 && errno == EINTR);
+                if (rv >= 0) {
+                        for (int i = 0; i < count; i++) {
+                                if (fds[i].revents & POLLNVAL) {
+                                        // The descriptor is not valid anymore => stop tracking the process
+                                        list[i].fd = -1;
+                                } else {
+                                        list[i].exited = fds[i].revents ? true : false;
+                                        list[i].polled = true;
+                                }
+                        }
+                }
+                FREE(fds);
+        }
+}
+
+
+/**
+ * Track the process of the service with the process descriptor
+ */
+static void _pidfdTrack(Service_T s, pid_t pid) {
+#if defined SYS_pidfd_open
+        if (pidfds.available && pid > 0) {
+                PidFd_T *entry = NULL;
+                for (int i = 0; i < pidfds.count && ! entry; i++)
+                        if (pidfds.list[i].service == s)
+                                entry = &pidfds.list[i];
+                if (entry && entry->pid == pid && entry->fd >= 0 && ! entry->exited)
+                        return;
+                if (! entry) {
+                        if (pidfds.count == pidfds.capacity) {
+                                pidfds.capacity = pidfds.capacity ? pidfds.capacity * 2 : 16;
+                                RESIZE(pidfds.list, pidfds.capacity * sizeof(PidFd_T));
+                        }
+                        entry = &pidfds.list[pidfds.count++];
+                        entry->service = s;
+                } else if (entry->fd >= 0) {
+                        close(entry->fd);
+                }
+                entry->pid = pid;
+                entry->polled = entry->exited = false;
+                if ((entry->fd = syscall(SYS_pidfd_open, pid, 0)) >= 0) {
+                        entry->polled = true; // The descriptor was opened => the process is running
+                } else if (errno == ENOSYS || errno == EINVAL) {
+                        DEBUG("Process descriptors are not supported -- %s\n", STRERROR);
+                        pidfds.available = false;
+                }
+        }
+#endif
+}
+
+
+/**
+ * Test the process liveness using the process descriptor
+ * @return 1 if the process is running, 0 if it exited or -1 if the process is not tracked
+ */
+static int _pidfdRunning(Service_T s, pid_t pid) {
+        for (int i = 0; i < pidfds.count; i++) {
+                PidFd_T *entry = &pidfds.list[i];
+                if (entry->service == s) {
+                        if (entry->pid != pid || entry->fd < 0)
+                                return -1;
+                        if (! entry->polled)
+                                _pidfdPoll(entry, 1);
+                        return entry->exited ? 0 : 1;
+                }
+        }
+        return -1;
+}
+
+
+/**
+ * Close the descriptors of the processes whose exit was reported already. The exit is reported for the rest of the cycle, in which it was
+ * seen, then the liveness is tested without the descriptor again, so a restarted process which got the same recycled PID is found
+ */
+static void _pidfdRelease() {
+        for (int i = 0; i < pidfds.count; i++) {
+                PidFd_T *entry = &pidfds.list[i];
+                if (entry->exited && entry->fd >= 0) {
+                        close(entry->fd);
+                        entry->fd = -1;
+                        entry->polled = entry->exited = false;
+                }
+        }
+}
+
+
+static void _pidfdFree() {
+        for (int i = 0; i < pidfds.count; i++)
+                if (pidfds.list[i].fd >= 0)
+                        close(pidfds.list[i].fd);
+        FREE(pidfds.list);
+        pidfds.count = pidfds.capacity = 0;
+}
+
+
+/**
+ * Test if the process is running. If the process events are available and the process is in the current process tree and didn't exit,
+ * no system call is needed. The exit event is sent before the parent reaped the process, so the exited process is verified with
+ * getpgid(), which reports the zombie process as running, like without the process events
+ */
+static boolean_t _isRunning(pid_t pid) {
+        if (events.available && ! events.lost) {
+                int leaf = _findProcess(pid, ptree, &ptreeindex);
+                if (leaf != -1 && ! ptree[leaf].exited)
+                        return true;
+        }
+        errno = 0;
+        return getpgid(pid) > -1 || errno == EPERM;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -206,37 +634,48 @@ static int _match(regex_t *regex) {
 int ProcessTree_init(ProcessEngine_Flags pflags) {
         ProcessTree_T *oldptree = ptree;
         int oldptreesize = ptreesize;
+        PidIndex_T oldptreeindex = ptreeindex;
+        ptreeindex = (PidIndex_T){};
         if (oldptree) {
                 ptree = NULL;
                 ptreesize = 0;
                 // We need only process' cpu.time from the old ptree, so free dynamically allocated parts which we don't need before initializing new ptree (so the memory can be reused, otherwise the memory footprint will hold two ptrees)
                 for (int i = 0; i < oldptreesize; i++) {
-                        FREE(oldptree[i].cmdline);
-                        FREE(oldptree[i].children.list);
-                        FREE(oldptree[i].secattr);
+                        oldptree[i].children.list = NULL;
+                        oldptree[i].cmdline = oldptree[i].secattr = NULL;
                 }
+                FREE(ptreechildren);
         }
+        _stringsReset(false);
 
         systeminfo.time_prev = systeminfo.time;
         systeminfo.time = Time_milli() / 100.;
+        snapshot.stamp = 0;
+        // Consume the events preceding the scan, the events which will arrive during the scan are counted as changes (may be reflected in the tree already)
+        _processEvents();
+        events.changes = 0;
+        events.lost = false;
         if ((ptreesize = initprocesstree_sysdep(&ptree, pflags)) <= 0 || ! ptree) {
                 DEBUG("System statistic -- cannot initialize the process tree -- process resource monitoring disabled\n");
                 Run.flags &= ~Run_ProcessEngineEnabled;
                 if (oldptree)
                         _delete(&oldptree, &oldptreesize);
+                _indexFree(&oldptreeindex);
                 return -1;
         } else if (! (Run.flags & Run_ProcessEngineEnabled)) {
                 DEBUG("System statistic -- initialization of the process tree succeeded -- process resource monitoring enabled\n");
                 Run.flags |= Run_ProcessEngineEnabled;
         }
 
+        _indexBuild(&ptreeindex, ptree, ptreesize);
+
         int root = -1; // Main process. Not all systems have main process with PID 1 (such as Solaris zones and FreeBSD jails), so we try to find process which is parent of itself
         ProcessTree_T *pt = ptree;
         double time_delta = systeminfo.time - systeminfo.time_prev;
         for (int i = 0; i < (volatile int)ptreesize; i ++) {
                 pt[i].cpu.usage.self = -1;
                 if (oldptree) {
-                        int oldentry = _findProcess(pt[i].pid, oldptree, oldptreesize);
+                        int oldentry = _findProcess(pt[i].pid, oldptree, &oldptreeindex);
                         if (oldentry != -1) {
                                 if (systeminfo.cpu.count > 0 && time_delta > 0 && oldptree[oldentry].cpu.time >= 0 && pt[i].cpu.time >= oldptree[oldentry].cpu.time) {
                                         pt[i].cpu.usage.self = 100. * (pt[i].cpu.time - oldptree[oldentry].cpu.time) / time_delta;
@@ -248,7 +687,7 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                         root = pt[i].parent = i;
                 } else {
                         // Find this process' parent
-                        int parent = _findProcess(pt[i].ppid, pt, ptreesize);
+                        int parent = _findProcess(pt[i].ppid, pt, &ptreeindex);
                         if (parent == -1) {
                                 /* Parent process wasn't found - on Linux this is normal: main process with PID 0 is not listed, similarly in FreeBSD jail.
                                  * We create virtual process entry for missing parent so we can have full tree-like structure with root. */
@@ -256,32 +695,86 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                                 pt = RESIZE(ptree, ptreesize * sizeof(ProcessTree_T));
                                 memset(&pt[parent], 0, sizeof(ProcessTree_T));
                                 root = pt[parent].ppid = pt[parent].pid = pt[i].ppid;
+                                _indexAdd(&ptreeindex, pt, parent);
                         }
                         pt[i].parent = parent;
-                        // Connect the child (this process) to the parent
-                        RESIZE(pt[parent].children.list, sizeof(int) * (pt[parent].children.count + 1));
-                        pt[parent].children.list[pt[parent].children.count] = i;
-                        pt[parent].children.count++;
                 }
         }
         FREE(oldptree); // Free the rest of old ptree
+        _indexFree(&oldptreeindex);
         if (root == -1) {
                 DEBUG("System statistic error -- cannot find root process id\n");
                 _delete(&ptree, &ptreesize);
+                _indexFree(&ptreeindex);
                 return -1;
         }
 
-        _fillProcessTree(pt, root);
+        _linkChildren(pt, ptreesize);
+        _fillProcessTree(pt, ptreesize, root);
 
+        snapshot.stamp = snapshot.cycle;
+        snapshot.flags = pflags;
+        snapshot.generation++;
         return ptreesize;
 }
 
 
+int ProcessTree_initCycle(ProcessEngine_Flags pflags) {
+        snapshot.cycle++;
+        _pidfdRelease();
+        _pidfdPoll(pidfds.list, pidfds.count);
+        return ProcessTree_init(pflags);
+}
+
+
+void ProcessTree_invalidate() {
+        snapshot.stamp = 0;
+        for (int i = 0; i < pidfds.count; i++)
+                pidfds.list[i].polled = false;
+}
+
+
+char *ProcessTree_strdup(const char *s, int length) {
+        if (! s)
+                return NULL;
+        if (length < 0)
+                length = strlen(s);
+        if (! ptreestrings || ptreestrings->used + length + 1 > ptreestrings->size) {
+                size_t size = MAX(STRINGS_CHUNK, length + 1);
+                StringChunk_T chunk = ALLOC(sizeof(struct StringChunk_T) + size);
+                chunk->used = 0;
+                chunk->size = size;
+                chunk->next = ptreestrings;
+                ptreestrings = chunk;
+        }
+        char *t = ptreestrings->data + ptreestrings->used;
+        memcpy(t, s, length);
+        t[length] = 0;
+        ptreestrings->used += length + 1;
+        return t;
+}
+
+
 /**
  * Delete the process tree
  */
 void ProcessTree_delete() {
         _delete(&ptree, &ptreesize);
+        _indexFree(&ptreeindex);
+        _stringsReset(true);
+        _pidfdFree();
+        FREE(matchindex.entries);
+        matchindex.count = matchindex.capacity = 0;
+}
+
+
+void ProcessTree_reload() {
+        _pidfdFree();
+        FREE(matchindex.entries);
+        if (matchindex.prefilter)
+                Prefilter_free(&matchindex.prefilter);
+        matchindex.count = matchindex.capacity = 0;
+        matchindex.generation = 0;
 }
 
 
@@ -292,8 +785,9 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid) {
         s->inf.process->_pid = s->inf.process->pid;
         s->inf.process->pid  = pid;
 
-        int leaf = _findProcess(pid, ptree, ptreesize);
-        if (leaf != -1) {
+        int leaf = _findProcess(pid, ptree, &ptreeindex);
+        // Collect the process data which the system dependent tree scan skipped (fails if the process exited in the meantime)
+        if (leaf != -1 && updateprocess_sysdep(&ptree[leaf])) {
                 /* save the previous ppid and set actual one */
                 s->inf.process->_ppid             = s->inf.process->ppid;
                 s->inf.process->ppid              = ptree[leaf].ppid;
@@ -339,7 +833,7 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid) {
 
 time_t ProcessTree_getProcessUptime(pid_t pid) {
         if (ptree) {
-                int leaf = _findProcess(pid, ptree, ptreesize);
+                int leaf = _findProcess(pid, ptree, &ptreeindex);
                 return (time_t)((leaf >= 0 && leaf < ptreesize) ? ptree[leaf].uptime : -1);
         }
         return 0;
@@ -348,18 +842,32 @@ time_t ProcessTree_getProcessUptime(pid_t pid) {
 
 pid_t ProcessTree_findProcess(Service_T s) {
         ASSERT(s);
+        _processEvents();
         // Test the cached PID first
         if (s->inf.process->pid > 0) {
-                errno = 0;
-                if (getpgid(s->inf.process->pid) > -1 || errno == EPERM)
+                int running = _pidfdRunning(s, s->inf.process->pid);
+                if (running == 1 || (running == -1 && _isRunning(s->inf.process->pid))) {
+                        _pidfdTrack(s, s->inf.process->pid);
                         return s->inf.process->pid;
+                }
         }
-        // If the cached PID is not running, scan for the process again
+        // If the cached PID is not running, search the process tree snapshot
         if (s->matchlist) {
-                // Update the process tree including command line
-                ProcessTree_init(ProcessEngine_CollectCommandLine);
+                // Update the process tree including command line only if the snapshot is not usable. The snapshot from this cycle is used, an older one only if the process events confirm that no process changed since
+                boolean_t current = ptree && (snapshot.flags & ProcessEngine_CollectCommandLine) && (snapshot.stamp == snapshot.cycle || (snapshot.stamp && events.available && ! events.lost && ! events.changes));
+                if (! current)
+                        ProcessTree_init(ProcessEngine_CollectCommandLine);
                 if (Run.flags & Run_ProcessEngineEnabled) {
-                        int pid = _match(s->matchlist->regex_comp);
+                        int pid = _matchService(s);
+                        if (pid > 0 && current) {
+                                // The process may have exited since the snapshot was taken => verify it and rescan if needed
+                                if (_pidfdRunning(s, pid) == 0 || ! _isRunning(pid)) {
+                                        ProcessTree_init(ProcessEngine_CollectCommandLine);
+                                        pid = (Run.flags & Run_ProcessEngineEnabled) ? _matchService(s) : -1;
+                                }
+                        }
+                        if (pid > 0)
+                                _pidfdTrack(s, pid);
                         if (pid >= 0)
                                 return pid;
                 } else {
@@ -370,10 +878,12 @@ pid_t ProcessTree_findProcess(Service_T s) {
         } else {
                 pid_t pid = Util_getPid(s->path);
                 if (pid > 0) {
-                        errno = 0;
-                        if (getpgid(pid) > -1 || errno == EPERM)
+                        // If the process which we track exited, the PID in the stale pidfile may belong to other process already
+                        if (_pidfdRunning(s, pid) != 0 && _isRunning(pid)) {
+                                _pidfdTrack(s, pid);
                                 return pid;
-                        DEBUG("'%s' process test failed [pid=%d] -- %s\n", s->name, pid, STRERROR);
+                        }
+                        DEBUG("'%s' process test failed [pid=%d] -- the process is not running\n", s->name, pid);
                 }
         }
         Util_resetInfo(s);
@@ -31,6 +31,7 @@
 typedef struct ProcessTree_T {
         boolean_t visited;
         boolean_t zombie;
+        boolean_t exited;      /**< The process exit was reported by process events after the tree was collected */
         pid_t pid;
         pid_t ppid;
         int parent;
@@ -83,12 +84,50 @@ typedef struct ProcessTree_T {
 int ProcessTree_init(ProcessEngine_Flags pflags);
 
 
+/**
+ * Collect the process tree snapshot for a new validation cycle. The process
+ * lookups in the same cycle are served from this snapshot, the process table
+ * is rescanned only if the snapshot lacks required data or is outdated.
+ * @param pflags Process engine flags
+ * @return The process tree size or -1 if failed
+ */
+int ProcessTree_initCycle(ProcessEngine_Flags pflags);
+
+
+/**
+ * Mark the process tree snapshot as outdated. The next process lookup will
+ * rescan the process table. Should be called when some process may have been
+ * started or stopped by Monit.
+ */
+void ProcessTree_invalidate(void);
+
+
+/**
+ * Copy the string to the process tree string arena. The strings are released
+ * at once when the process tree is collected again or deleted, the system
+ * dependent collectors must use this method for the cmdline and secattr
+ * strings and must not free them.
+ * @param s The string to copy
+ * @param length The string length or -1 if s is NUL terminated
+ * @return The string copy or NULL if s is NULL
+ */
+char *ProcessTree_strdup(const char *s, int length);
+
+
 /**
  * Delete the process tree
  */
 void ProcessTree_delete(void);
 
 
+/**
+ * Drop the state kept for the services (the pattern match index and the
+ * process descriptors), which refers to the service list. Must be called on reload, after the
+ * old service list was freed.
+ */
+void ProcessTree_reload(void);
+
+
 /**
  * Update the process infomation.
  * @param s A Service object
@@ -25,11 +25,24 @@
 #ifndef MONIT_PROCESS_SYSDEP_H
 #define MONIT_PROCESS_SYSDEP_H
 
+typedef enum {
+        ProcessEvent_Fork = 0,
+        ProcessEvent_Exec,
+        ProcessEvent_Exit,
+        ProcessEvent_Lost     // The event queue overflowed, some events were lost
+} __attribute__((__packed__)) ProcessEvent_Type;
+
+
+typedef void (*ProcessEvent_Handler)(ProcessEvent_Type type, pid_t pid);
+
+
 boolean_t init_process_info_sysdep(void);
 int init_proc_info_sysdep(void);
 int getloadavg_sysdep (double *, int);
 boolean_t used_system_memory_sysdep(SystemInfo_T *);
 boolean_t used_system_cpu_sysdep(SystemInfo_T *);
 int    initprocesstree_sysdep(ProcessTree_T **, ProcessEngine_Flags);
+boolean_t updateprocess_sysdep(ProcessTree_T *);
+int    processevents_sysdep(ProcessEvent_Handler);
 
 #endif
@@ -146,6 +146,26 @@ boolean_t init_process_info_sysdep(void) {
 }
 
 
+/**
+ * The process tree scan collects all process data, nothing to update
+ * @param pt The process tree entry
+ * @return true
+ */
+boolean_t updateprocess_sysdep(ProcessTree_T *pt) {
+        return true;
+}
+
+
+/**
+ * Process events are not supported on this platform, the process table scan is used
+ * @param handler The process event handler
+ * @return -1
+ */
+int processevents_sysdep(ProcessEvent_Handler handler) {
+        return -1;
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
@@ -233,7 +253,7 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].cred.gid = ps.pr_gid;
                 if (pflags & ProcessEngine_CollectCommandLine) {
                         if (ps.pr_argc == 0) {
-                                pt[i].cmdline = Str_dup(procs[i].pi_comm); // Kernel thread
+                                pt[i].cmdline = ProcessTree_strdup(procs[i].pi_comm, -1); // Kernel thread
                         } else {
                                 char command[4096];
                                 if (! getargs(&procs[i], sizeof(struct procentry64), command, sizeof(command))) {
@@ -245,9 +265,9 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                                                         command[i] = ' ';
                                                 }
                                         }
-                                        pt[i].cmdline = Str_dup(command);
+                                        pt[i].cmdline = ProcessTree_strdup(command, -1);
                                 } else {
-                                        pt[i].cmdline = Str_dup(procs[i].pi_comm);
+                                        pt[i].cmdline = ProcessTree_strdup(procs[i].pi_comm, -1);
                                 }
                         }
                 }
@@ -65,8 +65,23 @@
 #include <asm/param.h>
 #endif
 
-#ifdef HAVE_GLOB_H
-#include <glob.h>
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if defined HAVE_LINUX_NETLINK_H && defined HAVE_LINUX_CONNECTOR_H && defined HAVE_LINUX_CN_PROC_H
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#define HAVE_PROC_CONNECTOR 1
 #endif
 
 #ifdef HAVE_SYS_SYSINFO_H
@@ -92,7 +107,10 @@
 
 static struct {
         int hasIOStatistics; // True if /proc/<PID>/io is present
-} _statistics = {};
+        int procfd;          // Cached /proc directory descriptor
+        int lastCount;       // Number of processes found in the last scan
+        int eventsfd;        // Proc connector socket, -1 if not opened yet, -2 if not available
+} _statistics = {.procfd = -1, .eventsfd = -1};
 
 
 typedef struct Proc_T {
@@ -111,11 +129,24 @@ typedef struct Proc_T {
         unsigned long long  item_starttime;
         uint64_t            read_bytes;
         uint64_t            write_bytes;
+        int                 nameLength;
+        int                 secattrLength;
+        // Strings are last, so the numeric part can be reset cheaply
         char                name[4096];
         char                secattr[STRLEN];
 } *Proc_T;
 
 
+/* The getdents64 record, the glibc dirent structure doesn't necessarily match the kernel layout */
+typedef struct ProcDirent_T {
+        uint64_t            d_ino;
+        int64_t             d_off;
+        unsigned short      d_reclen;
+        unsigned char       d_type;
+        char                d_name[];
+} ProcDirent_T;
+
+
 /* --------------------------------------- Static constructor and destructor */
 
 
@@ -153,38 +184,125 @@ static time_t _getStartTime() {
 }
 
 
-// parse /proc/PID/stat 
-static boolean_t _parseProcPidStat(Proc_T proc) {
-        char buf[4096];
-        char *tmp = NULL;
-        if (! file_readProc(buf, sizeof(buf), "stat", proc->pid, NULL)) {
-                DEBUG("system statistic error -- cannot read /proc/%d/stat\n", proc->pid);
+/**
+ * Open the /proc directory once, the per-process files are opened relative to this descriptor
+ * @return true if the /proc directory is available
+ */
+static boolean_t _procOpen() {
+        if (_statistics.procfd < 0 && (_statistics.procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+                LogError("system statistic error -- cannot open /proc: %s\n", STRERROR);
                 return false;
         }
-        if (! (tmp = strrchr(buf, ')'))) {
-                DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->pid);
-                return false;
+        return true;
+}
+
+
+/**
+ * Read the /proc/<pid>/<name> file. The content is NUL terminated
+ * @return The number of bytes read or -1 if the file cannot be read
+ */
+static int _readProcFile(int pid, const char *name, char *buf, int size) {
+        // Compose the "<pid>/<name>" path relative to /proc
+        char path[64], digits[16];
+        int n = 0, k = 0;
+        do {
+                digits[n++] = '0' + pid % 10;
+                pid /= 10;
+        } while (pid > 0);
+        while (n > 0)
+                path[k++] = digits[--n];
+        path[k++] = '/';
+        while (*name && k < sizeof(path) - 1)
+                path[k++] = *name++;
+        path[k] = 0;
+        int fd = openat(_statistics.procfd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -1;
+        int total = 0;
+        while (total < size - 1) {
+                ssize_t r = read(fd, buf + total, size - 1 - total);
+                if (r > 0) {
+                        total += r;
+                } else if (r == 0 || errno != EINTR) {
+                        if (r < 0 && total == 0) {
+                                close(fd);
+                                return -1;
+                        }
+                        break;
+                }
         }
-        *tmp = 0;
-        if (sscanf(buf, "%*d (%255s", proc->name) != 1) {
-                DEBUG("system statistic error -- file /proc/%d/stat process name parse error\n", proc->pid);
+        close(fd);
+        buf[total] = 0;
+        return total;
+}
+
+
+static inline const char *_skipSpaces(const char *p) {
+        while (*p == ' ' || *p == '\t')
+                p++;
+        return p;
+}
+
+
+/**
+ * Parse the decimal integer (optionally negative) after optional whitespace
+ * @return Pointer to the first character after the number or NULL if no number was found
+ */
+static const char *_parseNumber(const char *p, long long *value) {
+        boolean_t negative = false;
+        p = _skipSpaces(p);
+        if (*p == '-') {
+                negative = true;
+                p++;
+        }
+        if (*p < '0' || *p > '9')
+                return NULL;
+        unsigned long long v = 0;
+        for (; *p >= '0' && *p <= '9'; p++)
+                v = v * 10 + (*p - '0');
+        *value = negative ? -(long long)v : (long long)v;
+        return p;
+}
+
+
+// parse /proc/PID/stat
+static boolean_t _parseProcPidStat(Proc_T proc) {
+        char buf[1024];
+        if (_readProcFile(proc->pid, "stat", buf, sizeof(buf)) <= 0) {
+                DEBUG("system statistic error -- cannot read /proc/%d/stat\n", proc->pid);
                 return false;
         }
-        tmp += 2;
-        if (sscanf(tmp,
-                   "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld %*d %*d %d %*u %llu %*u %ld %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %*d\n",
-                   &(proc->item_state),
-                   &(proc->ppid),
-                   &(proc->item_utime),
-                   &(proc->item_stime),
-                   &(proc->item_cutime),
-                   &(proc->item_cstime),
-                   &(proc->item_threads),
-                   &(proc->item_starttime),
-                   &(proc->item_rss)) != 9) {
+        // The process name is enclosed in parentheses and may contain any character, so search for the last ')'
+        char *name = strchr(buf, '(');
+        char *end = strrchr(buf, ')');
+        if (! name || ! end || end < name) {
                 DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->pid);
                 return false;
         }
+        int length = 0;
+        for (name++; name + length < end && name[length] != ' ' && name[length] != '\t' && length < 255; length++)
+                ;
+        memcpy(proc->name, name, length);
+        proc->name[length] = 0;
+        proc->nameLength = length;
+        // Fields following the process name, the state is field 0
+        const char *p = _skipSpaces(end + 1);
+        proc->item_state = *p++;
+        long long field[22];
+        for (int i = 1; i < 22; i++) {
+                if (! (p = _parseNumber(p, &field[i]))) {
+                        DEBUG("system statistic error -- file /proc/%d/stat parse error\n", proc->pid);
+                        return false;
+                }
+        }
+        proc->ppid           = (int)field[1];
+        proc->item_utime     = (unsigned long)field[11];
+        proc->item_stime     = (unsigned long)field[12];
+        proc->item_cutime    = (long)field[13];
+        proc->item_cstime    = (long)field[14];
+        proc->item_threads   = (int)field[17];
+        proc->item_starttime = (unsigned long long)field[19];
+        proc->item_rss       = (long)field[21];
         return true;
 }
 
@@ -192,8 +310,9 @@ static boolean_t _parseProcPidStat(Proc_T proc) {
 // parse /proc/PID/status
 static boolean_t _parseProcPidStatus(Proc_T proc) {
         char buf[4096];
-        char *tmp = NULL;
-        if (! file_readProc(buf, sizeof(buf), "status", proc->pid, NULL)) {
+        const char *tmp = NULL;
+        long long uid, euid, gid;
+        if (_readProcFile(proc->pid, "status", buf, sizeof(buf)) <= 0) {
                 DEBUG("system statistic error -- cannot read /proc/%d/status\n", proc->pid);
                 return false;
         }
@@ -201,18 +320,21 @@ static boolean_t _parseProcPidStatus(Proc_T proc) {
                 DEBUG("system statistic error -- cannot find process uid\n");
                 return false;
         }
-        if (sscanf(tmp + 4, "\t%d\t%d", &(proc->uid), &(proc->euid)) != 2) {
+        if (! (tmp = _parseNumber(tmp + 4, &uid)) || ! _parseNumber(tmp, &euid)) {
                 DEBUG("system statistic error -- cannot read process uid\n");
                 return false;
         }
-        if (! (tmp = strstr(buf, "Gid:"))) {
+        if (! (tmp = strstr(tmp, "Gid:"))) {
                 DEBUG("system statistic error -- cannot find process gid\n");
                 return false;
         }
-        if (sscanf(tmp + 4, "\t%d", &(proc->gid)) != 1) {
+        if (! _parseNumber(tmp + 4, &gid)) {
                 DEBUG("system statistic error -- cannot read process gid\n");
                 return false;
         }
+        proc->uid = (int)uid;
+        proc->euid = (int)euid;
+        proc->gid = (int)gid;
         return true;
 }
 
@@ -220,25 +342,28 @@ static boolean_t _parseProcPidStatus(Proc_T proc) {
 // parse /proc/PID/io
 static boolean_t _parseProcPidIO(Proc_T proc) {
         char buf[4096];
-        char *tmp = NULL;
+        const char *tmp = NULL;
+        long long value;
         if (_statistics.hasIOStatistics) {
-                if (file_readProc(buf, sizeof(buf), "io", proc->pid, NULL)) {
+                if (_readProcFile(proc->pid, "io", buf, sizeof(buf)) > 0) {
                         if (! (tmp = strstr(buf, "read_bytes:"))) {
                                 DEBUG("system statistic error -- cannot find process read_bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 11, "\t%"PRIu64, &(proc->read_bytes)) != 1) {
+                        if (! (tmp = _parseNumber(tmp + 11, &value))) {
                                 DEBUG("system statistic error -- cannot get process read bytes\n");
                                 return false;
                         }
-                        if (! (tmp = strstr(buf, "write_bytes:"))) {
+                        proc->read_bytes = (uint64_t)value;
+                        if (! (tmp = strstr(tmp, "write_bytes:"))) {
                                 DEBUG("system statistic error -- cannot find process write_bytes\n");
                                 return false;
                         }
-                        if (sscanf(tmp + 12, "\t%"PRIu64, &(proc->write_bytes)) != 1) {
+                        if (! _parseNumber(tmp + 12, &value)) {
                                 DEBUG("system statistic error -- cannot get process write bytes\n");
                                 return false;
                         }
+                        proc->write_bytes = (uint64_t)value;
                 }
         }
         return true;
@@ -248,17 +373,22 @@ static boolean_t _parseProcPidIO(Proc_T proc) {
 // parse /proc/PID/cmdline
 static boolean_t _parseProcPidCmdline(Proc_T proc, ProcessEngine_Flags pflags) {
         if (pflags & ProcessEngine_CollectCommandLine) {
-                int bytes = 0;
-                char buf[4096];
-                if (! file_readProc(buf, sizeof(buf), "cmdline", proc->pid, &bytes)) {
+                char buf[sizeof(proc->name)];
+                int bytes = _readProcFile(proc->pid, "cmdline", buf, sizeof(buf));
+                if (bytes < 0) {
                         DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", proc->pid);
                         return false;
                 }
-                for (int j = 0; j < (bytes - 1); j++) // The cmdline file contains argv elements/strings terminated separated by '\0' => join the string
+                // The cmdline file contains argv elements/strings terminated separated by '\0' => join the string
+                while (bytes > 0 && buf[bytes - 1] == 0)
+                        bytes--;
+                for (int j = 0; j < bytes; j++)
                         if (buf[j] == 0)
                                 buf[j] = ' ';
-                if (*buf)
-                        snprintf(proc->name, sizeof(proc->name), "%s", buf);
+                if (bytes > 0) {
+                        memcpy(proc->name, buf, bytes + 1);
+                        proc->nameLength = bytes;
+                }
         }
         return true;
 }
@@ -266,14 +396,51 @@ static boolean_t _parseProcPidCmdline(Proc_T proc, ProcessEngine_Flags pflags) {
 
 // parse /proc/PID/attr/current
 static boolean_t _parseProcPidAttrCurrent(Proc_T proc) {
-        if (file_readProc(proc->secattr, sizeof(proc->secattr), "attr/current", proc->pid, NULL)) {
+        if (_readProcFile(proc->pid, "attr/current", proc->secattr, sizeof(proc->secattr)) >= 0) {
                 Str_trim(proc->secattr);
+                proc->secattrLength = strlen(proc->secattr);
                 return true;
         }
         return false;
 }
 
 
+#ifdef HAVE_PROC_CONNECTOR
+/**
+ * Subscribe to the process events multicast by the kernel proc connector (requires the CAP_NET_ADMIN capability)
+ * @return The netlink socket or -1 if the connector is not available
+ */
+static int _procConnectorOpen() {
+        int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (fd < 0)
+                return -1;
+        struct sockaddr_nl address = {.nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC};
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+                struct __attribute__((aligned(NLMSG_ALIGNTO))) {
+                        struct nlmsghdr header;
+                        struct __attribute__((__packed__)) {
+                                struct cn_msg message;
+                                enum proc_cn_mcast_op operation;
+                        } body;
+                } request = {};
+                request.header.nlmsg_len = sizeof(request);
+                request.header.nlmsg_type = NLMSG_DONE;
+                request.header.nlmsg_pid = getpid();
+                request.body.message.id.idx = CN_IDX_PROC;
+                request.body.message.id.val = CN_VAL_PROC;
+                request.body.message.len = sizeof(enum proc_cn_mcast_op);
+                request.body.operation = PROC_CN_MCAST_LISTEN;
+                if (send(fd, &request, sizeof(request), 0) == sizeof(request))
+                        return fd;
+        }
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+}
+#endif
+
+
 static double _usagePercent(unsigned long long previous, unsigned long long current, double total) {
         if (current < previous) {
                 // The counter jumped back (observed for cpu wait metric on Linux 4.15) or wrapped
@@ -352,49 +519,161 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
         ASSERT(reference);
 
         // Find all processes in the /proc directory
-        glob_t globbuf;
-        int rv = glob("/proc/[0-9]*", 0, NULL, &globbuf);
-        if (rv) {
-                LogError("system statistic error -- glob failed: %d (%s)\n", rv, STRERROR);
+        if (! _procOpen())
+                return 0;
+        if (lseek(_statistics.procfd, 0, SEEK_SET) < 0) {
+                LogError("system statistic error -- cannot rewind /proc: %s\n", STRERROR);
                 return 0;
         }
-        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), globbuf.gl_pathc);
+        int capacity = MAX(_statistics.lastCount + 128, 256);
+        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), capacity);
 
-        int count = 0;
-        struct Proc_T proc = {};
+        int count = 0, bytes;
+        char buf[32768] __attribute__((aligned(8)));
+        struct Proc_T proc;
         time_t starttime = _getStartTime();
-        for (int i = 0; i < globbuf.gl_pathc; i++) {
-                proc.pid = atoi(globbuf.gl_pathv[i] + 6); // skip "/proc/"
-                if (_parseProcPidStat(&proc) && _parseProcPidStatus(&proc) && _parseProcPidIO(&proc) && _parseProcPidCmdline(&proc, pflags)) {
-                        // Non-mandatory statistics (may not exist)
-                        _parseProcPidAttrCurrent(&proc);
-                        // Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that continue was called during data collecting)
-                        pt[count].pid = proc.pid;
-                        pt[count].ppid = proc.ppid;
-                        pt[count].cred.uid = proc.uid;
-                        pt[count].cred.euid = proc.euid;
-                        pt[count].cred.gid = proc.gid;
-                        pt[count].threads.self = proc.item_threads;
-                        pt[count].uptime = starttime > 0 ? (systeminfo.time / 10. - (starttime + (time_t)(proc.item_starttime / hz))) : 0;
-                        pt[count].cpu.time = (double)(proc.item_utime + proc.item_stime) / hz * 10.; // jiffies -> seconds = 1/hz
-                        pt[count].memory.usage = (uint64_t)proc.item_rss * (uint64_t)page_size;
-                        pt[count].read.bytes = proc.read_bytes;
-                        pt[count].write.bytes = proc.write_bytes;
-                        pt[count].zombie = proc.item_state == 'Z' ? true : false;
-                        pt[count].cmdline = Str_dup(proc.name);
-                        pt[count].secattr = Str_dup(proc.secattr);
-                        count++;
-                        memset(&proc, 0, sizeof(struct Proc_T));
+        while ((bytes = syscall(SYS_getdents64, _statistics.procfd, buf, sizeof(buf))) > 0) {
+                for (int offset = 0; offset < bytes;) {
+                        ProcDirent_T *entry = (ProcDirent_T *)(buf + offset);
+                        offset += entry->d_reclen;
+                        // Skip non-PID entries
+                        int pid = 0;
+                        const char *c = entry->d_name;
+                        for (; *c >= '0' && *c <= '9'; c++)
+                                pid = pid * 10 + (*c - '0');
+                        if (*c || pid <= 0)
+                                continue;
+                        memset(&proc, 0, offsetof(struct Proc_T, name));
+                        *proc.name = *proc.secattr = 0;
+                        proc.pid = pid;
+                        // Note: the credentials, I/O statistics and security attribute are not needed for the tree, they're collected by updateprocess_sysdep() for monitored processes only
+                        if (_parseProcPidStat(&proc) && _parseProcPidCmdline(&proc, pflags)) {
+                                if (count == capacity) {
+                                        capacity *= 2;
+                                        RESIZE(pt, capacity * sizeof(ProcessTree_T));
+                                        memset(pt + count, 0, (capacity - count) * sizeof(ProcessTree_T));
+                                }
+                                // Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that continue was called during data collecting)
+                                pt[count].pid = proc.pid;
+                                pt[count].ppid = proc.ppid;
+                                pt[count].cred.uid = pt[count].cred.euid = pt[count].cred.gid = -1;
+                                pt[count].threads.self = proc.item_threads;
+                                pt[count].uptime = starttime > 0 ? (systeminfo.time / 10. - (starttime + (time_t)(proc.item_starttime / hz))) : 0;
+                                pt[count].cpu.time = (double)(proc.item_utime + proc.item_stime) / hz * 10.; // jiffies -> seconds = 1/hz
+                                pt[count].memory.usage = (uint64_t)proc.item_rss * (uint64_t)page_size;
+                                pt[count].zombie = proc.item_state == 'Z' ? true : false;
+                                pt[count].cmdline = ProcessTree_strdup(proc.name, proc.nameLength);
+                                count++;
+                        }
                 }
         }
+        if (bytes < 0 || count == 0) {
+                if (bytes < 0)
+                        LogError("system statistic error -- cannot read /proc: %s\n", STRERROR);
+                FREE(pt);
+                return 0;
+        }
 
+        _statistics.lastCount = count;
         *reference = pt;
-        globfree(&globbuf);
 
         return count;
 }
 
 
+/**
+ * Collect the process data which are not part of the process tree scan: credentials, I/O statistics and security attribute
+ * @param pt The process tree entry
+ * @return true if succeeded otherwise false
+ */
+boolean_t updateprocess_sysdep(ProcessTree_T *pt) {
+        ASSERT(pt);
+        struct Proc_T proc;
+        memset(&proc, 0, offsetof(struct Proc_T, name));
+        *proc.name = *proc.secattr = 0;
+        proc.pid = pt->pid;
+        if (! _procOpen() || ! _parseProcPidStatus(&proc) || ! _parseProcPidIO(&proc))
+                return false;
+        // Non-mandatory statistics (may not exist)
+        _parseProcPidAttrCurrent(&proc);
+        pt->cred.uid = proc.uid;
+        pt->cred.euid = proc.euid;
+        pt->cred.gid = proc.gid;
+        pt->read.bytes = proc.read_bytes;
+        pt->write.bytes = proc.write_bytes;
+        pt->secattr = ProcessTree_strdup(proc.secattr, proc.secattrLength);
+        return true;
+}
+
+
+/**
+ * Read the pending process events from the proc connector. The socket is opened on the first call.
+ * @param handler The process event handler
+ * @return The number of fork, exec and exit events or -1 if the process events are not available
+ */
+int processevents_sysdep(ProcessEvent_Handler handler) {
+        ASSERT(handler);
+#ifdef HAVE_PROC_CONNECTOR
+        if (_statistics.eventsfd == -1) {
+                if ((_statistics.eventsfd = _procConnectorOpen()) < 0) {
+                        DEBUG("system statistic -- process events are not available (%s), using the process table scan\n", STRERROR);
+                        _statistics.eventsfd = -2;
+                } else {
+                        DEBUG("system statistic -- subscribed to the process events\n");
+                }
+        }
+        if (_statistics.eventsfd < 0)
+                return -1;
+        int count = 0;
+        ssize_t n;
+        char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+        struct sockaddr_nl from;
+        socklen_t fromlen = sizeof(from);
+        while ((n = recvfrom(_statistics.eventsfd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen)) > 0) {
+                if (from.nl_pid != 0)
+                        continue; // Not sent by the kernel
+                for (struct nlmsghdr *header = (struct nlmsghdr *)buf; NLMSG_OK(header, n); header = NLMSG_NEXT(header, n)) {
+                        if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP)
+                                continue;
+                        struct cn_msg *message = NLMSG_DATA(header);
+                        if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC)
+                                continue;
+                        struct proc_event *event = (struct proc_event *)message->data;
+                        // Only the events of the whole process (thread group leader) are reported, the thread events are ignored
+                        switch (event->what) {
+                                case PROC_EVENT_FORK:
+                                        if (event->event_data.fork.child_pid == event->event_data.fork.child_tgid) {
+                                                handler(ProcessEvent_Fork, event->event_data.fork.child_tgid);
+                                                count++;
+                                        }
+                                        break;
+                                case PROC_EVENT_EXEC:
+                                        handler(ProcessEvent_Exec, event->event_data.exec.process_tgid);
+                                        count++;
+                                        break;
+                                case PROC_EVENT_EXIT:
+                                        if (event->event_data.exit.process_pid == event->event_data.exit.process_tgid) {
+                                                handler(ProcessEvent_Exit, event->event_data.exit.process_tgid);
+                                                count++;
+                                        }
+                                        break;
+                                default:
+                                        break;
+                        }
+                }
+                fromlen = sizeof(from);
+        }
+        if (n < 0 && errno == ENOBUFS) {
+                DEBUG("system statistic -- process events queue overflow\n");
+                handler(ProcessEvent_Lost, 0);
+        }
+        return count;
+#else
+        return -1;
+#endif
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
@@ -188,11 +188,10 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                                 for (int j = 0; args[j]; j++)
                                         StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
                                 if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
+                                        pt[i].cmdline = ProcessTree_strdup(StringBuffer_toString(StringBuffer_trim(cmdline)), -1);
                         }
                         if (STR_UNDEF(pt[i].cmdline)) {
-                                FREE(pt[i].cmdline);
-                                pt[i].cmdline = Str_dup(pinfo[i].p_comm);
+                                pt[i].cmdline = ProcessTree_strdup(pinfo[i].p_comm, -1);
                         }
                 }
         }
@@ -207,6 +206,26 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
 }
 
 
+/**
+ * The process tree scan collects all process data, nothing to update
+ * @param pt The process tree entry
+ * @return true
+ */
+boolean_t updateprocess_sysdep(ProcessTree_T *pt) {
+        return true;
+}
+
+
+/**
+ * Process events are not supported on this platform, the process table scan is used
+ * @param handler The process event handler
+ * @return -1
+ */
+int processevents_sysdep(ProcessEvent_Handler handler) {
+        return -1;
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
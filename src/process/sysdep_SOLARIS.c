@@ -167,10 +167,9 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                         pt[i].zombie       = psinfo->pr_nlwp == 0 ? true : false; // If we don't have any light-weight processes (LWP) then we are definitely a zombie
                         pt[i].memory.usage = (uint64_t)psinfo->pr_rssize * 1024;
                         if (pflags & ProcessEngine_CollectCommandLine) {
-                                pt[i].cmdline = Str_dup(psinfo->pr_psargs);
+                                pt[i].cmdline = ProcessTree_strdup(psinfo->pr_psargs, -1);
                                 if (STR_UNDEF(pt[i].cmdline)) {
-                                        FREE(pt[i].cmdline);
-                                        pt[i].cmdline = Str_dup(psinfo->pr_fname);
+                                        pt[i].cmdline = ProcessTree_strdup(psinfo->pr_fname, -1);
                                 }
                         }
                         if (file_readProc(buf, sizeof(buf), "status", pt[i].pid, NULL)) {
@@ -194,6 +193,26 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
         return treesize;
 }
 
+/**
+ * The process tree scan collects all process data, nothing to update
+ * @param pt The process tree entry
+ * @return true
+ */
+boolean_t updateprocess_sysdep(ProcessTree_T *pt) {
+        return true;
+}
+
+
+/**
+ * Process events are not supported on this platform, the process table scan is used
+ * @param handler The process event handler
+ * @return -1
+ */
+int processevents_sysdep(ProcessEvent_Handler handler) {
+        return -1;
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
@@ -53,6 +53,28 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
 }
 
 
+/**
+ * THIS IS JUST A DUMMY!!!
+ *
+ * @param pt The process tree entry
+ * @return true
+ */
+boolean_t updateprocess_sysdep(ProcessTree_T *pt) {
+        return true;
+}
+
+
+/**
+ * THIS IS JUST A DUMMY!!!
+ *
+ * @param handler The process event handler
+ * @return -1 (process events are not available)
+ */
+int processevents_sysdep(ProcessEvent_Handler handler) {
+        return -1;
+}
+
+
 /**
  * THIS IS JUST A DUMMY!!!
  *
@@ -28,10 +28,9 @@
 #include <string.h>
 #endif
 
-#include "md5.h"
-#include "sha1.h"
 #include "base64.h"
 #include "protocol.h"
+#include "digest.h"
 #include "httpstatus.h"
 #include "util/Str.h"
 
@@ -61,12 +60,6 @@
 #define BUFSIZE 4096
 
 
-typedef union ChecksumContext_T {
-        md5_context_t  md5;
-        sha1_context_t sha1;
-} *ChecksumContext_T;
-
-
 /* ----------------------------------------------------------------- Private */
 
 
@@ -74,7 +67,11 @@ static void _contentVerify(Port_T P, const char *data) {
         if (P->url_request && P->url_request->regex) {
                 boolean_t rv = false;
                 char error[512];
-                int regex_return = regexec(P->url_request->regex, data, 0, NULL, 0);
+                // Skip the regex if the content doesn't contain the literal required by the pattern
+                int regex_return = REG_NOMATCH;
+                Prefilter_scan(P->url_request->prefilter, data, strlen(data));
+                if (Prefilter_candidate(P->url_request->prefilter, 0))
+                        regex_return = regexec(P->url_request->regex, data, 0, NULL, 0);
                 switch (P->url_request->operator) {
                         case Operator_Equal:
                                 if (regex_return == 0) {
@@ -104,69 +101,16 @@ static void _contentVerify(Port_T P, const char *data) {
 }
 
 
-static void _checksumInit(Port_T P, ChecksumContext_T context) {
-        if (P->parameters.http.checksum) {
-                switch (P->parameters.http.hashtype) {
-                        case Hash_Md5:
-                                md5_init(&(context->md5));
-                                break;
-                        case Hash_Sha1:
-                                sha1_init(&(context->sha1));
-                                break;
-                        default:
-                                THROW(ProtocolException, "HTTP checksum error: Unknown hash type");
-                }
-        }
-}
-
-
-static void _checksumFinish(Port_T P, ChecksumContext_T context, MD_T hash) {
-        if (P->parameters.http.checksum) {
-                switch (P->parameters.http.hashtype) {
-                        case Hash_Md5:
-                                md5_finish(&(context->md5), (md5_byte_t *)hash);
-                                break;
-                        case Hash_Sha1:
-                                sha1_finish(&(context->sha1), (unsigned char *)hash);
-                                break;
-                        default:
-                                THROW(ProtocolException, "HTTP checksum error: Unknown hash type");
-                }
-        }
-}
-
-
-static void _checksumAppend(Port_T P, ChecksumContext_T context, const char *input, int inputLength) {
-        if (P->parameters.http.checksum) {
-                switch (P->parameters.http.hashtype) {
-                        case Hash_Md5:
-                                md5_append(&(context->md5), (const md5_byte_t *)input, inputLength);
-                                break;
-                        case Hash_Sha1:
-                                sha1_append(&(context->sha1), (const unsigned char *)input, inputLength);
-                                break;
-                        default:
-                                THROW(ProtocolException, "HTTP checksum error: Unknown hash type");
-                }
-        }
+static void _checksumAppend(Digest_T digest, const char *input, int inputLength) {
+        if (digest)
+                Digest_update(digest, input, inputLength);
 }
 
 
-static void _checksumVerify(Port_T P, MD_T hash) {
-        if (P->parameters.http.checksum) {
-                int keyLength = 0;
-                switch (P->parameters.http.hashtype) {
-                        case Hash_Md5:
-                                keyLength = 16; /* Raw key bytes not string chars! */
-                                break;
-                        case Hash_Sha1:
-                                keyLength = 20; /* Raw key bytes not string chars! */
-                                break;
-                        default:
-                                THROW(ProtocolException, "HTTP checksum error: Unknown hash type");
-                }
+static void _checksumVerify(Port_T P, Digest_T digest) {
+        if (digest) {
                 MD_T hashString = {};
-                if (strncasecmp(Util_digest2Bytes((unsigned char *)hash, keyLength, hashString), P->parameters.http.checksum, keyLength * 2) != 0)
+                if (strncasecmp(Digest_finish(digest, hashString), P->parameters.http.checksum, Digest_length(P->parameters.http.hashtype) * 2) != 0)
                         THROW(ProtocolException, "HTTP checksum error: Data checksum mismatch (expected %s got %s)", P->parameters.http.checksum, hashString);
                 DEBUG("HTTP: Succeeded testing data checksum\n");
         }
@@ -215,43 +159,64 @@ static int _readDataFromSocket(Port_T P, Socket_T socket, char *data, int wantBy
 }
 
 
-static void _readData(Socket_T socket, Port_T P, volatile char **data, int wantBytes, int *haveBytes, ChecksumContext_T context) {
+static void _readData(Socket_T socket, Port_T P, volatile char **data, int wantBytes, int *haveBytes, Digest_T digest) {
         if (P->url_request && P->url_request->regex) {
                 // The content test is required => cache the whole body
                 *data = realloc((void *)*data, *haveBytes + wantBytes + 1);
                 *haveBytes += _readDataFromSocket(P, socket, (void *)*data + *haveBytes, wantBytes);
-                _checksumAppend(P, context, (const char *)*data, wantBytes);
+                _checksumAppend(digest, (const char *)*data, wantBytes);
                 *(*data + *haveBytes) = 0;
         } else {
                 // No content check is required => use small buffer and compute the checksum on the fly
                 *haveBytes = 0;
                 for (int readBytes = (wantBytes < BUFSIZE) ? wantBytes : BUFSIZE; *haveBytes < wantBytes; readBytes = (wantBytes - *haveBytes) < BUFSIZE ? (wantBytes - *haveBytes) : BUFSIZE) {
                         _readDataFromSocket(P, socket, (void *)*data, readBytes);
-                        _checksumAppend(P, context, (const char *)*data, readBytes);
+                        _checksumAppend(digest, (const char *)*data, readBytes);
                         *haveBytes += readBytes;
                 }
         }
 }
 
 
-static void _processBodyChunked(Socket_T socket, Port_T P, volatile char **data, int *contentLength, ChecksumContext_T context) {
+/* Read the chunked body trailer up to the empty line */
+static void _readTrailer(Socket_T socket) {
+        char buf[512] = {};
+        do {
+                if (! Socket_readLine(socket, buf, sizeof(buf)))
+                        THROW(IOException, "HTTP error: failed to read chunked body trailer -- %s", STRERROR);
+        } while (! ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n')));
+}
+
+
+/* Returns true if the whole body was read, false if it was truncated to the content buffer limit */
+static boolean_t _processBodyChunked(Socket_T socket, Port_T P, volatile char **data, int *contentLength, Digest_T digest) {
         char crlf[2] = {};
         int wantBytes = 0;
         int haveBytes = 0;
-        while ((wantBytes = _getChunkSize(socket)) && haveBytes < Run.limits.httpContentBuffer) {
-                if (haveBytes + wantBytes > Run.limits.httpContentBuffer) {
+        int totalBytes = 0;
+        while ((wantBytes = _getChunkSize(socket)) && totalBytes < Run.limits.httpContentBuffer) {
+                if (totalBytes + wantBytes > Run.limits.httpContentBuffer) {
                         DEBUG("HTTP: content buffer limit exceeded -- limiting the data to %d\n", Run.limits.httpContentBuffer);
-                        wantBytes = Run.limits.httpContentBuffer - haveBytes;
+                        wantBytes = Run.limits.httpContentBuffer - totalBytes;
                 }
-                _readData(socket, P, data, wantBytes, &haveBytes, context);
+                _readData(socket, P, data, wantBytes, &haveBytes, digest);
+                totalBytes += wantBytes;
                 // Read the CRLF terminator
                 _readDataFromSocket(P, socket, crlf, 2);
         }
+        if (wantBytes)
+                return false;
+        // The trailer is read only if the connection is reused, the server may close the connection without the final CRLF
+        if (P->parameters.http.keepalive)
+                _readTrailer(socket);
+        return true;
 }
 
 
-static void _processBodyContentLength(Socket_T socket, Port_T P, volatile char **data, int *contentLength, ChecksumContext_T context) {
+/* Returns true if the whole body was read, false if it was truncated to the content buffer limit */
+static boolean_t _processBodyContentLength(Socket_T socket, Port_T P, volatile char **data, int *contentLength, Digest_T digest) {
         int haveBytes = 0;
+        boolean_t complete = true;
         if (*contentLength < 0) {
                 THROW(ProtocolException, "HTTP error: Missing Content-Length header");
         } else if (*contentLength == 0) {
@@ -259,12 +224,35 @@ static void _processBodyContentLength(Socket_T socket, Port_T P, volatile char *
         } else if (*contentLength > Run.limits.httpContentBuffer) {
                 DEBUG("HTTP: content buffer limit exceeded -- limiting the data to %d\n", Run.limits.httpContentBuffer);
                 *contentLength = Run.limits.httpContentBuffer;
+                complete = false;
+        }
+        _readData(socket, P, data, *contentLength, &haveBytes, digest);
+        return complete;
+}
+
+
+/* Read and discard the body which wasn't tested, so the next request can reuse the connection. Returns false if the body end is unknown or it is too large */
+static boolean_t _skipBody(Socket_T socket, Port_T P, boolean_t (*processBody)(Socket_T socket, Port_T P, volatile char **data, int *contentLength, Digest_T digest), int contentLength) {
+        if (! processBody || contentLength > (int)Run.limits.httpContentBuffer)
+                return false;
+        if (contentLength == 0)
+                return true;
+        volatile char *data = CALLOC(1, BUFSIZE);
+        volatile boolean_t rv = false;
+        TRY
+        {
+                rv = processBody(socket, P, &data, &contentLength, NULL);
         }
-        _readData(socket, P, data, *contentLength, &haveBytes, context);
+        FINALLY
+        {
+                free((void *)data);
+        }
+        END_TRY;
+        return rv;
 }
 
 
-static void _processStatus(Socket_T socket, Port_T P) {
+static int _processStatus(Socket_T socket, Port_T P, boolean_t *keepalive) {
         int status;
         char buf[512] = {};
 
@@ -275,17 +263,24 @@ static void _processStatus(Socket_T socket, Port_T P) {
                 THROW(ProtocolException, "HTTP error: Cannot parse HTTP status in response: %s", buf);
         if (! Util_evalQExpression(P->parameters.http.operator, status, P->parameters.http.hasStatus ? P->parameters.http.status : 400))
                 THROW(ProtocolException, "HTTP error: Server returned status %d", status);
+        // HTTP/1.0 servers close the connection unless negotiated otherwise
+        if (! Str_startsWith(buf, "HTTP/1.1"))
+                *keepalive = false;
+        return status;
 }
 
 
-static void _processHeaders(Socket_T socket, Port_T P, void (**processBody)(Socket_T socket, Port_T P, volatile char **data, int *contentLength, ChecksumContext_T context), int *contentLength) {
+static void _processHeaders(Socket_T socket, Port_T P, boolean_t (**processBody)(Socket_T socket, Port_T P, volatile char **data, int *contentLength, Digest_T digest), int *contentLength, boolean_t *keepalive) {
         char buf[512] = {};
 
         while (Socket_readLine(socket, buf, sizeof(buf))) {
                 if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n'))
                         break;
                 Str_chomp(buf);
-                if (Str_startsWith(buf, "Content-Length")) {
+                if (Str_startsWith(buf, "Connection")) {
+                        if (Str_sub(buf, "close"))
+                                *keepalive = false;
+                } else if (Str_startsWith(buf, "Content-Length")) {
                         if (! sscanf(buf, "%*s%*[: ]%d", contentLength))
                                 THROW(ProtocolException, "HTTP error: Parsing Content-Length response header '%s'", buf);
                         if (*contentLength < 0)
@@ -307,34 +302,41 @@ static void _processHeaders(Socket_T socket, Port_T P, void (**processBody)(Sock
  */
 static void _checkResponse(Socket_T socket, Port_T P) {
         int contentLength = -1;
-        void (*processBody)(Socket_T socket, Port_T P, volatile char **data, int *contentLength, ChecksumContext_T context) = NULL;
+        boolean_t keepalive = P->parameters.http.keepalive;
+        boolean_t (*processBody)(Socket_T socket, Port_T P, volatile char **data, int *contentLength, Digest_T digest) = NULL;
 
-        _processStatus(socket, P);
-        _processHeaders(socket, P, &processBody, &contentLength);
+        int status = _processStatus(socket, P, &keepalive);
+        _processHeaders(socket, P, &processBody, &contentLength, &keepalive);
         if ((P->url_request && P->url_request->regex) || P->parameters.http.checksum) {
                 if (processBody) {
-                        MD_T hash = {};
+                        Digest_T digest = NULL;
+                        if (P->parameters.http.checksum && ! (digest = Digest_new(P->parameters.http.hashtype)))
+                                THROW(ProtocolException, "HTTP checksum error: Unknown hash type");
                         volatile char *data = CALLOC(1, BUFSIZE);
-                        union ChecksumContext_T context = {};
                         TRY
                         {
                                 // Read data
-                                _checksumInit(P, &context);
-                                processBody(socket, P, &data, &contentLength, &context);
-                                _checksumFinish(P, &context, hash);
+                                if (! processBody(socket, P, &data, &contentLength, digest))
+                                        keepalive = false;
                                 // Perform tests
-                                _checksumVerify(P, hash);
+                                _checksumVerify(P, digest);
                                 _contentVerify(P, (char *)data);
                         }
                         FINALLY
                         {
                                 free((void *)data);
+                                if (digest)
+                                        Digest_free(&digest);
                         }
                         END_TRY;
                 } else {
                         THROW(ProtocolException, "HTTP error: uknown transfer encoding");
                 }
+        } else if (keepalive && ! (P->parameters.http.method == Http_Head || status / 100 == 1 || status == 204 || status == 304)) {
+                // Skip the body unless the response has none
+                keepalive = _skipBody(socket, P, processBody, contentLength);
         }
+        Socket_setKeepAlive(socket, keepalive);
 }
 
 
@@ -369,7 +371,7 @@ static void _sendRequest(Socket_T socket, Port_T P) {
         if (! _hasHeader(P->parameters.http.headers, "Accept-Encoding"))
                 StringBuffer_append(sb, "Accept-Encoding: identity\r\n"); // We want no compression
         if (! _hasHeader(P->parameters.http.headers, "Connection"))
-                StringBuffer_append(sb, "Connection: close\r\n");
+                StringBuffer_append(sb, "Connection: %s\r\n", P->parameters.http.keepalive ? "keep-alive" : "close");
         // Add headers if we have them
         if (P->parameters.http.headers) {
                 for (list_t p = P->parameters.http.headers->head; p; p = p->next) {
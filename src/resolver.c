@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#include "monit.h"
+#include "resolver.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * Implementation of the caching resolver. The entries are kept in a hash
+ * table protected by a mutex, the lookups return a private copy of the
+ * cached address list, so the entry can be refreshed while the copy is
+ * in use.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define RESOLVER_BUCKETS 127
+#define RESOLVER_STALE   3       // The number of TTL periods past the expiration, for which the stale entry is used while the refresh fails
+
+
+typedef struct ResolverKey_T {
+        char *hostname;
+        char *service;
+        int family;
+        int socktype;
+        int protocol;
+        int flags;
+} ResolverKey_T;
+
+
+typedef struct ResolverEntry_T {
+        ResolverKey_T key;
+        struct addrinfo *result;
+        int64_t expire;                          /**< The time when the entry expires [ms] */
+        int64_t used;                           /**< The time of the last lookup [ms] */
+        boolean_t refreshing;                 /**< true if the refresh thread is running */
+        struct ResolverEntry_T *next;
+} *ResolverEntry_T;
+
+
+static struct {
+        Mutex_T mutex;
+        ResolverEntry_T buckets[RESOLVER_BUCKETS];
+        Resolver_Statistics_T statistics;
+} _resolver = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned int _hash(ResolverKey_T *key) {
+        unsigned int h = 5381;
+        for (const char *p = key->hostname; *p; p++)
+                h = h * 33 + (unsigned char)*p;
+        if (key->service)
+                for (const char *p = key->service; *p; p++)
+                        h = h * 33 + (unsigned char)*p;
+        return (h ^ key->family ^ (key->socktype << 4) ^ (key->protocol << 8) ^ (key->flags << 12)) % RESOLVER_BUCKETS;
+}
+
+
+static boolean_t _equals(ResolverKey_T *a, ResolverKey_T *b) {
+        return IS(a->hostname, b->hostname) && ((! a->service && ! b->service) || (a->service && b->service && IS(a->service, b->service))) && a->family == b->family && a->socktype == b->socktype && a->protocol == b->protocol && a->flags == b->flags;
+}
+
+
+/**
+ * Copy the address list, each node is allocated with its socket address in one block
+ */
+static struct addrinfo *_copy(const struct addrinfo *result) {
+        struct addrinfo *copy = NULL, **last = &copy;
+        for (const struct addrinfo *r = result; r; r = r->ai_next) {
+                struct addrinfo *a = ALLOC(sizeof(struct addrinfo) + r->ai_addrlen);
+                *a = *r;
+                a->ai_addr = (struct sockaddr *)(a + 1);
+                memcpy(a->ai_addr, r->ai_addr, r->ai_addrlen);
+                a->ai_canonname = r->ai_canonname ? Str_dup(r->ai_canonname) : NULL;
+                a->ai_next = NULL;
+                *last = a;
+                last = &(a->ai_next);
+        }
+        return copy;
+}
+
+
+static ResolverEntry_T _find(ResolverKey_T *key) {
+        for (ResolverEntry_T e = _resolver.buckets[_hash(key)]; e; e = e->next)
+                if (_equals(&(e->key), key))
+                        return e;
+        return NULL;
+}
+
+
+static void _freeEntry(ResolverEntry_T *e) {
+        Resolver_freeaddrinfo((*e)->result);
+        FREE((*e)->key.hostname);
+        FREE((*e)->key.service);
+        FREE(*e);
+}
+
+
+/**
+ * Remove the entries which were not used for ten TTL periods (e.g. the host is not monitored after reload)
+ */
+static void _prune(int64_t now) {
+        int64_t unused = 10LL * Run.limits.dnsTTL;
+        for (int i = 0; i < RESOLVER_BUCKETS; i++) {
+                for (ResolverEntry_T *e = &_resolver.buckets[i]; *e;) {
+                        if (! (*e)->refreshing && now - (*e)->used > unused) {
+                                ResolverEntry_T next = (*e)->next;
+                                _freeEntry(e);
+                                *e = next;
+                                _resolver.statistics.entries--;
+                        } else {
+                                e = &((*e)->next);
+                        }
+                }
+        }
+}
+
+
+/**
+ * Store the resolved address list in the cache. Must be called with the mutex locked
+ */
+static void _store(ResolverKey_T *key, const struct addrinfo *result, int64_t now) {
+        ResolverEntry_T e = _find(key);
+        if (! e) {
+                _prune(now);
+                NEW(e);
+                e->key.hostname = Str_dup(key->hostname);
+                e->key.service = key->service ? Str_dup(key->service) : NULL;
+                e->key.family = key->family;
+                e->key.socktype = key->socktype;
+                e->key.protocol = key->protocol;
+                e->key.flags = key->flags;
+                e->used = now;
+                unsigned int h = _hash(key);
+                e->next = _resolver.buckets[h];
+                _resolver.buckets[h] = e;
+                _resolver.statistics.entries++;
+        }
+        Resolver_freeaddrinfo(e->result);
+        e->result = _copy(result);
+        e->expire = now + Run.limits.dnsTTL;
+}
+
+
+static int _lookup(ResolverKey_T *key, struct addrinfo **result) {
+        struct addrinfo hints = {
+                .ai_family = key->family,
+                .ai_socktype = key->socktype,
+                .ai_protocol = key->protocol,
+                .ai_flags = key->flags
+        };
+        return getaddrinfo(key->hostname, key->service, &hints, result);
+}
+
+
+/**
+ * Refresh the expired entry in the background. The entry is looked up again when the lookup completes, as it may be pruned meanwhile
+ */
+static void *_refresh(void *args) {
+        set_signal_block();
+        ResolverKey_T *key = args;
+        struct addrinfo *result;
+        int status = _lookup(key, &result);
+        int64_t now = Time_milli();
+        LOCK(_resolver.mutex)
+        {
+                ResolverEntry_T e = _find(key);
+                if (status == 0) {
+                        if (e)
+                                _store(key, result, now);
+                } else {
+                        _resolver.statistics.errors++;
+                        DEBUG("Cannot refresh the address of '%s' -- %s, the cached address is used\n", key->hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                }
+                if (e)
+                        e->refreshing = false;
+        }
+        END_LOCK;
+        if (status == 0)
+                freeaddrinfo(result);
+        FREE(key->hostname);
+        FREE(key->service);
+        FREE(key);
+        return NULL;
+}
+
+
+/**
+ * Start the refresh thread for the entry, on failure the entry is refreshed by the next lookup
+ */
+static void _startRefresh(ResolverKey_T *key) {
+        ResolverKey_T *copy;
+        NEW(copy);
+        *copy = *key;
+        copy->hostname = Str_dup(key->hostname);
+        copy->service = key->service ? Str_dup(key->service) : NULL;
+        TRY
+        {
+                Thread_T thread;
+                Thread_createDetached(&thread, _refresh, copy);
+        }
+        ELSE
+        {
+                LogError("Cannot refresh the address of '%s' -- %s\n", key->hostname, Exception_frame.message);
+                LOCK(_resolver.mutex)
+                {
+                        ResolverEntry_T e = _find(key);
+                        if (e)
+                                e->refreshing = false;
+                }
+                END_LOCK;
+                FREE(copy->hostname);
+                FREE(copy->service);
+                FREE(copy);
+        }
+        END_TRY;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int Resolver_getaddrinfo(const char *hostname, const char *service, const struct addrinfo *hints, struct addrinfo **result) {
+        ASSERT(hostname);
+        ASSERT(hints);
+        ASSERT(result);
+        ResolverKey_T key = {
+                .hostname = (char *)hostname,
+                .service = (char *)service,
+                .family = hints->ai_family,
+                .socktype = hints->ai_socktype,
+                .protocol = hints->ai_protocol,
+                .flags = hints->ai_flags
+        };
+        boolean_t refresh = false;
+        int64_t now = Time_milli();
+        *result = NULL;
+        if (Run.limits.dnsTTL) {
+                LOCK(_resolver.mutex)
+                {
+                        ResolverEntry_T e = _find(&key);
+                        if (e && now - e->expire < RESOLVER_STALE * (int64_t)Run.limits.dnsTTL) {
+                                e->used = now;
+                                *result = _copy(e->result);
+                                if (now < e->expire) {
+                                        _resolver.statistics.hits++;
+                                } else {
+                                        _resolver.statistics.stale++;
+                                        if (! e->refreshing)
+                                                refresh = e->refreshing = true;
+                                }
+                        } else {
+                                // If the entry wasn't refreshed long after it expired (e.g. the host was removed from DNS), resolve the host synchronously, so the failure is reported
+                                if (e)
+                                        e->used = now;
+                                _resolver.statistics.misses++;
+                        }
+                }
+                END_LOCK;
+                if (*result) {
+                        if (refresh)
+                                _startRefresh(&key);
+                        return 0;
+                }
+        }
+        struct addrinfo *r;
+        int status = _lookup(&key, &r);
+        if (status == 0) {
+                if (Run.limits.dnsTTL) {
+                        LOCK(_resolver.mutex)
+                        {
+                                _store(&key, r, Time_milli());
+                        }
+                        END_LOCK;
+                }
+                *result = _copy(r);
+                freeaddrinfo(r);
+        } else {
+                LOCK(_resolver.mutex)
+                {
+                        _resolver.statistics.errors++;
+                }
+                END_LOCK;
+        }
+        return status;
+}
+
+
+void Resolver_freeaddrinfo(struct addrinfo *result) {
+        while (result) {
+                struct addrinfo *next = result->ai_next;
+                FREE(result->ai_canonname);
+                FREE(result);
+                result = next;
+        }
+}
+
+
+void Resolver_statistics(Resolver_Statistics_T *statistics) {
+        ASSERT(statistics);
+        LOCK(_resolver.mutex)
+        {
+                *statistics = _resolver.statistics;
+        }
+        END_LOCK;
+}
+
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#ifndef MONIT_RESOLVER_H
+#define MONIT_RESOLVER_H
+
+#include "monit.h"
+
+
+/**
+ * Caching host name resolver for the connection tests. The getaddrinfo()
+ * results are cached by the host, service, address family, socket type,
+ * protocol and flags for Run.limits.dnsTTL milliseconds (0 disables the
+ * cache). An expired entry is still served while it is refreshed by a
+ * background thread, so a slow or failing resolver doesn't stall the
+ * tests. If the refresh fails, the stale addresses are kept for at most
+ * RESOLVER_STALE TTL periods past the expiration, then the host is resolved
+ * synchronously again, so the lookup failure is reported.
+ *
+ * @file
+ */
+
+
+/** The resolver cache counters */
+typedef struct Resolver_Statistics_T {
+        unsigned long long hits;         /**< Lookups served from the cache */
+        unsigned long long stale;  /**< Lookups served from an expired entry */
+        unsigned long long misses;  /**< Lookups which called getaddrinfo() */
+        unsigned long long errors;           /**< Failed lookups and refreshes */
+        int entries;                            /**< Number of cached entries */
+} Resolver_Statistics_T;
+
+
+/**
+ * Translate the host and service to the list of addresses, the arguments
+ * and the return value are the same as of getaddrinfo(3). The result must
+ * be released by Resolver_freeaddrinfo().
+ * @param hostname The host name or address
+ * @param service The service name or port number (optional)
+ * @param hints The address criteria
+ * @param result The address list
+ * @return 0 on success, otherwise the getaddrinfo() error code
+ */
+int Resolver_getaddrinfo(const char *hostname, const char *service, const struct addrinfo *hints, struct addrinfo **result);
+
+
+/**
+ * Release the address list returned by Resolver_getaddrinfo()
+ * @param result The address list
+ */
+void Resolver_freeaddrinfo(struct addrinfo *result);
+
+
+/**
+ * Get the resolver cache counters
+ * @param statistics The statistics object to fill
+ */
+void Resolver_statistics(Resolver_Statistics_T *statistics);
+
+
+#endif
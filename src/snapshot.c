@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#include "monit.h"
+#include "snapshot.h"
+
+// libmonit
+#include "util/StringBuffer.h"
+
+
+/**
+ * Implementation of the Snapshot. The entries are kept in an array keyed
+ * by the path relative to the tree root, with an open addressing index.
+ * Each walk marks the entries it has seen with its generation number, the
+ * entries which were not seen are removed when the walk completes. The
+ * directories being walked are kept open between the calls.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define CHANGES_SAMPLE 3
+
+
+typedef struct Entry_T {
+        char *path;                          /**< Path relative to the tree root */
+        ino_t inode;
+        off_t size;
+        time_t mtime;
+        mode_t mode;
+        unsigned int generation;              /**< The last walk which saw the entry */
+} Entry_T;
+
+
+typedef struct Frame_T {
+        DIR *dir;
+        int length;                             /**< The directory path length */
+} Frame_T;
+
+
+typedef struct Result_T {
+        int entries;
+        int changed;
+        unsigned long long size;
+        time_t oldest;
+        StringBuffer_T changes;
+} Result_T;
+
+
+#define T Snapshot_T
+struct T {
+        boolean_t initialized;             /**< true if the first walk has completed */
+        dev_t device;                                  /**< The tree root device */
+        unsigned int generation;                           /**< The walk number */
+        int count;                                       /**< Number of entries */
+        int capacity;
+        Entry_T *entries;
+        int size;                                  /**< Index size (power of 2) */
+        int *index;                 /**< Entry number + 1 by path hash, 0 = free */
+        struct {
+                int depth;
+                int capacity;
+                Frame_T *frames;
+        } stack;                             /**< The directories being walked */
+        Result_T walk;                                  /**< The walk in progress */
+        Result_T last;                              /**< The last completed walk */
+        char path[PATH_MAX];                       /**< The current entry path */
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned int _hash(const char *path) {
+        unsigned int hash = 5381;
+        for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+                hash = (hash << 5) + hash + *p;
+        return hash;
+}
+
+
+static void _indexAdd(T S, int entry) {
+        for (unsigned int i = _hash(S->entries[entry].path) & (S->size - 1); ; i = (i + 1) & (S->size - 1)) {
+                if (S->index[i] == 0) {
+                        S->index[i] = entry + 1;
+                        return;
+                }
+        }
+}
+
+
+static void _indexBuild(T S) {
+        while (S->size < 2 * (S->count + 1))
+                S->size = S->size ? S->size * 2 : 64;
+        RESIZE(S->index, S->size * sizeof(int));
+        memset(S->index, 0, S->size * sizeof(int));
+        for (int i = 0; i < S->count; i++)
+                _indexAdd(S, i);
+}
+
+
+static Entry_T *_indexGet(T S, const char *path) {
+        if (! S->size)
+                return NULL;
+        for (unsigned int i = _hash(path) & (S->size - 1); ; i = (i + 1) & (S->size - 1)) {
+                int slot = S->index[i];
+                if (slot == 0)
+                        return NULL;
+                if (IS(S->entries[slot - 1].path, path))
+                        return &S->entries[slot - 1];
+        }
+}
+
+
+static void _changed(T S, const char *what, const char *path) {
+        if (S->initialized) {
+                if (S->walk.changed++ < CHANGES_SAMPLE)
+                        StringBuffer_append(S->walk.changes, "%s%s %s", StringBuffer_length(S->walk.changes) ? ", " : "", what, path);
+                else if (S->walk.changed == CHANGES_SAMPLE + 1)
+                        StringBuffer_append(S->walk.changes, ", ...");
+        }
+}
+
+
+static void _update(T S, struct stat *sb) {
+        S->walk.entries++;
+        if (S_ISREG(sb->st_mode))
+                S->walk.size += sb->st_size;
+        if (! S_ISDIR(sb->st_mode) && (! S->walk.oldest || sb->st_mtime < S->walk.oldest))
+                S->walk.oldest = sb->st_mtime;
+        Entry_T *e = _indexGet(S, S->path);
+        if (e) {
+                if (e->inode != sb->st_ino || e->size != sb->st_size || e->mtime != sb->st_mtime || e->mode != sb->st_mode)
+                        _changed(S, "modified", e->path);
+        } else {
+                if (S->count == S->capacity) {
+                        S->capacity = S->capacity ? S->capacity * 2 : 64;
+                        RESIZE(S->entries, S->capacity * sizeof(Entry_T));
+                }
+                e = &S->entries[S->count++];
+                e->path = Str_dup(S->path);
+                if (2 * (S->count + 1) > S->size)
+                        _indexBuild(S);
+                else
+                        _indexAdd(S, S->count - 1);
+                _changed(S, "new", e->path);
+        }
+        e->inode = sb->st_ino;
+        e->size = sb->st_size;
+        e->mtime = sb->st_mtime;
+        e->mode = sb->st_mode;
+        e->generation = S->generation;
+}
+
+
+static void _push(T S, DIR *dir, int length) {
+        if (S->stack.depth == S->stack.capacity) {
+                S->stack.capacity = S->stack.capacity ? S->stack.capacity * 2 : 16;
+                RESIZE(S->stack.frames, S->stack.capacity * sizeof(Frame_T));
+        }
+        S->stack.frames[S->stack.depth++] = (Frame_T){.dir = dir, .length = length};
+}
+
+
+static void _start(T S, DIR *dir, dev_t device) {
+        S->device = device;
+        S->generation++;
+        S->walk.entries = S->walk.changed = 0;
+        S->walk.size = 0ULL;
+        S->walk.oldest = 0;
+        StringBuffer_clear(S->walk.changes);
+        _push(S, dir, 0);
+}
+
+
+static void _finish(T S) {
+        // Remove the entries which the walk didn't see
+        int count = 0;
+        for (int i = 0; i < S->count; i++) {
+                if (S->entries[i].generation != S->generation) {
+                        _changed(S, "removed", S->entries[i].path);
+                        FREE(S->entries[i].path);
+                } else {
+                        S->entries[count++] = S->entries[i];
+                }
+        }
+        if (count != S->count) {
+                S->count = count;
+                _indexBuild(S);
+        }
+        // Publish the results
+        StringBuffer_T changes = S->last.changes;
+        S->last = S->walk;
+        S->walk.changes = changes;
+        S->initialized = true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T Snapshot_new() {
+        T S;
+        NEW(S);
+        S->walk.changes = StringBuffer_create(64);
+        S->last.changes = StringBuffer_create(64);
+        return S;
+}
+
+
+void Snapshot_free(T *S) {
+        ASSERT(S && *S);
+        while ((*S)->stack.depth > 0)
+                closedir((*S)->stack.frames[--(*S)->stack.depth].dir);
+        for (int i = 0; i < (*S)->count; i++)
+                FREE((*S)->entries[i].path);
+        StringBuffer_free(&(*S)->walk.changes);
+        StringBuffer_free(&(*S)->last.changes);
+        FREE((*S)->stack.frames);
+        FREE((*S)->entries);
+        FREE((*S)->index);
+        FREE(*S);
+}
+
+
+Snapshot_Status Snapshot_walk(T S, const char *path, int budget) {
+        ASSERT(S);
+        ASSERT(path);
+        if (S->stack.depth == 0) {
+                int fd = open(path, O_RDONLY | O_DIRECTORY);
+                if (fd < 0)
+                        return Snapshot_Error;
+                struct stat sb;
+                DIR *dir = NULL;
+                if (fstat(fd, &sb) || ! (dir = fdopendir(fd))) {
+                        int _errno = errno;
+                        close(fd);
+                        errno = _errno;
+                        return Snapshot_Error;
+                }
+                _start(S, dir, sb.st_dev);
+        }
+        for (int visited = 0; S->stack.depth > 0; ) {
+                if (budget > 0 && visited >= budget)
+                        return Snapshot_Pending;
+                Frame_T *f = &S->stack.frames[S->stack.depth - 1];
+                struct dirent *de = readdir(f->dir);
+                if (! de) {
+                        closedir(f->dir);
+                        S->stack.depth--;
+                        continue;
+                }
+                if (IS(de->d_name, ".") || IS(de->d_name, ".."))
+                        continue;
+                int length = f->length + snprintf(S->path + f->length, sizeof(S->path) - f->length, "%s%s", f->length ? "/" : "", de->d_name);
+                if (length >= sizeof(S->path)) {
+                        DEBUG("Snapshot: path too long -- %s/%s\n", path, S->path);
+                        continue;
+                }
+                struct stat sb;
+                if (fstatat(dirfd(f->dir), de->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0)
+                        continue; // The entry was removed meanwhile
+                visited++;
+                _update(S, &sb);
+                if (S_ISDIR(sb.st_mode) && sb.st_dev == S->device) {
+                        DIR *dir = NULL;
+                        int fd = openat(dirfd(f->dir), de->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+                        if (fd >= 0 && (dir = fdopendir(fd)))
+                                _push(S, dir, length);
+                        else if (fd >= 0)
+                                close(fd);
+                        else
+                                DEBUG("Snapshot: cannot open directory %s/%s -- %s\n", path, S->path, STRERROR);
+                }
+        }
+        _finish(S);
+        return Snapshot_Done;
+}
+
+
+int Snapshot_getEntries(T S) {
+        ASSERT(S);
+        return S->last.entries;
+}
+
+
+unsigned long long Snapshot_getSize(T S) {
+        ASSERT(S);
+        return S->last.size;
+}
+
+
+time_t Snapshot_getOldest(T S) {
+        ASSERT(S);
+        return S->last.oldest;
+}
+
+
+int Snapshot_getChanged(T S) {
+        ASSERT(S);
+        return S->last.changed;
+}
+
+
+const char *Snapshot_getChanges(T S) {
+        ASSERT(S);
+        return StringBuffer_toString(S->last.changes);
+}
+
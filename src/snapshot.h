@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#ifndef MONIT_SNAPSHOT_H
+#define MONIT_SNAPSHOT_H
+
+
+/**
+ * A metadata <b>Snapshot</b> of a directory tree. The tree is walked
+ * recursively (without following symbolic links or crossing mountpoints)
+ * and the inode, size, modification time and mode of each entry is kept,
+ * so the next walk can report the entries which were added, removed or
+ * modified since. A walk can be split over several calls to bound the
+ * time spent in one call. The results are updated when a walk completes.
+ *
+ * @file
+ */
+
+
+typedef enum {
+        Snapshot_Pending = 0,                          /**< The walk is in progress */
+        Snapshot_Done,                                /**< The walk has completed */
+        Snapshot_Error             /**< The tree root cannot be read (errno is set) */
+} __attribute__((__packed__)) Snapshot_Status;
+
+
+#define T Snapshot_T
+typedef struct T *T;
+
+
+/**
+ * Create a new empty Snapshot
+ * @return A new Snapshot object
+ */
+T Snapshot_new(void);
+
+
+/**
+ * Destroy the Snapshot and set *S to NULL
+ * @param S A Snapshot object reference
+ */
+void Snapshot_free(T *S);
+
+
+/**
+ * Continue the walk of the directory tree or start a new one if the
+ * previous walk has completed
+ * @param S A Snapshot object
+ * @param path The tree root directory
+ * @param budget The maximum number of entries to visit in this call, 0 = no limit
+ * @return The walk status
+ */
+Snapshot_Status Snapshot_walk(T S, const char *path, int budget);
+
+
+/**
+ * @param S A Snapshot object
+ * @return The number of entries in the tree (excluding the root)
+ */
+int Snapshot_getEntries(T S);
+
+
+/**
+ * @param S A Snapshot object
+ * @return The total size of the regular files in the tree [B]
+ */
+unsigned long long Snapshot_getSize(T S);
+
+
+/**
+ * @param S A Snapshot object
+ * @return The modification time of the oldest entry which is not a
+ * directory or 0 if there is no such entry
+ */
+time_t Snapshot_getOldest(T S);
+
+
+/**
+ * @param S A Snapshot object
+ * @return The number of entries which were added, removed or modified
+ * between the last two walks (0 after the first walk)
+ */
+int Snapshot_getChanged(T S);
+
+
+/**
+ * @param S A Snapshot object
+ * @return A description of the first few changed entries of the last
+ * walk (e.g. "new spool/a, removed spool/b")
+ */
+const char *Snapshot_getChanges(T S);
+
+
+#undef T
+#endif
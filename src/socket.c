@@ -76,6 +76,8 @@
 #include "monit.h"
 #include "socket.h"
 #include "SslServer.h"
+#include "resolver.h"
+#include "util.h"
 
 // libmonit
 #include "exceptions/assert.h"
@@ -116,6 +118,7 @@ struct T {
         int timeout; // milliseconds
         int length;
         int offset;
+        boolean_t keepalive;
         char *host;
         Port_T Port;
 #ifdef HAVE_OPENSSL
@@ -225,53 +228,62 @@ static boolean_t _doConnect(int s, const struct sockaddr *addr, socklen_t addrle
 }
 
 
+/* Create the Socket object for the connected IP socket s. If SSL is enabled, the SSL handshake is performed */
+static T _newIpSocket(int s, const char *host, const struct sockaddr *addr, int family, int type, SslOptions_T options, int timeout) {
+        T S;
+        NEW(S);
+        S->socket = s;
+        S->type = type;
+        S->family = family == AF_INET ? Socket_Ip4 : Socket_Ip6;
+        S->timeout = timeout;
+        S->host = Str_dup(host);
+        S->port = _getPort(addr);
+        S->connection_type = Connection_Client;
+        if (options->flags == SSL_Enabled) {
+                TRY
+                {
+                        Socket_enableSsl(S, options, host);
+                }
+                ELSE
+                {
+                        Socket_free(&S);
+                        RETHROW;
+                }
+                END_TRY;
+        }
+        return S;
+}
+
+
+/* Create the non-blocking socket for the connection to addr, bound to the outgoing address if set. Returns the socket or -1 on error */
+static int _newIpDescriptor(const struct sockaddr *addr, socklen_t addrlen, const struct sockaddr *localaddr, socklen_t localaddrlen, int family, int type, int protocol, char *error, int errorlen) {
+        int s = socket(family, type, protocol);
+        if (s < 0) {
+                snprintf(error, errorlen, "Cannot create socket to %s -- %s", _addressToString(addr, addrlen, (char[STRLEN]){}, STRLEN), STRERROR);
+                return -1;
+        }
+        if (localaddr && bind(s, localaddr, localaddrlen) < 0) {
+                snprintf(error, errorlen, "Cannot bind to outgoing address -- %s", STRERROR);
+        } else if (! Net_setNonBlocking(s)) {
+                snprintf(error, errorlen, "Cannot set nonblocking socket -- %s", STRERROR);
+        } else if (fcntl(s, F_SETFD, FD_CLOEXEC) == -1) {
+                snprintf(error, errorlen, "Cannot set socket close on exec -- %s", STRERROR);
+        } else {
+                return s;
+        }
+        Net_close(s);
+        return -1;
+}
+
+
 T _createIpSocket(const char *host, const struct sockaddr *addr, socklen_t addrlen, const struct sockaddr *localaddr, socklen_t localaddrlen, int family, int type, int protocol, SslOptions_T options, int timeout) {
         ASSERT(host);
         char error[STRLEN];
-        int s = socket(family, type, protocol);
+        int s = _newIpDescriptor(addr, addrlen, localaddr, localaddrlen, family, type, protocol, error, sizeof(error));
         if (s >= 0) {
-                if (localaddr) {
-                        if (bind(s, localaddr, localaddrlen) < 0) {
-                                snprintf(error, sizeof(error), "Cannot bind to outgoing address -- %s", STRERROR);
-                                goto error;
-                        }
-                }
-                if (Net_setNonBlocking(s)) {
-                        if (fcntl(s, F_SETFD, FD_CLOEXEC) != -1) {
-                                if (_doConnect(s, addr, addrlen, timeout, error, sizeof(error))) {
-                                        T S;
-                                        NEW(S);
-                                        S->socket = s;
-                                        S->type = type;
-                                        S->family = family == AF_INET ? Socket_Ip4 : Socket_Ip6;
-                                        S->timeout = timeout;
-                                        S->host = Str_dup(host);
-                                        S->port = _getPort(addr);
-                                        S->connection_type = Connection_Client;
-                                        if (options->flags == SSL_Enabled) {
-                                                TRY
-                                                {
-                                                        Socket_enableSsl(S, options, host);
-                                                }
-                                                ELSE
-                                                {
-                                                        Socket_free(&S);
-                                                        RETHROW;
-                                                }
-                                                END_TRY;
-                                        }
-                                        return S;
-                                }
-                        } else {
-                                snprintf(error, sizeof(error), "Cannot set socket close on exec -- %s", STRERROR);
-                        }
-                } else {
-                        snprintf(error, sizeof(error), "Cannot set nonblocking socket -- %s", STRERROR);
-                }
-error:
+                if (_doConnect(s, addr, addrlen, timeout, error, sizeof(error)))
+                        return _newIpSocket(s, host, addr, family, type, options, timeout);
                 Net_close(s);
-        } else {
-                snprintf(error, sizeof(error), "Cannot create socket to %s -- %s", _addressToString(addr, addrlen, (char[STRLEN]){}, STRLEN), STRERROR);
         }
         THROW(IOException, "%s", error);
         return NULL;
@@ -305,7 +317,7 @@ struct addrinfo *_resolve(const char *hostname, int port, Socket_Type type, Sock
         }
         char _port[6];
         snprintf(_port, sizeof(_port), "%d", port);
-        int status = getaddrinfo(hostname, _port, &hints, &result);
+        int status = Resolver_getaddrinfo(hostname, _port, &hints, &result);
         if (status != 0) {
                 LogError("Cannot translate '%s' to IP address -- %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return NULL;
@@ -342,7 +354,7 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
                         }
                         END_TRY;
                 }
-                freeaddrinfo(result);
+                Resolver_freeaddrinfo(result);
                 if (! S)
                         LogError("Cannot create socket to [%s]:%d -- %s\n", host, port, error);
         }
@@ -487,6 +499,12 @@ int Socket_getTimeout(T S) {
 }
 
 
+void Socket_setKeepAlive(T S, boolean_t keepalive) {
+        ASSERT(S);
+        S->keepalive = keepalive;
+}
+
+
 boolean_t Socket_isSecure(T S) {
         ASSERT(S);
 #ifdef HAVE_OPENSSL
@@ -555,17 +573,95 @@ const char *Socket_getLocalHost(T S, char *host, int hostlen) {
 }
 
 
+/* Keep the connection in the port for the next test if the test succeeded and the protocol left the connection reusable, otherwise close it */
+static void _release(Port_T p, T *S, boolean_t succeeded) {
+        if (succeeded && (*S)->keepalive) {
+                (*S)->keepalive = false;
+                p->pooled = *S;
+                *S = NULL;
+        } else {
+                Socket_free(S);
+        }
+}
+
+
+/* Returns true if the idle connection was closed by the server or if it has some unexpected data pending */
+static boolean_t _isClosed(T S) {
+        if (S->offset < S->length)
+                return true;
+        char c;
+        ssize_t n;
+        do {
+                n = recv(S->socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        } while (n == -1 && errno == EINTR);
+        if (n == 0)
+                return true;
+        if (n < 0)
+                return errno != EAGAIN && errno != EWOULDBLOCK;
+#ifdef HAVE_OPENSSL
+        if (S->ssl)
+                return false; // The SSL layer may have pending records, such as the TLSv1.3 session ticket
+#endif
+        return true;
+}
+
+
+/* Run the protocol test over the connection kept open by the previous test. Returns false if there is no such connection or if it failed
+ on the connection level (e.g. the server closed the idle connection meanwhile), the caller then reconnects. The protocol errors are thrown */
+static boolean_t _testPooled(Port_T p) {
+        if (! p->pooled)
+                return false;
+        volatile T S = p->pooled;
+        volatile boolean_t rv = false;
+        p->pooled = NULL;
+        if (_isClosed(S)) {
+                DEBUG("Keep-alive connection to %s was closed -- reconnecting\n", Util_portDescription(p, (char[STRLEN]){}, STRLEN));
+                Socket_free((T *)&S);
+                return false;
+        }
+        int64_t started = Time_micro();
+        TRY
+        {
+#ifdef HAVE_OPENSSL
+                // The certificate ages while the server keeps the connection open => refresh the validDays as the fresh connection does in
+                // _testAddress(). The connection is established already, so it is refreshed before the test (can be collected even if the test fails)
+                p->target.net.ssl.certificate.validDays = Ssl_getCertificateValidDays(S->ssl);
+#endif
+                p->protocol->check(S);
+                rv = true;
+        }
+        CATCH(IOException)
+        {
+                DEBUG("Keep-alive connection to %s failed -- %s -- reconnecting\n", Util_portDescription(p, (char[STRLEN]){}, STRLEN), Exception_frame.message);
+        }
+        FINALLY
+        {
+                p->timing.connect = 0.;
+                p->timing.request = (double)(Time_micro() - started) / 1000.;
+                _release(p, (T *)&S, rv);
+        }
+        END_TRY;
+        return rv;
+}
+
+
 static void _testUnix(Port_T p) {
+        int64_t started = Time_micro();
         T S = Socket_createUnix(p->target.unix.pathname, p->type, p->timeout);
         if (S) {
+                volatile boolean_t succeeded = false;
                 S->Port = p;
+                p->timing.connect = (double)(Time_micro() - started) / 1000.;
+                started = Time_micro();
                 TRY
                 {
                         p->protocol->check(S);
+                        succeeded = true;
                 }
                 FINALLY
                 {
-                        Socket_free(&S);
+                        p->timing.request = (double)(Time_micro() - started) / 1000.;
+                        _release(p, &S, succeeded);
                 }
                 END_TRY;
         } else {
@@ -574,58 +670,141 @@ static void _testUnix(Port_T p) {
 }
 
 
-static void _testIp(Port_T p) {
-        char error[512];
-        volatile Connection_State is_available = Connection_Failed;
-        struct addrinfo *result = _resolve(p->hostname, p->target.net.port, p->type, p->family);
-        if (result) {
-                // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
-                for (struct addrinfo *r = result; r && is_available != Connection_Ok; r = r->ai_next) {
-                        if (p->outgoing.addrlen == 0 || p->outgoing.addrlen == r->ai_addrlen) {
-                                const struct sockaddr *localaddr = p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL;
-                                volatile T S = NULL;
-                                TRY
-                                {
-                                        S = _createIpSocket(p->hostname, r->ai_addr, r->ai_addrlen, localaddr, p->outgoing.addrlen, r->ai_family, r->ai_socktype, r->ai_protocol, &(p->target.net.ssl.options), p->timeout);
-                                        S->Port = p;
-                                        TRY
-                                        {
-                                                p->protocol->check(S);
-                                        }
-                                        FINALLY
-                                        {
+/* Run the protocol test at the address r. If s is a valid descriptor, it is the socket already connected to r by Socket_connectAll(), otherwise
+ the connection is created. Returns true if the test succeeded, otherwise the error is set */
+static boolean_t _testAddress(Port_T p, struct addrinfo *r, int s, char *error, int errorlen) {
+        volatile boolean_t rv = false;
+        volatile T S = NULL;
+        TRY
+        {
+                int64_t started = Time_micro();
+                if (s >= 0)
+                        S = _newIpSocket(s, p->hostname, r->ai_addr, r->ai_family, r->ai_socktype, &(p->target.net.ssl.options), p->timeout);
+                else
+                        S = _createIpSocket(p->hostname, r->ai_addr, r->ai_addrlen, p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL, p->outgoing.addrlen, r->ai_family, r->ai_socktype, r->ai_protocol, &(p->target.net.ssl.options), p->timeout);
+                S->Port = p;
+                // The connect time includes the connect started by Socket_connectAll() and the SSL handshake
+                p->timing.connect = (s >= 0 ? p->preconnect.response : 0.) + (double)(Time_micro() - started) / 1000.;
+                started = Time_micro();
+                TRY
+                {
+                        p->protocol->check(S);
+                }
+                FINALLY
+                {
+                        p->timing.request = (double)(Time_micro() - started) / 1000.;
 #ifdef HAVE_OPENSSL
-                                                // Set the minimum valid days past the protocol check as if the connection uses STARTTLS to switch plain->SSL, we have no SSL certificate informations until the STARTTTLS is performed.
-                                                // Try to collect the certificate validDays even on protocol exception - the protocol test may fail on higher level (e.g. when HTTP returns 400), but we can still get certificate info
-                                                p->target.net.ssl.certificate.validDays = Ssl_getCertificateValidDays(S->ssl);
+                        // Set the minimum valid days past the protocol check as if the connection uses STARTTLS to switch plain->SSL, we have no SSL certificate informations until the STARTTTLS is performed.
+                        // Try to collect the certificate validDays even on protocol exception - the protocol test may fail on higher level (e.g. when HTTP returns 400), but we can still get certificate info
+                        p->target.net.ssl.certificate.validDays = Ssl_getCertificateValidDays(S->ssl);
 #endif
-                                        }
-                                        END_TRY;
-                                        is_available = Connection_Ok;
+                }
+                END_TRY;
+                rv = true;
+        }
+        ELSE
+        {
+                snprintf(error, errorlen, "%s", Exception_frame.message);
+                DEBUG("Socket test failed for %s -- %s\n", _addressToString(r->ai_addr, r->ai_addrlen, (char[STRLEN]){}, STRLEN), error);
+        }
+        FINALLY
+        {
+                if (S) {
+                        _release(p, (T *)&S, rv);
+                }
+        }
+        END_TRY;
+        return rv;
+}
 
-                                }
-                                ELSE
-                                {
-                                        snprintf(error, sizeof(error), "%s", Exception_frame.message);
-                                        DEBUG("Socket test failed for %s -- %s\n", _addressToString(r->ai_addr, r->ai_addrlen, (char[STRLEN]){}, STRLEN), error);
-                                }
-                                FINALLY
-                                {
-                                        if (S) {
-                                                Socket_free((Socket_T *)&S);
-                                        }
-                                }
-                                END_TRY;
+
+/* Test if the socket connected by Socket_connectAll() can be used. The protocol tests of the other ports run meanwhile and the server may drop
+ the idle connection (e.g. MySQL after connect_timeout) => the socket which waited longer than the port timeout or which the server closed is
+ not used, the address is connected again */
+static boolean_t _preconnectUsable(Port_T p) {
+        if (Time_micro() - p->preconnect.connected > (int64_t)p->timeout * 1000LL) {
+                DEBUG("Connection to %s waited too long for the test -- reconnecting\n", Util_portDescription(p, (char[STRLEN]){}, STRLEN));
+                return false;
+        }
+        char c;
+        ssize_t n;
+        do {
+                n = recv(p->preconnect.socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        } while (n == -1 && errno == EINTR);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                DEBUG("Connection to %s was closed before the test -- reconnecting\n", Util_portDescription(p, (char[STRLEN]){}, STRLEN));
+                return false;
+        }
+        return true;
+}
+
+
+static void _testIp(Port_T p) {
+        char error[512] = {};
+        boolean_t is_available = false;
+        struct addrinfo *result, *r;
+        if (p->preconnect.started) {
+                // The host was resolved and the first address connected by Socket_connectAll() => test it and continue with the next address if it failed
+                result = p->preconnect.result;
+                r = p->preconnect.address;
+                if (p->preconnect.socket >= 0) {
+                        if (_preconnectUsable(p)) {
+                                is_available = _testAddress(p, r, p->preconnect.socket, error, sizeof(error));
                         } else {
-                                snprintf(error, sizeof(error), "No IP address matching '%s' was found", p->outgoing.ip);
+                                // The connect succeeded, so it doesn't count in the response time, the test connects again
+                                Net_close(p->preconnect.socket);
+                                p->preconnect.response = 0.;
+                                is_available = _testAddress(p, r, -1, error, sizeof(error));
                         }
+                } else {
+                        snprintf(error, sizeof(error), "%s", p->preconnect.error == ETIMEDOUT ? "Connection timed out" : strerror(p->preconnect.error));
+                        DEBUG("Socket test failed for %s -- %s\n", _addressToString(r->ai_addr, r->ai_addrlen, (char[STRLEN]){}, STRLEN), error);
                 }
-                freeaddrinfo(result);
-                if (is_available != Connection_Ok)
-                        THROW(IOException, "%s", error);
-        } else {
+                r = r->ai_next;
+                p->preconnect.started = false;
+                p->preconnect.socket = -1;
+                p->preconnect.result = p->preconnect.address = NULL;
+        } else if (! (result = r = _resolve(p->hostname, p->target.net.port, p->type, p->family))) {
                 THROW(IOException, "Cannot resolve [%s]:%d", p->hostname, p->target.net.port);
         }
+        // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
+        for (; r && ! is_available; r = r->ai_next) {
+                if (p->outgoing.addrlen == 0 || p->outgoing.addrlen == r->ai_addrlen)
+                        is_available = _testAddress(p, r, -1, error, sizeof(error));
+                else
+                        snprintf(error, sizeof(error), "No IP address matching '%s' was found", p->outgoing.ip);
+        }
+        Resolver_freeaddrinfo(result);
+        if (! is_available)
+                THROW(IOException, "%s", error);
+}
+
+
+/* Release the resources of the connect started by Socket_connectAll() which was not used by the test */
+static void _preconnectReset(Port_T p) {
+        if (p->preconnect.started && p->preconnect.socket >= 0)
+                Net_close(p->preconnect.socket);
+        if (p->preconnect.result)
+                Resolver_freeaddrinfo(p->preconnect.result);
+        p->preconnect.started = false;
+        p->preconnect.socket = -1;
+        p->preconnect.error = 0;
+        p->preconnect.response = 0.;
+        p->preconnect.connected = 0;
+        p->preconnect.result = p->preconnect.address = NULL;
+}
+
+
+/* Complete the pending connect of the port */
+static void _preconnectDone(Port_T p, int s, int error, int64_t started) {
+        p->preconnect.connected = Time_micro();
+        p->preconnect.response = (double)(p->preconnect.connected - started) / 1000.;
+        if (error) {
+                p->preconnect.error = error;
+                Net_close(s);
+        } else {
+                p->preconnect.socket = s;
+        }
 }
 
 
@@ -638,20 +817,24 @@ void Socket_test(void *P) {
         TRY
         {
                 int64_t start = Time_micro();
-                switch (p->family) {
-                        case Socket_Unix:
-                                _testUnix(p);
-                                break;
-                        case Socket_Ip:
-                        case Socket_Ip4:
-                        case Socket_Ip6:
-                                _testIp(p);
-                                break;
-                        default:
-                                THROW(IOException, "Invalid socket family %d\n", p->family);
-                                break;
+                boolean_t preconnected = p->preconnect.started;
+                if (! _testPooled(p)) {
+                        switch (p->family) {
+                                case Socket_Unix:
+                                        _testUnix(p);
+                                        break;
+                                case Socket_Ip:
+                                case Socket_Ip4:
+                                case Socket_Ip6:
+                                        _testIp(p);
+                                        break;
+                                default:
+                                        THROW(IOException, "Invalid socket family %d\n", p->family);
+                                        break;
+                        }
                 }
-                p->response = (double)(Time_micro() - start) / 1000.; // Convert microseconds to milliseconds
+                // If the port was connected by Socket_connectAll(), the response time includes the connect time (zero if the test connected again)
+                p->response = (preconnected ? p->preconnect.response : 0.) + (double)(Time_micro() - start) / 1000.; // Convert microseconds to milliseconds
                 p->is_available = Connection_Ok;
         }
         ELSE
@@ -664,6 +847,94 @@ void Socket_test(void *P) {
 }
 
 
+void Socket_connectAll(void *P[], int count) {
+        ASSERT(P);
+        int pending = 0;
+        struct pollfd *fds = CALLOC(count, sizeof(struct pollfd));
+        int64_t *started = CALLOC(count, sizeof(int64_t));
+        for (int i = 0; i < count; i++) {
+                Port_T p = P[i];
+                fds[i].fd = -1;
+                _preconnectReset(p);
+                // The port with the connection kept open from the previous test doesn't need to connect
+                if (p->family == Socket_Unix || p->pooled)
+                        continue;
+                // If the host cannot be resolved or the socket cannot be created, the port is left for Socket_test() which reports the error
+                struct addrinfo *result = _resolve(p->hostname, p->target.net.port, p->type, p->family);
+                if (! result)
+                        continue;
+                struct addrinfo *r = result;
+                while (r && p->outgoing.addrlen && p->outgoing.addrlen != r->ai_addrlen)
+                        r = r->ai_next;
+                char error[STRLEN];
+                int s = r ? _newIpDescriptor(r->ai_addr, r->ai_addrlen, p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL, p->outgoing.addrlen, r->ai_family, r->ai_socktype, r->ai_protocol, error, sizeof(error)) : -1;
+                if (s < 0) {
+                        Resolver_freeaddrinfo(result);
+                        continue;
+                }
+                p->preconnect.started = true;
+                p->preconnect.result = result;
+                p->preconnect.address = r;
+                started[i] = Time_micro();
+                if (connect(s, r->ai_addr, r->ai_addrlen) == 0) {
+                        _preconnectDone(p, s, 0, started[i]);
+                } else if (errno == EINPROGRESS) {
+                        fds[i].fd = s;
+                        fds[i].events = POLLOUT;
+                        pending++;
+                } else {
+                        _preconnectDone(p, s, errno, started[i]);
+                }
+        }
+        while (pending > 0) {
+                // Expire the connects which reached their timeout and wait up to the nearest deadline of the rest
+                int64_t now = Time_micro();
+                int64_t next = 0;
+                for (int i = 0; i < count; i++) {
+                        if (fds[i].fd >= 0) {
+                                int64_t deadline = started[i] + (int64_t)((Port_T)P[i])->timeout * 1000LL;
+                                if (deadline <= now) {
+                                        _preconnectDone(P[i], fds[i].fd, ETIMEDOUT, started[i]);
+                                        fds[i].fd = -1;
+                                        pending--;
+                                } else if (! next || deadline < next) {
+                                        next = deadline;
+                                }
+                        }
+                }
+                if (! pending)
+                        break;
+                int rv = poll(fds, count, (int)((next - now + 999) / 1000));
+                if (rv == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        int error = errno;
+                        for (int i = 0; i < count; i++) {
+                                if (fds[i].fd >= 0) {
+                                        _preconnectDone(P[i], fds[i].fd, error, started[i]);
+                                        fds[i].fd = -1;
+                                }
+                        }
+                        break;
+                }
+                for (int i = 0; i < count && rv > 0; i++) {
+                        if (fds[i].fd >= 0 && fds[i].revents) {
+                                int error = 0;
+                                socklen_t errorlen = sizeof(error);
+                                if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &errorlen) < 0)
+                                        error = errno;
+                                _preconnectDone(P[i], fds[i].fd, error, started[i]);
+                                fds[i].fd = -1;
+                                pending--;
+                                rv--;
+                        }
+                }
+        }
+        FREE(started);
+        FREE(fds);
+}
+
+
 void Socket_enableSsl(T S, SslOptions_T options, const char *name)  {
         assert(S);
 #ifdef HAVE_OPENSSL
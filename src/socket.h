@@ -144,6 +144,16 @@ int Socket_getTimeout(T S);
 boolean_t Socket_isSecure(T S);
 
 
+/**
+ * Mark the connection as reusable. The protocol test sets it if the whole
+ * response was read and the server keeps the connection open, the port
+ * test with keep-alive enabled then keeps the connection for the next test.
+ * @param S A Socket_T object
+ * @param keepalive true if the connection can be reused
+ */
+void Socket_setKeepAlive(T S, boolean_t keepalive);
+
+
 /**
  * Get the underlying socket descriptor
  * @param S A Socket_T object
@@ -212,6 +222,20 @@ const char *Socket_getLocalHost(T S, char *host, int hostlen);
 void Socket_test(void *P);
 
 
+/**
+ * Connect the given IP ports at once. The hosts are resolved and the
+ * non-blocking connects to the first address of each port are started
+ * together and waited for with one poll() loop, each with the port's
+ * own timeout. The following Socket_test() of the port then runs the
+ * protocol test on the connected socket, or continues with the next
+ * host address if the connect failed. The unix socket ports are skipped
+ * (the local connect doesn't wait).
+ * @param P An array of Port_T objects
+ * @param count The number of ports in the array
+ */
+void Socket_connectAll(void *P[], int count);
+
+
 /**
  * Enables SSL on a connected socket.
  * @param S A connected Socket_T object
@@ -129,6 +129,7 @@ struct T {
         SSL *handler;
         SSL_CTX *ctx;
         X509 *certificate;
+        char *session;                                       // Client session cache key
         char error[128];
 };
 
@@ -148,6 +149,31 @@ static Mutex_T *instanceMutexTable;
 static int session_id_context = 1;
 
 
+/*
+ * The client contexts are cached per effective SSL options, so the CA certificates, client certificate and ciphers are loaded only once.
+ * The client sessions are cached per target and verification options for resumption, so repeated connections use abbreviated handshake.
+ */
+typedef struct SslContext_T {
+        char *key;
+        SSL_CTX *ctx;
+        struct SslContext_T *next;
+} *SslContext_T;
+
+
+typedef struct SslSession_T {
+        char *key;
+        SSL_SESSION *session;
+        struct SslSession_T *next;
+} *SslSession_T;
+
+
+static struct {
+        Mutex_T mutex;
+        SslContext_T contexts;
+        SslSession_T sessions;
+} _cache = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -334,6 +360,9 @@ static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
                         case Hash_Sha1:
                                 hash = EVP_sha1();
                                 break;
+                        case Hash_Sha256:
+                                hash = EVP_sha256();
+                                break;
                         default:
                                 X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                 snprintf(C->error, sizeof(C->error), "Invalid SSL certificate checksum type (0x%x)", checksumType);
@@ -454,16 +483,16 @@ static boolean_t _setServerNameIdentification(T C, const char *hostname) {
 }
 
 
-static boolean_t _setClientCertificate(T C, const char *file) {
-        if (SSL_CTX_use_certificate_chain_file(C->ctx, file) != 1) {
+static boolean_t _setClientCertificate(SSL_CTX *ctx, const char *file) {
+        if (SSL_CTX_use_certificate_chain_file(ctx, file) != 1) {
                 LogError("SSL client certificate chain loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_use_PrivateKey_file(C->ctx, file, SSL_FILETYPE_PEM) != 1) {
+        if (SSL_CTX_use_PrivateKey_file(ctx, file, SSL_FILETYPE_PEM) != 1) {
                 LogError("SSL client private key loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_check_private_key(C->ctx) != 1) {
+        if (SSL_CTX_check_private_key(ctx) != 1) {
                 LogError("SSL client private key doesn't match the certificate: %s\n", SSLERROR);
                 return false;
         }
@@ -471,6 +500,208 @@ static boolean_t _setClientCertificate(T C, const char *file) {
 }
 
 
+/**
+ * Store the new client session in the cache. Called by OpenSSL when the session is established (with TLSv1.3 when the session ticket
+ * is received). The cache takes the session reference
+ */
+static int _newSession(SSL *handler, SSL_SESSION *session) {
+        T C = SSL_get_app_data(handler);
+        if (! C || ! C->session)
+                return 0;
+        LOCK(_cache.mutex)
+        {
+                SslSession_T s = _cache.sessions;
+                while (s && ! IS(s->key, C->session))
+                        s = s->next;
+                if (s) {
+                        SSL_SESSION_free(s->session);
+                } else {
+                        NEW(s);
+                        s->key = Str_dup(C->session);
+                        s->next = _cache.sessions;
+                        _cache.sessions = s;
+                }
+                s->session = session;
+        }
+        END_LOCK;
+        return 1;
+}
+
+
+/**
+ * Drop the cached session of the connection, e.g. if the handshake failed
+ */
+static void _removeSession(T C) {
+        if (C->session) {
+                LOCK(_cache.mutex)
+                {
+                        for (SslSession_T *s = &_cache.sessions; *s; s = &((*s)->next)) {
+                                if (IS((*s)->key, C->session)) {
+                                        SslSession_T next = (*s)->next;
+                                        SSL_SESSION_free((*s)->session);
+                                        FREE((*s)->key);
+                                        FREE(*s);
+                                        *s = next;
+                                        break;
+                                }
+                        }
+                }
+                END_LOCK;
+        }
+}
+
+
+/**
+ * Test if the server certificate of the session expired. The certificate is not verified when the session is resumed, so the session
+ * established before the certificate expired would pass the verification until the session lifetime ends
+ */
+static boolean_t _sessionExpired(SSL_SESSION *session) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) && ! defined(LIBRESSL_VERSION_NUMBER)
+        X509 *certificate = session->peer;
+        return certificate && X509_cmp_current_time(X509_get_notAfter(certificate)) < 0;
+#elif defined(LIBRESSL_VERSION_NUMBER)
+        X509 *certificate = SSL_SESSION_get0_peer(session);
+        return certificate && X509_cmp_current_time(X509_get_notAfter(certificate)) < 0;
+#else
+        X509 *certificate = SSL_SESSION_get0_peer(session);
+        return certificate && X509_cmp_current_time(X509_get0_notAfter(certificate)) < 0;
+#endif
+}
+
+
+/**
+ * Resume the cached session of the target if available. The session key contains the target address and the certificate verification
+ * options, as no certificate is verified when the session is resumed. If the certificate verification is enabled and the certificate of
+ * the cached session expired, the session is dropped, so the full handshake verifies the current certificate
+ */
+static void _setSession(T C, const char *name) {
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        if (getpeername(C->socket, (struct sockaddr *)&addr, &addrlen) != 0)
+                return;
+        char host[INET6_ADDRSTRLEN] = {};
+        int port = 0;
+        switch (addr.ss_family) {
+                case AF_INET:
+                        inet_ntop(AF_INET, &(((struct sockaddr_in *)&addr)->sin_addr), host, sizeof(host));
+                        port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+                        break;
+#ifdef HAVE_IPV6
+                case AF_INET6:
+                        inet_ntop(AF_INET6, &(((struct sockaddr_in6 *)&addr)->sin6_addr), host, sizeof(host));
+                        port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+                        break;
+#endif
+                default:
+                        return;
+        }
+        C->session = Str_cat("%p [%s]:%d %s %d %d %d %s", (void *)C->ctx, host, port, NVLSTR(name), _optionsVerify(C->options->verify), _optionsAllowSelfSigned(C->options->allowSelfSigned), _optionsChecksumType(C->options->checksumType), NVLSTR(_optionsChecksum(C->options->checksum)));
+        LOCK(_cache.mutex)
+        {
+                for (SslSession_T *s = &_cache.sessions; *s; s = &((*s)->next)) {
+                        if (IS((*s)->key, C->session)) {
+                                if (_optionsVerify(C->options->verify) && _sessionExpired((*s)->session)) {
+                                        DEBUG("SSL: the server certificate of the cached session expired -- full handshake\n");
+                                        SslSession_T next = (*s)->next;
+                                        SSL_SESSION_free((*s)->session);
+                                        FREE((*s)->key);
+                                        FREE(*s);
+                                        *s = next;
+                                        break;
+                                }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && ! defined(LIBRESSL_VERSION_NUMBER)
+                                if (SSL_SESSION_is_resumable((*s)->session))
+#endif
+                                        SSL_set_session(C->handler, (*s)->session);
+                                break;
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+static SSL_CTX *_newContext(SslOptions_T options) {
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+        const SSL_METHOD *method = SSLv23_client_method();
+#else
+        const SSL_METHOD *method = TLS_client_method();
+#endif
+        if (! method) {
+                LogError("SSL: client method initialization failed -- %s\n", SSLERROR);
+                return NULL;
+        }
+        SSL_CTX *ctx = SSL_CTX_new(method);
+        if (! ctx) {
+                LogError("SSL: client context initialization failed -- %s\n", SSLERROR);
+                return NULL;
+        }
+        if (! _setVersion(ctx, options)) {
+                goto sslerror;
+        }
+        SSL_CTX_set_default_verify_paths(ctx);
+        const char *CACertificateFile = _optionsCACertificateFile(options->CACertificateFile);
+        const char *CACertificatePath = _optionsCACertificatePath(options->CACertificatePath);
+        if (CACertificateFile || CACertificatePath) {
+                if (! SSL_CTX_load_verify_locations(ctx, CACertificateFile, CACertificatePath)) {
+                        LogError("SSL: CA certificates loading failed -- %s\n", SSLERROR);
+                        goto sslerror;
+                }
+        }
+        const char *ClientPEMFile = _optionsClientPEMFile(options->clientpemfile);
+        if (ClientPEMFile && ! _setClientCertificate(ctx, ClientPEMFile))
+                goto sslerror;
+#ifdef SSL_OP_NO_COMPRESSION
+        SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION);
+#endif
+        const char *ciphers = _optionsCiphers(options->ciphers);
+        if (SSL_CTX_set_cipher_list(ctx, ciphers) != 1) {
+                LogError("SSL: client cipher list [%s] error -- no valid ciphers\n", ciphers);
+                goto sslerror;
+        }
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, _newSession);
+        return ctx;
+sslerror:
+        SSL_CTX_free(ctx);
+        return NULL;
+}
+
+
+/**
+ * Returns the cached client context for the options or creates a new one. The caller gets its own context reference
+ */
+static SSL_CTX *_getContext(SslOptions_T options) {
+        SSL_CTX *ctx = NULL;
+        char *key = Str_cat("%d %s %s %s %s", _optionsVersion(options->version), _optionsCiphers(options->ciphers), NVLSTR(_optionsCACertificateFile(options->CACertificateFile)), NVLSTR(_optionsCACertificatePath(options->CACertificatePath)), NVLSTR(_optionsClientPEMFile(options->clientpemfile)));
+        LOCK(_cache.mutex)
+        {
+                SslContext_T c = _cache.contexts;
+                while (c && ! IS(c->key, key))
+                        c = c->next;
+                if (! c && (ctx = _newContext(options))) {
+                        NEW(c);
+                        c->key = key;
+                        c->ctx = ctx;
+                        c->next = _cache.contexts;
+                        _cache.contexts = c;
+                        key = NULL;
+                }
+                if (c) {
+                        ctx = c->ctx;
+#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
+                        CRYPTO_add(&ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#else
+                        SSL_CTX_up_ref(ctx);
+#endif
+                }
+        }
+        END_LOCK;
+        FREE(key);
+        return ctx;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -504,10 +735,33 @@ void Ssl_stop() {
         RAND_cleanup();
         ERR_free_strings();
 #endif
+        Ssl_clearCache();
         Ssl_threadCleanup();
 }
 
 
+void Ssl_clearCache() {
+        LOCK(_cache.mutex)
+        {
+                while (_cache.contexts) {
+                        SslContext_T c = _cache.contexts;
+                        _cache.contexts = c->next;
+                        SSL_CTX_free(c->ctx);
+                        FREE(c->key);
+                        FREE(c);
+                }
+                while (_cache.sessions) {
+                        SslSession_T s = _cache.sessions;
+                        _cache.sessions = s->next;
+                        SSL_SESSION_free(s->session);
+                        FREE(s->key);
+                        FREE(s);
+                }
+        }
+        END_LOCK;
+}
+
+
 void Ssl_threadCleanup() {
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
         ERR_remove_thread_state(NULL);
@@ -530,42 +784,8 @@ T Ssl_new(SslOptions_T options) {
         T C;
         NEW(C);
         C->options = options;
-#if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
-        const SSL_METHOD *method = SSLv23_client_method();
-#else
-        const SSL_METHOD *method = TLS_client_method();
-#endif
-        if (! method) {
-                LogError("SSL: client method initialization failed -- %s\n", SSLERROR);
-                goto sslerror;
-        }
-        if (! (C->ctx = SSL_CTX_new(method))) {
-                LogError("SSL: client context initialization failed -- %s\n", SSLERROR);
-                goto sslerror;
-        }
-        if (! _setVersion(C->ctx, options)) {
-                goto sslerror;
-        }
-        SSL_CTX_set_default_verify_paths(C->ctx);
-        const char *CACertificateFile = _optionsCACertificateFile(options->CACertificateFile);
-        const char *CACertificatePath = _optionsCACertificatePath(options->CACertificatePath);
-        if (CACertificateFile || CACertificatePath) {
-                if (! SSL_CTX_load_verify_locations(C->ctx, CACertificateFile, CACertificatePath)) {
-                        LogError("SSL: CA certificates loading failed -- %s\n", SSLERROR);
-                        goto sslerror;
-                }
-        }
-        const char *ClientPEMFile = _optionsClientPEMFile(options->clientpemfile);
-        if (ClientPEMFile && ! _setClientCertificate(C, ClientPEMFile))
+        if (! (C->ctx = _getContext(options)))
                 goto sslerror;
-#ifdef SSL_OP_NO_COMPRESSION
-        SSL_CTX_set_options(C->ctx, SSL_OP_NO_COMPRESSION);
-#endif
-        const char *ciphers = _optionsCiphers(options->ciphers);
-        if (SSL_CTX_set_cipher_list(C->ctx, ciphers) != 1) {
-                LogError("SSL: client cipher list [%s] error -- no valid ciphers\n", ciphers);
-                goto sslerror;
-        }
         if (! (C->handler = SSL_new(C->ctx))) {
                 LogError("SSL: cannot create client handler -- %s\n", SSLERROR);
                 goto sslerror;
@@ -586,6 +806,7 @@ void Ssl_free(T *C) {
                 SSL_free((*C)->handler);
         if ((*C)->ctx && ! (*C)->accepted)
                 SSL_CTX_free((*C)->ctx);
+        FREE((*C)->session);
         FREE(*C);
 }
 
@@ -629,6 +850,7 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
         SSL_set_connect_state(C->handler);
         SSL_set_fd(C->handler, C->socket);
         _setServerNameIdentification(C, name);
+        _setSession(C, name);
         boolean_t retry = false;
         do {
                 int rv = SSL_connect(C->handler);
@@ -643,6 +865,7 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
                                         retry = _retry(C->socket, &timeout, Net_canWrite);
                                         break;
                                 default:
+                                        _removeSession(C);
 					rv = (int)SSL_get_verify_result(C->handler);
 					if (rv != X509_V_OK)
                                                 THROW(IOException, "SSL server certificate verification error: %s", *C->error ? C->error : X509_verify_cert_error_string(rv));
@@ -654,6 +877,17 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
                         break;
                 }
         } while (retry);
+        if (SSL_session_reused(C->handler)) {
+                DEBUG("SSL: session resumed\n");
+                // The certificate is not verified on resumption, take it from the session (which keeps the reference) for the certificate tests
+                if (! C->certificate) {
+                        X509 *certificate = SSL_get_peer_certificate(C->handler);
+                        if (certificate) {
+                                C->certificate = certificate;
+                                X509_free(certificate);
+                        }
+                }
+        }
 }
 
 
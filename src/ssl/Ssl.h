@@ -84,6 +84,13 @@ void Ssl_start(void);
 void Ssl_stop(void);
 
 
+/**
+ * Release the cached SSL client contexts and sessions. The cache is
+ * rebuilt on demand, e.g. after reload with changed SSL options.
+ */
+void Ssl_clearCache(void);
+
+
 /**
  * Cleanup thread's error queue.
  */
@@ -114,7 +121,9 @@ void Ssl_free(T *C);
 
 /**
  * Connect a socket using SSL. If name is set and TLS is used,
- * the Server Name Indication (SNI) TLS extension is enabled.
+ * the Server Name Indication (SNI) TLS extension is enabled. The cached
+ * session of the previous connection to the same target with the same
+ * certificate verification options is resumed if available.
  * @param C An SSL connection object
  * @param socket A socket
  * @param timeout Milliseconds to wait for connection to be established
@@ -48,6 +48,10 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 
 
 #include "monit.h"
@@ -93,6 +97,14 @@
  * The backward compatibility of monitoring state restore is very important if
  * Monit runs in cluster => keep previous formats compatibility.
  *
+ * The service records have fixed size, so once State_save() wrote the file,
+ * the file is mapped and State_update() rewrites a single service record in
+ * place (for example the content match read position after each check).
+ * The updated pages are flushed asynchronously by State_saveIfDirty() at the
+ * end of the cycle, instead of rewriting and syncing the whole file. The full
+ * rewrite is used if the service list layout is not known yet (the file was
+ * not saved by this Monit instance) or if the state was marked as dirty.
+ *
  * @file
  */
 
@@ -233,6 +245,18 @@ static uint64_t booted = 0ULL;
 static boolean_t _stateDirty = false;
 
 
+/* The mapped service records of the state file written by State_save() */
+static struct {
+        boolean_t pending;    // Some record was updated since the last msync
+        int count;            // Number of service records
+        size_t size;
+        char *base;
+} _map = {.base = MAP_FAILED};
+
+
+#define STATE_HEADER_SIZE (sizeof(int32_t) + sizeof(int32_t) + sizeof(uint64_t))
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -487,6 +511,80 @@ static void _restoreV0(int services) {
 }
 
 
+static void _serialize(Service_T service, State4_T *state) {
+        memset(state, 0, sizeof(*state));
+        snprintf(state->name, sizeof(state->name), "%s", service->name);
+        state->type = service->type;
+        state->monitor = service->monitor & ~Monitor_Waiting;
+        state->nstart = service->nstart;
+        state->ncycle = service->ncycle;
+        switch (service->type) {
+                case Service_Directory:
+                        state->priv.directory.atime = (uint64_t)service->inf.directory->timestamp.access;
+                        state->priv.directory.ctime = (uint64_t)service->inf.directory->timestamp.change;
+                        state->priv.directory.mtime = (uint64_t)service->inf.directory->timestamp.modify;
+                        state->priv.directory.mode = service->inf.directory->mode;
+                        break;
+
+                case Service_Fifo:
+                        state->priv.fifo.atime = (uint64_t)service->inf.fifo->timestamp.access;
+                        state->priv.fifo.ctime = (uint64_t)service->inf.fifo->timestamp.change;
+                        state->priv.fifo.mtime = (uint64_t)service->inf.fifo->timestamp.modify;
+                        state->priv.fifo.mode = service->inf.fifo->mode;
+                        break;
+
+                case Service_File:
+                        state->priv.file.inode = service->inf.file->inode;
+                        state->priv.file.readpos = service->inf.file->readpos;
+                        state->priv.file.size = (int64_t)service->inf.file->size;
+                        state->priv.file.atime = (uint64_t)service->inf.file->timestamp.access;
+                        state->priv.file.ctime = (uint64_t)service->inf.file->timestamp.change;
+                        state->priv.file.mtime = (uint64_t)service->inf.file->timestamp.modify;
+                        state->priv.file.mode = service->inf.file->mode;
+                        strncpy(state->priv.file.hash, service->inf.file->cs_sum, sizeof(state->priv.file.hash) - 1);
+                        break;
+
+                case Service_Filesystem:
+                        state->priv.filesystem.mode = service->inf.filesystem->mode;
+                        break;
+
+                case Service_Net:
+                        if (service->linkspeedlist) {
+                                state->priv.net.duplex = service->linkspeedlist->duplex;
+                                state->priv.net.speed = service->linkspeedlist->speed;
+                        }
+                        break;
+
+                default:
+                        break;
+        }
+}
+
+
+static void _unmap() {
+        if (_map.base != MAP_FAILED) {
+                if (munmap(_map.base, _map.size) == -1)
+                        LogError("State file '%s': unmap error -- %s\n", Run.files.state, STRERROR);
+                _map.base = MAP_FAILED;
+        }
+        _map.pending = false;
+        _map.count = 0;
+        _map.size = 0;
+}
+
+
+/* Map the service records written by State_save(). If the mapping fails, State_update() falls back to the full rewrite */
+static void _mapRecords(int count) {
+        _map.size = STATE_HEADER_SIZE + count * sizeof(State4_T);
+        if ((_map.base = mmap(NULL, _map.size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)) == MAP_FAILED) {
+                DEBUG("State file '%s': cannot map -- %s\n", Run.files.state, STRERROR);
+                _map.size = 0;
+                return;
+        }
+        _map.count = count;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -502,6 +600,7 @@ boolean_t State_open() {
 
 
 void State_close() {
+        _unmap();
         if (file != -1) {
                 if (close(file) == -1)
                         LogError("State file '%s': close error -- %s\n", Run.files.state, STRERROR);
@@ -512,6 +611,7 @@ void State_close() {
 
 
 void State_save() {
+        _unmap();
         TRY
         {
                 if (ftruncate(file, 0L) == -1) {
@@ -532,62 +632,20 @@ void State_save() {
                 if (write(file, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted)) {
                         THROW(IOException, "Unable to write system boot time");
                 }
+                int count = 0;
                 for (Service_T service = servicelist; service; service = service->next) {
                         State4_T state;
-                        memset(&state, 0, sizeof(state));
-                        snprintf(state.name, sizeof(state.name), "%s", service->name);
-                        state.type = service->type;
-                        state.monitor = service->monitor & ~Monitor_Waiting;
-                        state.nstart = service->nstart;
-                        state.ncycle = service->ncycle;
-                        switch (service->type) {
-                                case Service_Directory:
-                                        state.priv.directory.atime = (uint64_t)service->inf.directory->timestamp.access;
-                                        state.priv.directory.ctime = (uint64_t)service->inf.directory->timestamp.change;
-                                        state.priv.directory.mtime = (uint64_t)service->inf.directory->timestamp.modify;
-                                        state.priv.directory.mode = service->inf.directory->mode;
-                                        break;
-
-                                case Service_Fifo:
-                                        state.priv.fifo.atime = (uint64_t)service->inf.fifo->timestamp.access;
-                                        state.priv.fifo.ctime = (uint64_t)service->inf.fifo->timestamp.change;
-                                        state.priv.fifo.mtime = (uint64_t)service->inf.fifo->timestamp.modify;
-                                        state.priv.fifo.mode = service->inf.fifo->mode;
-                                        break;
-
-                                case Service_File:
-                                        state.priv.file.inode = service->inf.file->inode;
-                                        state.priv.file.readpos = service->inf.file->readpos;
-                                        state.priv.file.size = (int64_t)service->inf.file->size;
-                                        state.priv.file.atime = (uint64_t)service->inf.file->timestamp.access;
-                                        state.priv.file.ctime = (uint64_t)service->inf.file->timestamp.change;
-                                        state.priv.file.mtime = (uint64_t)service->inf.file->timestamp.modify;
-                                        state.priv.file.mode = service->inf.file->mode;
-                                        strncpy(state.priv.file.hash, service->inf.file->cs_sum, sizeof(state.priv.file.hash) - 1);
-                                        break;
-
-                                case Service_Filesystem:
-                                        state.priv.filesystem.mode = service->inf.filesystem->mode;
-                                        break;
-
-                                case Service_Net:
-                                        if (service->linkspeedlist) {
-                                                state.priv.net.duplex = service->linkspeedlist->duplex;
-                                                state.priv.net.speed = service->linkspeedlist->speed;
-                                        }
-                                        break;
-
-                                default:
-                                        break;
-                        }
+                        _serialize(service, &state);
                         if (write(file, &state, sizeof(state)) != sizeof(state)) {
                                 THROW(IOException, "Unable to write service state");
                         }
+                        service->stateSlot = count++;
                 }
                 if (fsync(file)) {
                         THROW(IOException, "Unable to sync -- %s", STRERROR);
                 }
                 _stateDirty = false;
+                _mapRecords(count);
         }
         ELSE
         {
@@ -602,9 +660,30 @@ void State_dirty() {
 }
 
 
+void State_update(Service_T service) {
+        ASSERT(service);
+        if (! _stateDirty && _map.base != MAP_FAILED && service->stateSlot < _map.count) {
+                State4_T *slot = (State4_T *)(_map.base + STATE_HEADER_SIZE + service->stateSlot * sizeof(State4_T));
+                if (IS(slot->name, service->name) && slot->type == service->type) {
+                        State4_T state;
+                        _serialize(service, &state);
+                        memcpy(slot, &state, sizeof(state));
+                        _map.pending = true;
+                        return;
+                }
+        }
+        // The record layout is not known => rewrite the whole file at the end of the cycle
+        _stateDirty = true;
+}
+
+
 void State_saveIfDirty() {
         if (_stateDirty) {
                 State_save();
+        } else if (_map.pending) {
+                if (msync(_map.base, _map.size, MS_ASYNC) == -1)
+                        LogError("State file '%s': sync error -- %s\n", Run.files.state, STRERROR);
+                _map.pending = false;
         }
 }
 
@@ -34,6 +34,10 @@
  * service to the state file at the end of every poll cycle. When Monit is
  * restarted or reloaded, it restores the state of the services from this file.
  *
+ * The properties which change often (the content match read position and
+ * the file checksum) are updated with State_update(), which rewrites only
+ * the service record in the mapped state file.
+ *
  * The location of the state file defaults to ~/.monit.state and can be
  * overriden on the command line or using the "set statefile" statement in the
  * configuration file.
@@ -62,7 +66,16 @@ void State_dirty(void);
 
 
 /**
- * Save the state if dirty
+ * Update the state of the given service in place. The record is written to
+ * the mapped state file and flushed by State_saveIfDirty(). If the state
+ * file layout is not known yet, the state is marked as dirty instead.
+ * @param service The service whose state changed
+ */
+void State_update(Service_T service);
+
+
+/**
+ * Save the state if dirty, otherwise flush the updated service records
  */
 void State_saveIfDirty(void);
 
@@ -112,7 +112,7 @@
 #include "engine.h"
 #include "md5.h"
 #include "md5_crypt.h"
-#include "sha1.h"
+#include "digest.h"
 #include "base64.h"
 #include "alert.h"
 #include "ProcessTree.h"
@@ -594,133 +594,86 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result) {
 }
 
 
-boolean_t Util_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resblock) {
-#define HASHBLOCKSIZE 4096
-        md5_context_t ctx_md5;
-        sha1_context_t ctx_sha1;
-        unsigned char buffer[HASHBLOCKSIZE + 72];
-        size_t sum;
-
-        /* Initialize the computation contexts */
-        if (md5_resblock)
-                md5_init(&ctx_md5);
-        if (sha1_resblock)
-                sha1_init(&ctx_sha1);
-
-        /* Iterate over full file contents */
-        while (1)  {
-                /* We read the file in blocks of HASHBLOCKSIZE bytes. One call of the computation function processes the whole buffer so that with the next round of the loop another block can be read */
-                size_t n;
-                sum = 0;
-
-                /* Read block. Take care for partial reads */
-                while (1) {
-                        n = fread(buffer + sum, 1, HASHBLOCKSIZE - sum, stream);
-                        sum += n;
-                        if (sum == HASHBLOCKSIZE)
-                                break;
-                        if (n == 0) {
-                                /* Check for the error flag IFF N == 0, so that we don't exit the loop after a partial read due to e.g., EAGAIN or EWOULDBLOCK */
-                                if (ferror(stream))
-                                        return false;
-                                goto process_partial_block;
-                        }
-
-                        /* We've read at least one byte, so ignore errors. But always check for EOF, since feof may be true even though N > 0. Otherwise, we could end up calling fread after EOF */
-                        if (feof(stream))
-                                goto process_partial_block;
-                }
-
-                /* Process buffer with HASHBLOCKSIZE bytes. Note that HASHBLOCKSIZE % 64 == 0 */
-                if (md5_resblock)
-                        md5_append(&ctx_md5, (const md5_byte_t *)buffer, HASHBLOCKSIZE);
-                if (sha1_resblock)
-                        sha1_append(&ctx_sha1, buffer, HASHBLOCKSIZE);
-        }
-
-process_partial_block:
-        /* Process any remaining bytes */
-        if (sum > 0) {
-                if (md5_resblock)
-                        md5_append(&ctx_md5, (const md5_byte_t *)buffer, (int)sum);
-                if (sha1_resblock)
-                        sha1_append(&ctx_sha1, buffer, sum);
-        }
-        /* Construct result in desired memory */
-        if (md5_resblock)
-                md5_finish(&ctx_md5, md5_resblock);
-        if (sha1_resblock)
-                sha1_finish(&ctx_sha1, sha1_resblock);
-        return true;
-}
-
-
 void Util_printHash(char *file) {
-        MD_T hash;
-        unsigned char sha1[STRLEN], md5[STRLEN];
-        FILE *fhandle = NULL;
-
-        if (! (fhandle = file ? fopen(file, "r") : stdin) || ! Util_getStreamDigests(fhandle, sha1, md5) || (file && fclose(fhandle))) {
+        Hash_Type types[] = {Hash_Sha1, Hash_Md5, Hash_Sha256, Hash_Xxh64};
+        Digest_T digests[sizeof(types) / sizeof(types[0])];
+        long long elapsed[sizeof(types) / sizeof(types[0])] = {};
+        int count = 0;
+        for (int i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+                if ((digests[count] = Digest_new(types[i])))
+                        count++;
+        int fd = file ? open(file, O_RDONLY) : STDIN_FILENO;
+        if (fd < 0) {
                 printf("%s: %s\n", file, STRERROR);
                 exit(1);
         }
-        printf("SHA1(%s) = %s\n", file ? file : "stdin", Util_digest2Bytes(sha1, 20, hash));
-        printf("MD5(%s)  = %s\n", file ? file : "stdin", Util_digest2Bytes(md5, 16, hash));
+#ifdef HAVE_POSIX_FADVISE
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        // Update the digests one by one to measure the throughput of each hash (printed in verbose mode)
+        long long total = 0;
+        unsigned char *buffer = ALLOC(1048576);
+        for (ssize_t n; (n = read(fd, buffer, 1048576)) != 0; total += n) {
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        printf("%s: %s\n", file ? file : "stdin", STRERROR);
+                        exit(1);
+                }
+                for (int i = 0; i < count; i++) {
+                        long long start = Time_micro();
+                        Digest_update(digests[i], buffer, n);
+                        elapsed[i] += Time_micro() - start;
+                }
+        }
+        FREE(buffer);
+        if (file)
+                close(fd);
+        for (int i = 0; i < count; i++) {
+                MD_T hash;
+                char name[STRLEN];
+                snprintf(name, sizeof(name), "%s(%s)", checksumnames[Digest_getType(digests[i])], file ? file : "stdin");
+                printf("%-*s = %s\n", (int)strlen(file ? file : "stdin") + 8, name, Digest_finish(digests[i], hash));
+        }
+        if (Run.debug) {
+                for (int i = 0; i < count; i++)
+                        printf("%-6s throughput: %.1f MB/s\n", checksumnames[Digest_getType(digests[i])], elapsed[i] ? (double)total / elapsed[i] : 0.);
+        }
+        for (int i = 0; i < count; i++)
+                Digest_free(&digests[i]);
 }
 
 
 boolean_t Util_getChecksum(char *file, Hash_Type hashtype, char *buf, int bufsize) {
-        int hashlength = 16;
-
         ASSERT(file);
         ASSERT(buf);
         ASSERT(bufsize >= sizeof(MD_T));
 
-        switch (hashtype) {
-                case Hash_Md5:
-                        hashlength = 16;
-                        break;
-                case Hash_Sha1:
-                        hashlength = 20;
-                        break;
-                default:
-                        LogError("checksum: invalid hash type: 0x%x\n", hashtype);
-                        return false;
+        Digest_T digest = Digest_new(hashtype);
+        if (! digest) {
+                LogError("checksum: invalid hash type: 0x%x\n", hashtype);
+                return false;
         }
-
+        boolean_t rv = false;
         if (File_isFile(file)) {
-                FILE *f = fopen(file, "r");
-                if (f) {
-                        boolean_t fresult = false;
-                        MD_T sum;
-
-                        switch (hashtype) {
-                                case Hash_Md5:
-                                        fresult = Util_getStreamDigests(f, NULL, sum);
-                                        break;
-                                case Hash_Sha1:
-                                        fresult = Util_getStreamDigests(f, sum, NULL);
-                                        break;
-                                default:
-                                        break;
+                int fd = open(file, O_RDONLY);
+                if (fd >= 0) {
+                        if (Digest_read(fd, &digest, 1)) {
+                                Digest_finish(digest, buf);
+                                rv = true;
+                        } else {
+                                LogError("checksum: file %s read error -- %s\n", file, STRERROR);
                         }
-
-                        if (fclose(f))
+                        if (close(fd))
                                 LogError("checksum: error closing file '%s' -- %s\n", file, STRERROR);
-
-                        if (! fresult) {
-                                LogError("checksum: file %s stream error (0x%x)\n", file, fresult);
-                                return false;
-                        }
-
-                        Util_digest2Bytes((unsigned char *)sum, hashlength, buf);
-                        return true;
-
-                } else
+                } else {
                         LogError("checksum: failed to open file %s -- %s\n", file, STRERROR);
-        } else
+                }
+        } else {
                 LogError("checksum: file %s is not regular file\n", file);
-        return false;
+        }
+        Digest_free(&digest);
+        return rv;
 }
 
 
@@ -808,9 +761,19 @@ void Util_printRunList() {
         printf(" %-18s =   stopTimeout:       %s\n", " ", Fmt_time2str(Run.limits.stopTimeout, (char[11]){}));
         printf(" %-18s =   startTimeout:      %s\n", " ", Fmt_time2str(Run.limits.startTimeout, (char[11]){}));
         printf(" %-18s =   restartTimeout:    %s\n", " ", Fmt_time2str(Run.limits.restartTimeout, (char[11]){}));
+        if (Run.limits.checksumBudget)
+                printf(" %-18s =   checksumBudget:    %s\n", " ", Fmt_bytes2str(Run.limits.checksumBudget, buf));
+        else
+                printf(" %-18s =   checksumBudget:    unlimited\n", " ");
+        printf(" %-18s =   treeBudget:        %u entries\n", " ", Run.limits.treeBudget);
+        printf(" %-18s =   dnsTTL:            %s\n", " ", Fmt_time2str(Run.limits.dnsTTL, (char[11]){}));
         printf(" %-18s = }\n", " ");
         printf(" %-18s = %s\n", "On reboot", onrebootnames[Run.onreboot]);
         printf(" %-18s = %d seconds with start delay %d seconds\n", "Poll time", Run.polltime, Run.startdelay);
+        if (Run.parallel > 1)
+                printf(" %-18s = %d workers\n", "Parallel checks", Run.parallel);
+        if (Run.inotify)
+                printf(" %-18s = %s\n", "File notification", "inotify");
 
         if (Run.eventlist_dir) {
                 char slots[STRLEN];
@@ -1151,6 +1114,24 @@ void Util_printService(Service_T s) {
                        );
         }
 
+        for (Tree_T o = s->treelist; o; o = o->next) {
+                StringBuffer_clear(buf);
+                switch (o->type) {
+                        case Tree_Entries:
+                                printf(" %-20s = %s\n", "Entries", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %llu", operatornames[o->operator], o->limit)));
+                                break;
+                        case Tree_Size:
+                                printf(" %-20s = %s\n", "Total size", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Fmt_bytes2str(o->limit, (char[10]){}))));
+                                break;
+                        case Tree_Oldest:
+                                printf(" %-20s = %s\n", "Oldest entry", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Fmt_time2str(o->limit * 1000., (char[11]){}))));
+                                break;
+                        case Tree_Changed:
+                                printf(" %-20s = %s\n", "Entries", StringBuffer_toString(Util_printRule(buf, o->action, "if changed")));
+                                break;
+                }
+        }
+
         for (LinkStatus_T o = s->linkstatuslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 printf(" %-20s = %s\n", "Link status", StringBuffer_toString(Util_printRule(buf, o->action, "if failed")));
@@ -1398,6 +1379,8 @@ void Util_printService(Service_T s) {
                 printf(" %-20s = Check service every %s\n", "Every", s->every.spec.cron);
         else if (s->every.type == Every_NotInCron)
                 printf(" %-20s = Don't check service every %s\n", "Every", s->every.spec.cron);
+        else if (s->every.type == Every_Interval)
+                printf(" %-20s = Check service every %d seconds\n", "Every", s->every.spec.interval.seconds);
 
         for (ActionRate_T o = s->actionratelist; o; o = o->next) {
                 StringBuffer_clear(buf);
@@ -1735,6 +1718,10 @@ void Util_resetInfo(Service_T s) {
                         s->inf.directory->timestamp.access = 0;
                         s->inf.directory->timestamp.change = 0;
                         s->inf.directory->timestamp.modify = 0;
+                        s->inf.directory->tree.entries = -1;
+                        s->inf.directory->tree.changed = 0;
+                        s->inf.directory->tree.size = 0ULL;
+                        s->inf.directory->tree.oldest = 0;
                         break;
                 case Service_Fifo:
                         s->inf.fifo->mode = -1;
@@ -1883,6 +1870,8 @@ void Util_monitorUnset(Service_T s) {
         s->ncycle = 0;
         if (s->every.type == Every_SkipCycles)
                 s->every.spec.cycle.counter = 0;
+        else if (s->every.type == Every_Interval)
+                s->every.spec.interval.next = 0;
         s->error = Event_Null;
         if (s->eventlist)
                 gc_event(&s->eventlist);
@@ -83,20 +83,9 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result);
 
 
 /**
- * Compute SHA1 and MD5 message digests simultaneously for bytes read
- * from STREAM (suitable for stdin, which is not always rewindable).
- * The resulting message digest numbers will be written into the first
- * bytes of resblock buffers.
- * @param stream The stream from where the digests are computed
- * @param sha_resblock The buffer to write the SHA1 result to or NULL to skip the SHA1
- * @param md5_resblock The buffer to write the MD5 result to or NULL to skip the MD5
- * @return false if failed, otherwise true
- */
-boolean_t Util_getStreamDigests(FILE *stream, void *sha_resblock, void *md5_resblock);
-
-
-/**
- * Print MD5 and SHA1 hashes to standard output for given file or standard input
+ * Print the hashes (SHA1, MD5, SHA256 if supported and XXH64) to standard output
+ * for given file or standard input. In verbose mode the throughput of each hash
+ * is printed too.
  * @param file The file for which the hashes will be printed or NULL for stdin
  */
 void Util_printHash(char *file);
@@ -105,7 +94,7 @@ void Util_printHash(char *file);
 /**
  * Store the checksum of given file in supplied buffer
  * @param file The file for which to compute the checksum
- * @param hashtype The hash type (Hash_Md5 or Hash_Sha1)
+ * @param hashtype The hash type (e.g. Hash_Md5 or Hash_Sha1)
  * @param buf The buffer where the result will be stored
  * @param bufsize The size of the buffer
  * @return false if failed, otherwise true
@@ -73,6 +73,10 @@
 #include <sys/time.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_TIME_H
 #include <time.h>
 #endif
@@ -101,12 +105,16 @@
 #include "device.h"
 #include "ProcessTree.h"
 #include "protocol.h"
+#include "watch.h"
+#include "digest.h"
+#include "state.h"
 
 // libmonit
 #include "system/Time.h"
 #include "util/Fmt.h"
 #include "io/File.h"
 #include "io/InputStream.h"
+#include "io/FileTail.h"
 #include "exceptions/AssertException.h"
 
 /**
@@ -116,9 +124,89 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+#define CHECKSUM_CHUNK 1048576
+#define CHECKSUM_RESTARTS 3      // The number of restarted checksum computations, after which the file is hashed ignoring the budget
+
+
+typedef enum {
+        Job_Pending = 0,
+        Job_Running,
+        Job_Done
+} __attribute__((__packed__)) Job_State;
+
+
+typedef struct ValidateJob_T {
+        Job_State state;
+        Service_T service;
+        int parentsCount;
+        int *parents;                     /**< Indexes of the jobs we depend on */
+} ValidateJob_T;
+
+
+/* The worker pool used for parallel validation. The pool mutex serializes all service data and event handling, the workers release it only while blocked on network I/O */
+static struct {
+        boolean_t active;
+        int count;
+        int errors;
+        ValidateJob_T *jobs;
+        Mutex_T mutex;
+        Sem_T done;
+} _pool = {.mutex = PTHREAD_MUTEX_INITIALIZER, .done = PTHREAD_COND_INITIALIZER};
+
+
+/* The services with their own check interval, kept as a binary min-heap ordered by the time of the next check. The schedule is rebuilt by each validate() cycle, so it never outlives the servicelist across reload */
+static struct {
+        int count;
+        int capacity;
+        Service_T *services;
+} _schedule = {};
+
+
+/* The cached checksum of a file. The digest is valid while the file identity, size and change times match the ones it was computed for, otherwise it is recomputed incrementally, possibly over several cycles (see Run.limits.checksumBudget) */
+struct ChecksumCache_T {
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+        struct timespec ctime;
+        boolean_t valid;                     /**< true if sum is the digest of the file */
+        off_t offset;                      /**< Number of bytes hashed while in progress */
+        int restarts;      /**< Number of computations restarted as the file changed while in progress */
+        MD_T sum;
+};
+
+
+/* The checksum read buffer and the number of bytes hashed in this cycle, shared by all services as the checks are serialized */
+static struct {
+        uint64_t used;
+        unsigned char buffer[CHECKSUM_CHUNK] __attribute__((aligned(4096)));
+} _checksum = {};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
+/**
+ * Release the validation lock before a blocking operation (no-op if the checks run sequentially)
+ */
+static void _blockingBegin() {
+        if (_pool.active)
+                Mutex_unlock(_pool.mutex);
+}
+
+
+/**
+ * Re-acquire the validation lock after a blocking operation
+ */
+static void _blockingEnd() {
+        if (_pool.active)
+                Mutex_lock(_pool.mutex);
+}
+
+
 /**
  * Read program output. The output is saved to StringBuffer up to Run.limits.programOutput,
  * remaining bytes are dropped (must read whole output so the program doesn't hang on full
@@ -126,15 +214,42 @@
  */
 static void _programOutput(InputStream_T I, StringBuffer_T S) {
         int n;
-        char buf[STRLEN];
-        InputStream_setTimeout(I, 0);
-        do {
-                n = InputStream_readBytes(I, buf, sizeof(buf) - 1);
-                if (n > 0 && StringBuffer_length(S) < Run.limits.programOutput) {
-                        buf[n] = 0;
-                        StringBuffer_append(S, "%s", buf);
-                }
-        } while (n > 0);
+        const char *line;
+        // The limit 0 drops the whole output, the line limit must still be at least one character
+        FileTail_T tail = FileTail_new(InputStream_getDescriptor(I), MAX(Run.limits.programOutput, 1) + 1);
+        while ((n = FileTail_readLine(tail, &line)) >= 0) {
+                if (StringBuffer_length(S) < Run.limits.programOutput)
+                        StringBuffer_appendBytes(StringBuffer_appendBytes(S, line, n), "\n", 1);
+        }
+        // The output which doesn't end with a newline yet (the program is running or didn't terminate the last line)
+        if ((n = FileTail_pending(tail, &line)) && StringBuffer_length(S) < Run.limits.programOutput)
+                StringBuffer_appendBytes(S, line, n);
+        FileTail_free(&tail);
+}
+
+
+/**
+ * Connect the ports of the service at once, so the connection tests of several ports wait for slow or unresponsive hosts in parallel. The protocol
+ * tests then run one by one over the connected sockets in _checkConnection()
+ */
+static void _connectPorts(Port_T portlist, Port_T socketlist) {
+        int count = 0;
+        for (Port_T p = portlist; p; p = p->next)
+                count++;
+        for (Port_T p = socketlist; p; p = p->next)
+                count++;
+        if (count > 1) {
+                void **ports = CALLOC(count, sizeof(void *));
+                int i = 0;
+                for (Port_T p = portlist; p; p = p->next)
+                        ports[i++] = p;
+                for (Port_T p = socketlist; p; p = p->next)
+                        ports[i++] = p;
+                _blockingBegin();
+                Socket_connectAll(ports, count);
+                _blockingEnd();
+                FREE(ports);
+        }
 }
 
 
@@ -149,6 +264,7 @@ static State_Type _checkConnection(Service_T s, Port_T p) {
         char buf[STRLEN];
         char report[1024] = {};
 retry:
+        _blockingBegin();
         TRY
         {
                 Socket_test(p);
@@ -161,6 +277,7 @@ retry:
                 snprintf(report, sizeof(report), "failed protocol test [%s] at %s -- %s", p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Exception_frame.message);
         }
         END_TRY;
+        _blockingEnd();
         if (rv == State_Failed) {
                 if (retry_count-- > 1) {
                         LogWarning("'%s' %s (attempt %d/%d)\n", s->name, report, p->retry - retry_count, p->retry);
@@ -543,34 +660,144 @@ static State_Type _checkSystemResources(Service_T s, Resource_T r) {
 
 
 /**
- * Test for associated path checksum change
+ * Get the nanosecond modification and change time of the file (falls back to seconds if the platform doesn't provide them)
  */
-static State_Type _checkChecksum(Service_T s) {
+static void _statTimes(struct stat *sb, struct timespec *mtime, struct timespec *ctime) {
+#if defined HAVE_STRUCT_STAT_ST_MTIM
+        *mtime = sb->st_mtim;
+        *ctime = sb->st_ctim;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC
+        *mtime = sb->st_mtimespec;
+        *ctime = sb->st_ctimespec;
+#else
+        *mtime = (struct timespec){.tv_sec = sb->st_mtime};
+        *ctime = (struct timespec){.tv_sec = sb->st_ctime};
+#endif
+}
+
+
+/**
+ * Restart the digest computation unless the file matches the checksum cache key (device, inode, size, modification and change time)
+ */
+static void _checksumKey(Service_T s, struct stat *sb) {
+        Checksum_T cs = s->checksum;
+        if (! cs->cache)
+                NEW(cs->cache);
+        struct ChecksumCache_T *c = cs->cache;
+        struct timespec mtime, ctime;
+        _statTimes(sb, &mtime, &ctime);
+        if ((c->valid || c->offset) &&
+            c->device == sb->st_dev && c->inode == sb->st_ino && c->size == sb->st_size &&
+            c->mtime.tv_sec == mtime.tv_sec && c->mtime.tv_nsec == mtime.tv_nsec &&
+            c->ctime.tv_sec == ctime.tv_sec && c->ctime.tv_nsec == ctime.tv_nsec)
+                return;
+        if (! c->valid && c->offset && ++c->restarts == CHECKSUM_RESTARTS)
+                LogWarning("'%s' the file %s changed during %d checksum computations, its checksum will be computed ignoring the checksumBudget limit\n", s->name, s->path, c->restarts);
+        DEBUG("'%s' computing checksum of %lld bytes\n", s->name, (long long)sb->st_size);
+        c->device = sb->st_dev;
+        c->inode = sb->st_ino;
+        c->size = sb->st_size;
+        c->mtime = mtime;
+        c->ctime = ctime;
+        c->valid = false;
+        c->offset = 0;
+        if (cs->digest)
+                Digest_reset(cs->digest);
+}
+
+
+/**
+ * Continue the digest computation. Reading stops when the bytes hashed in this cycle exceed Run.limits.checksumBudget,
+ * but each check hashes at least one chunk, so the computation always makes progress. If the file changed during
+ * CHECKSUM_RESTARTS computations, the budget is ignored, otherwise a file changing each cycle would be never hashed.
+ * @return State_Succeeded if the digest is complete, State_Init if it is in progress or State_Failed on error
+ */
+static State_Type _checksumUpdate(Service_T s) {
+        Checksum_T cs = s->checksum;
+        struct ChecksumCache_T *c = cs->cache;
+        if (! cs->digest && ! (cs->digest = Digest_new(cs->type))) {
+                LogError("checksum: hash type %s is not supported\n", checksumnames[cs->type]);
+                return State_Failed;
+        }
+        int fd = open(s->path, O_RDONLY);
+        if (fd < 0) {
+                LogError("checksum: failed to open file %s -- %s\n", s->path, STRERROR);
+                return State_Failed;
+        }
+        State_Type rv = State_Init;
+        struct stat sb;
+        if (fstat(fd, &sb) || sb.st_dev != c->device || sb.st_ino != c->inode) {
+                // The file was replaced after stat(), the key doesn't match it => start over in the next cycle
+                c->offset = 0;
+                goto done;
+        }
+#ifdef HAVE_POSIX_FADVISE
+        posix_fadvise(fd, c->offset, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        boolean_t progress = false;
+        while (c->offset < c->size) {
+                if (progress && Run.limits.checksumBudget && _checksum.used >= Run.limits.checksumBudget && c->restarts < CHECKSUM_RESTARTS)
+                        goto done;
+                ssize_t n = pread(fd, _checksum.buffer, MIN(sizeof(_checksum.buffer), (size_t)(c->size - c->offset)), c->offset);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("checksum: file %s read error -- %s\n", s->path, STRERROR);
+                        c->offset = 0;
+                        rv = State_Failed;
+                        goto done;
+                }
+                if (n == 0) {
+                        // The file was truncated, its size won't match the key => start over in the next cycle
+                        c->offset = 0;
+                        goto done;
+                }
+                Digest_update(cs->digest, _checksum.buffer, n);
+                c->offset += n;
+                _checksum.used += n;
+                progress = true;
+        }
+        Digest_finish(cs->digest, c->sum);
+        c->valid = true;
+        c->offset = 0;
+        c->restarts = 0;
+        rv = State_Succeeded;
+done:
+        close(fd);
+        return rv;
+}
+
+
+/**
+ * Test for associated path checksum change. The digest is cached and recomputed only if the file changed.
+ */
+static State_Type _checkChecksum(Service_T s, struct stat *sb) {
         ASSERT(s);
         ASSERT(s->path);
         State_Type rv = State_Succeeded;
         if (s->checksum) {
                 Checksum_T cs = s->checksum;
-                if (Util_getChecksum(s->path, cs->type, s->inf.file->cs_sum, sizeof(s->inf.file->cs_sum))) {
+                State_Type state = State_Failed;
+                if (S_ISREG(sb->st_mode)) {
+                        _checksumKey(s, sb);
+                        state = cs->cache->valid ? State_Succeeded : _checksumUpdate(s);
+                } else {
+                        LogError("checksum: file %s is not regular file\n", s->path);
+                }
+                if (state == State_Init) {
+                        DEBUG("'%s' checksum computation in progress -- %lld of %lld bytes hashed\n", s->name, (long long)cs->cache->offset, (long long)cs->cache->size);
+                        return State_Init;
+                } else if (state == State_Succeeded) {
+                        if (! IS(s->inf.file->cs_sum, cs->cache->sum)) {
+                                snprintf(s->inf.file->cs_sum, sizeof(s->inf.file->cs_sum), "%s", cs->cache->sum);
+                                State_update(s);
+                        }
                         Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "checksum %s", s->inf.file->cs_sum);
                         if (! cs->initialized) {
                                 cs->initialized = true;
                                 strncpy(cs->hash, s->inf.file->cs_sum, sizeof(cs->hash) - 1);
                         }
-                        int changed;
-                        switch (cs->type) {
-                                case Hash_Md5:
-                                        changed = strncmp(cs->hash, s->inf.file->cs_sum, 32);
-                                        break;
-                                case Hash_Sha1:
-                                        changed = strncmp(cs->hash, s->inf.file->cs_sum, 40);
-                                        break;
-                                default:
-                                        LogError("'%s' unknown hash type (%d)\n", s->name, cs->type);
-                                        *s->inf.file->cs_sum = 0;
-                                        return State_Failed;
-                        }
-                        if (changed) {
+                        if (strncmp(cs->hash, s->inf.file->cs_sum, Digest_length(cs->type) * 2)) {
                                 if (cs->test_changes) {
                                         rv = State_Changed;
                                         /* reset expected value for next cycle */
@@ -817,6 +1044,79 @@ static State_Type _checkSize(Service_T s, off_t size) {
 }
 
 
+/**
+ * Test the directory tree. The tree is walked incrementally, at most Run.limits.treeBudget entries per cycle, the tests
+ * are evaluated when the walk completes.
+ */
+static State_Type _checkTree(Service_T s) {
+        ASSERT(s);
+        DirectoryInfo_T inf = s->inf.directory;
+        if (! inf->snapshot)
+                inf->snapshot = Snapshot_new();
+        switch (Snapshot_walk(inf->snapshot, s->path, Run.limits.treeBudget)) {
+                case Snapshot_Pending:
+                        DEBUG("'%s' directory tree walk in progress\n", s->name);
+                        return State_Init;
+                case Snapshot_Error:
+                        Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot read directory %s -- %s", s->path, STRERROR);
+                        return State_Failed;
+                default:
+                        break;
+        }
+        boolean_t baseline = inf->tree.entries < 0;
+        inf->tree.entries = Snapshot_getEntries(inf->snapshot);
+        inf->tree.changed = Snapshot_getChanged(inf->snapshot);
+        inf->tree.size = Snapshot_getSize(inf->snapshot);
+        inf->tree.oldest = Snapshot_getOldest(inf->snapshot);
+        State_Type rv = State_Succeeded;
+        char buf[10];
+        for (Tree_T t = s->treelist; t; t = t->next) {
+                switch (t->type) {
+                        case Tree_Entries:
+                                if (Util_evalQExpression(t->operator, inf->tree.entries, t->limit)) {
+                                        rv = State_Failed;
+                                        Event_post(s, Event_Size, State_Failed, t->action, "entries test failed for %s -- current entries count is %d", s->path, inf->tree.entries);
+                                } else {
+                                        Event_post(s, Event_Size, State_Succeeded, t->action, "entries check succeeded [current entries count = %d]", inf->tree.entries);
+                                }
+                                break;
+                        case Tree_Size:
+                                if (Util_evalQExpression(t->operator, inf->tree.size, t->limit)) {
+                                        rv = State_Failed;
+                                        Event_post(s, Event_Size, State_Failed, t->action, "total size test failed for %s -- current total size is %s", s->path, Fmt_bytes2str(inf->tree.size, buf));
+                                } else {
+                                        Event_post(s, Event_Size, State_Succeeded, t->action, "total size check succeeded [current total size = %s]", Fmt_bytes2str(inf->tree.size, buf));
+                                }
+                                break;
+                        case Tree_Oldest:
+                                if (inf->tree.oldest) {
+                                        long long age = (long long)(Time_now() - inf->tree.oldest);
+                                        if (Util_evalQExpression(t->operator, age, t->limit)) {
+                                                rv = State_Failed;
+                                                Event_post(s, Event_Timestamp, State_Failed, t->action, "oldest entry test failed for %s -- the oldest entry is %s old", s->path, Fmt_time2str(age * 1000., (char[11]){}));
+                                        } else {
+                                                Event_post(s, Event_Timestamp, State_Succeeded, t->action, "oldest entry check succeeded [the oldest entry is %s old]", Fmt_time2str(age * 1000., (char[11]){}));
+                                        }
+                                } else {
+                                        Event_post(s, Event_Timestamp, State_Succeeded, t->action, "oldest entry check succeeded [no entries]");
+                                }
+                                break;
+                        case Tree_Changed:
+                                if (baseline) {
+                                        // The first walk only records the snapshot
+                                } else if (inf->tree.changed) {
+                                        rv = State_Changed;
+                                        Event_post(s, Event_Timestamp, State_Changed, t->action, "%d entries changed in %s: %s", inf->tree.changed, s->path, Snapshot_getChanges(inf->snapshot));
+                                } else {
+                                        Event_post(s, Event_Timestamp, State_ChangedNot, t->action, "entries have not changed");
+                                }
+                                break;
+                }
+        }
+        return rv;
+}
+
+
 /**
  * Test uptime
  */
@@ -842,6 +1142,40 @@ static int _checkPattern(Match_T pattern, const char *line) {
 }
 
 
+/**
+ * Feed the content line to the ignore and match patterns
+ */
+static void _matchLine(Service_T s, const char *line, size_t length) {
+        // Run the regex only if the line contains the literal required by the pattern
+        int index = 0;
+        Prefilter_scan(s->matchfilter, line, length);
+        /* Check ignores */
+        for (Match_T ml = s->matchignorelist; ml; ml = ml->next) {
+                if (((Prefilter_candidate(s->matchfilter, index++) && _checkPattern(ml, line) == 0)) ^ (ml->not)) {
+                        /* We match! -> line is ignored! */
+                        DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
+                        return;
+                }
+        }
+        /* Check non ignores */
+        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
+                if (((Prefilter_candidate(s->matchfilter, index++) && _checkPattern(ml, line) == 0)) ^ (ml->not)) {
+                        DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                        /* Save the line for Event_post */
+                        if (! ml->log)
+                                ml->log = StringBuffer_create(Run.limits.fileContentBuffer);
+                        if (StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
+                                StringBuffer_append(ml->log, "%s\n", line);
+                                if (StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
+                                        StringBuffer_append(ml->log, "...\n");
+                        }
+                } else {
+                        DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                }
+        }
+}
+
+
 /**
  * Match content.
  *
@@ -851,25 +1185,23 @@ static int _checkPattern(Match_T pattern, const char *line) {
  * The test will resume at the beginning of the incomplete line during the next cycle, allowing the writer to finish the write.
  *
  * We test only Run.limits.fileContentBuffer at maximum - in the case that the line is bigger, we read the rest of the line (till '\n') but ignore the characters past the maximum
+ *
+ * The lines are read with FileTail, which hands them out in place from its read buffer, so the line is neither copied nor scanned again for its length.
  */
 static State_Type _checkMatch(Service_T s) {
         ASSERT(s);
-        /* TODO: https://bitbucket.org/tildeslash/monit/issues/401 Refactor and use mmap instead of naive std file io.
-         mmap can make code simpler, more efficient and support multi-line matching as there is no line-buffer, but the
-         whole file is in the buffer.
-         */
         State_Type rv = State_Succeeded;
         if (s->matchlist) {
-                FILE *file = fopen(s->path, "r");
-                if (! file) {
+                int fd = open(s->path, O_RDONLY);
+                if (fd == -1) {
                         LogError("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
                         return State_Failed;
                 }
-                /* FIXME: Refactor: Initialize the filesystems table ahead of file and filesystems test and index it by device id + replace the Str_startsWith() with lookup to the table by device id (obtained via file's stat()).
-                 The central filesystems initialization will allow to reduce the statfs() calls in the case that there will be multiple file and/or filesystems tests for the same fs. Temporarily we go with
-                 dummy Str_startsWith() as quick fix which will cover 99.9% of use cases without rising the statfs overhead if statfs call would be inlined here.
-                 */
-                if (Str_startsWith(s->path, "/proc")) {
+                /* The pseudo filesystems report zero size => always read the whole file. The filesystem type is looked up in the shared mount table by the file's device id, if the platform
+                 doesn't provide it, fallback to the path test */
+                const char *type = Filesystem_typeById(s->inf.file->device);
+                boolean_t pseudo = type ? (IS(type, "proc") || IS(type, "sysfs")) : Str_startsWith(s->path, "/proc");
+                if (pseudo) {
                         s->inf.file->readpos = 0;
                 } else {
                         /* If inode changed or size shrinked -> set read position = 0 */
@@ -878,78 +1210,39 @@ static State_Type _checkMatch(Service_T s) {
                         /* Do we need to match? Even if not, go to final, so we can reset the content match error flags in this cycle */
                         if (s->inf.file->readpos == s->inf.file->size) {
                                 DEBUG("'%s' content match skipped - file size nor inode has not changed since last test\n", s->name);
-                                goto final1;
+                                goto final;
                         }
                 }
-                char *line = CALLOC(sizeof(unsigned char), Run.limits.fileContentBuffer);
-                while (true) {
-next:
-                        /* Seek to the read position */
-                        if (fseek(file, (long)s->inf.file->readpos, SEEK_SET)) {
-                                rv = State_Failed;
-                                LogError("'%s' cannot seek file %s: %s\n", s->name, s->path, STRERROR);
-                                goto final2;
-                        }
-                        if (! fgets(line, Run.limits.fileContentBuffer, file)) {
-                                if (! feof(file)) {
-                                        rv = State_Failed;
-                                        LogError("'%s' cannot read file %s: %s\n", s->name, s->path, STRERROR);
-                                }
-                                goto final2;
-                        }
-                        size_t length = strlen(line);
-                        if (length == 0) {
-                                /* No content: shouldn't happen - empty line will contain at least '\n' */
-                                goto final2;
-                        } else if (line[length - 1] != '\n') {
-                                if (length < Run.limits.fileContentBuffer - 1) {
-                                        /* Incomplete line: we gonna read it next time again, allowing the writer to complete the write */
-                                        DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
-                                        goto final2;
-                                } else if (length >= Run.limits.fileContentBuffer - 1) {
-                                        /* Our read buffer is full: ignore the content past the Run.limits.fileContentBuffer */
-                                        int _rv;
-                                        do {
-                                                if ((_rv = fgetc(file)) == EOF)
-                                                        goto final2;
-                                                length++;
-                                        } while (_rv != '\n');
-                                }
-                        } else {
-                                /* Remove trailing newline */
-                                line[length - 1] = 0;
-                        }
-                        /* Set read position to the end of last read */
-                        s->inf.file->readpos += length;
-                        /* Check ignores */
-                        for (Match_T ml = s->matchignorelist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        /* We match! -> line is ignored! */
-                                        DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
-                                        goto next;
-                                }
-                        }
-                        /* Check non ignores */
-                        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
-                                        /* Save the line for Event_post */
-                                        if (! ml->log)
-                                                ml->log = StringBuffer_create(Run.limits.fileContentBuffer);
-                                        if (StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
-                                                StringBuffer_append(ml->log, "%s\n", line);
-                                                if (StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
-                                                        StringBuffer_append(ml->log, "...\n");
-                                        }
-                                } else {
-                                        DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
-                                }
+                if (lseek(fd, s->inf.file->readpos, SEEK_SET) == -1) {
+                        rv = State_Failed;
+                        LogError("'%s' cannot seek file %s: %s\n", s->name, s->path, STRERROR);
+                        goto final;
+                }
+#ifdef HAVE_POSIX_FADVISE
+                posix_fadvise(fd, s->inf.file->readpos, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+                // The regular file is mapped in windows and the line boundaries are found with memchr(), the pseudo filesystem files are read
+                int length;
+                const char *line;
+                FileTail_T tail = FileTail_new(fd, Run.limits.fileContentBuffer);
+                while ((length = FileTail_readLine(tail, &line)) >= 0)
+                        _matchLine(s, line, length);
+                if (FileTail_getError(tail)) {
+                        rv = State_Failed;
+                        LogError("'%s' cannot read file %s: %s\n", s->name, s->path, strerror(FileTail_getError(tail)));
+                } else {
+                        if (FileTail_pending(tail, &line))
+                                DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
+                        /* Set read position to the end of last complete line and persist it, so the lines are not matched again if Monit restarts */
+                        off_t position = FileTail_getPosition(tail);
+                        if (position != s->inf.file->readpos) {
+                                s->inf.file->readpos = position;
+                                State_update(s);
                         }
                 }
-final2:
-                FREE(line);
-final1:
-                if (fclose(file)) {
+                FileTail_free(&tail);
+final:
+                if (close(fd)) {
                         rv = State_Failed;
                         LogError("'%s' cannot close file %s: %s\n", s->name, s->path, STRERROR);
                 }
@@ -1225,6 +1518,13 @@ static boolean_t _checkSkip(Service_T s) {
                 s->monitor |= Monitor_Waiting;
                 DEBUG("'%s' test skipped as current time (%lld) matches every's cron spec \"not %s\"\n", s->name, (long long)now, s->every.spec.cron);
                 return true;
+        } else if (s->every.type == Every_Interval) {
+                if (now < s->every.spec.interval.next) {
+                        s->monitor |= Monitor_Waiting;
+                        DEBUG("'%s' test skipped as the next check is due in %lld seconds\n", s->name, (long long)(s->every.spec.interval.next - now));
+                        return true;
+                }
+                s->every.spec.interval.next = now + s->every.spec.interval.seconds;
         }
         s->monitor &= ~Monitor_Waiting;
         // Skip if parent is not initialized
@@ -1244,6 +1544,68 @@ static boolean_t _checkSkip(Service_T s) {
 }
 
 
+/**
+ * Returns true if the service is due in this cycle according to its every statement. Unlike _checkSkip() it doesn't update the schedule
+ */
+static boolean_t _isDue(Service_T s, time_t now) {
+        switch (s->every.type) {
+                case Every_SkipCycles:
+                        return s->every.spec.cycle.counter + 1 >= s->every.spec.cycle.number;
+                case Every_Cron:
+                        return (now - s->every.last_run) > 59 && Time_incron(s->every.spec.cron, now);
+                case Every_NotInCron:
+                        return ! Time_incron(s->every.spec.cron, now);
+                case Every_Interval:
+                        return now >= s->every.spec.interval.next;
+                default:
+                        return true;
+        }
+}
+
+
+/**
+ * Ping the remote hosts of the services at once, so the unreachable hosts wait for the ping timeout in parallel instead of one by one.
+ * The ping tests in check_remote_host() then just evaluate the results
+ */
+static void _pingHosts(Service_T services[], int count) {
+        int n = 0;
+        for (int i = 0; i < count; i++)
+                if (services[i]->type == Service_Host)
+                        for (Icmp_T icmp = services[i]->icmplist; icmp; icmp = icmp->next)
+                                if (icmp->type == ICMP_ECHO)
+                                        n++;
+        if (n > 1) {
+                Icmp_T *icmps = CALLOC(n, sizeof(Icmp_T));
+                const char **hostnames = CALLOC(n, sizeof(char *));
+                n = 0;
+                for (int i = 0; i < count; i++) {
+                        if (services[i]->type == Service_Host) {
+                                for (Icmp_T icmp = services[i]->icmplist; icmp; icmp = icmp->next) {
+                                        if (icmp->type == ICMP_ECHO) {
+                                                icmps[n] = icmp;
+                                                hostnames[n++] = services[i]->path;
+                                        }
+                                }
+                        }
+                }
+                icmp_echoAll(icmps, hostnames, n);
+                FREE(hostnames);
+                FREE(icmps);
+        }
+}
+
+
+/**
+ * Drop the ping results of the services which were not checked (e.g. because of a failed dependency), so they won't be used in the next cycle
+ */
+static void _pingHostsDone(Service_T services[], int count) {
+        for (int i = 0; i < count; i++)
+                if (services[i]->type == Service_Host)
+                        for (Icmp_T icmp = services[i]->icmplist; icmp; icmp = icmp->next)
+                                icmp->echo.started = false;
+}
+
+
 /**
  * Returns true if scheduled action was performed
  */
@@ -1259,6 +1621,210 @@ static boolean_t _doScheduledAction(Service_T s) {
 }
 
 
+/**
+ * Returns true if the test of the watched service can be skipped, because the file didn't change since the last test. The service with
+ * errors is tested each cycle (the error may depend on the number of cycles) and so is the service with timestamp tests relative to the
+ * current time. The service on a filesystem which doesn't report the changes (such as proc or NFS) is not watched, so it is tested too.
+ */
+static boolean_t _watchSkip(Service_T s) {
+        if (s->monitor != Monitor_Yes || s->error || Watch_getStatus(s) != Watch_Idle)
+                return false;
+        if (s->checksum && s->checksum->cache && ! s->checksum->cache->valid)
+                return false; // The checksum computation is in progress
+        if (s->treelist)
+                return false; // The watch doesn't cover the whole directory tree
+        for (Timestamp_T t = s->timestamplist; t; t = t->next)
+                if (! t->test_changes)
+                        return false;
+        DEBUG("'%s' test skipped as the file didn't change\n", s->name);
+        return true;
+}
+
+
+/**
+ * Run the tests of the service s if it is due in this cycle
+ * @return The service state or State_Init if the service was not checked
+ */
+static State_Type _validateService(Service_T s) {
+        State_Type state = State_Init;
+        // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle => let check program always run the test (to be refactored with new scheduler)
+        if (! _doScheduledAction(s) && s->monitor && (s->type == Service_Program || ! _checkSkip(s))) {
+                if (! _watchSkip(s)) {
+                        _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
+                        if (s->monitor) {
+                                state = s->check(s);
+                                if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
+                                        s->monitor = Monitor_Yes;
+                                Watch_setChecked(s);
+                        }
+                }
+                gettimeofday(&s->collected, NULL);
+        }
+        return state;
+}
+
+
+static void _scheduleSiftUp(int i) {
+        Service_T s = _schedule.services[i];
+        while (i > 0) {
+                int parent = (i - 1) / 2;
+                if (_schedule.services[parent]->every.spec.interval.next <= s->every.spec.interval.next)
+                        break;
+                _schedule.services[i] = _schedule.services[parent];
+                i = parent;
+        }
+        _schedule.services[i] = s;
+}
+
+
+static void _scheduleSiftDown(int i) {
+        Service_T s = _schedule.services[i];
+        while (true) {
+                int child = 2 * i + 1;
+                if (child >= _schedule.count)
+                        break;
+                if (child + 1 < _schedule.count && _schedule.services[child + 1]->every.spec.interval.next < _schedule.services[child]->every.spec.interval.next)
+                        child++;
+                if (s->every.spec.interval.next <= _schedule.services[child]->every.spec.interval.next)
+                        break;
+                _schedule.services[i] = _schedule.services[child];
+                i = child;
+        }
+        _schedule.services[i] = s;
+}
+
+
+static void _schedulePush(Service_T s) {
+        if (_schedule.count == _schedule.capacity) {
+                _schedule.capacity = _schedule.capacity ? _schedule.capacity * 2 : 8;
+                RESIZE(_schedule.services, _schedule.capacity * sizeof(Service_T));
+        }
+        _schedule.services[_schedule.count++] = s;
+        _scheduleSiftUp(_schedule.count - 1);
+}
+
+
+static Service_T _schedulePop() {
+        Service_T s = _schedule.services[0];
+        if (--_schedule.count > 0) {
+                _schedule.services[0] = _schedule.services[_schedule.count];
+                _scheduleSiftDown(0);
+        }
+        return s;
+}
+
+
+/**
+ * Collect the monitored services which have their own check interval
+ */
+static void _scheduleBuild() {
+        _schedule.count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->every.type == Every_Interval && s->monitor != Monitor_Not)
+                        _schedulePush(s);
+}
+
+
+/**
+ * Returns the first pending job whose dependencies were validated already or NULL if there is no job left. Must be called with the pool mutex locked.
+ */
+static ValidateJob_T *_nextJob() {
+        while (! interrupt()) {
+                boolean_t pending = false;
+                for (int i = 0; i < _pool.count; i++) {
+                        ValidateJob_T *job = &_pool.jobs[i];
+                        if (job->state == Job_Pending) {
+                                pending = true;
+                                boolean_t runnable = true;
+                                for (int j = 0; j < job->parentsCount && runnable; j++)
+                                        if (_pool.jobs[job->parents[j]].state != Job_Done)
+                                                runnable = false;
+                                if (runnable)
+                                        return job;
+                        }
+                }
+                if (! pending)
+                        break;
+                // Wait for some running job to finish, it may unblock the dependant services
+                Sem_wait(_pool.done, _pool.mutex);
+        }
+        return NULL;
+}
+
+
+static void *_validateWorker(void *args) {
+        set_signal_block();
+        LOCK(_pool.mutex)
+        {
+                ValidateJob_T *job;
+                while ((job = _nextJob())) {
+                        job->state = Job_Running;
+                        if (_validateService(job->service) == State_Failed)
+                                _pool.errors++;
+                        job->state = Job_Done;
+                        Sem_broadcast(_pool.done);
+                }
+                // Wakeup the workers waiting for dependencies in the case that the cycle was interrupted
+                Sem_broadcast(_pool.done);
+        }
+        END_LOCK;
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/**
+ * Check the services using Run.parallel workers. The services are dispatched in the servicelist order (which is sorted by
+ * dependencies), a service is started only after all services it depends on were checked.
+ * @return The number of failed services
+ */
+static int _validateParallel() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                count++;
+        if (! count)
+                return 0;
+        ValidateJob_T *jobs = CALLOC(count, sizeof(ValidateJob_T));
+        int i = 0;
+        for (Service_T s = servicelist; s; s = s->next, i++) {
+                jobs[i].service = s;
+                for (Dependant_T d = s->dependantlist; d; d = d->next) {
+                        // The servicelist is topologically sorted => parents precede the service
+                        for (int j = 0; j < i; j++) {
+                                if (IS(jobs[j].service->name, d->dependant)) {
+                                        RESIZE(jobs[i].parents, (jobs[i].parentsCount + 1) * sizeof(int));
+                                        jobs[i].parents[jobs[i].parentsCount++] = j;
+                                        break;
+                                }
+                        }
+                }
+        }
+        int workers = MIN(Run.parallel, count);
+        Thread_T threads[workers];
+        LOCK(_pool.mutex)
+        {
+                _pool.jobs = jobs;
+                _pool.count = count;
+                _pool.errors = 0;
+                _pool.active = true;
+        }
+        END_LOCK;
+        for (i = 0; i < workers; i++)
+                Thread_create(threads[i], _validateWorker, NULL);
+        for (i = 0; i < workers; i++)
+                Thread_join(threads[i]);
+        _pool.active = false;
+        _pool.jobs = NULL;
+        _pool.count = 0;
+        for (i = 0; i < count; i++)
+                FREE(jobs[i].parents);
+        FREE(jobs);
+        return _pool.errors;
+}
+
+
 /* ---------------------------------------------------------------- Public */
 
 
@@ -1271,8 +1837,11 @@ int validate() {
         Run.handler_flag = Handler_Succeeded;
         Event_queue_process();
 
+        Watch_process();
+        _checksum.used = 0;
         update_system_info();
-        ProcessTree_init(ProcessEngine_None);
+        ProcessTree_initCycle(ProcessEngine_None);
+        Filesystem_initCycle();
         gettimeofday(&systeminfo.collected, NULL);
 
         /* In the case that at least one action is pending, perform quick loop to handle the actions ASAP */
@@ -1282,26 +1851,103 @@ int validate() {
                         _doScheduledAction(s);
         }
 
+        /* Ping the remote hosts due in this cycle at once */
+        int count = 0;
+        time_t now = Time_now();
+        for (Service_T s = servicelist; s; s = s->next)
+                count++;
+        Service_T hosts[count + 1];
+        count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Host && s->monitor != Monitor_Not && s->doaction == Action_Ignored && _isDue(s, now))
+                        hosts[count++] = s;
+        _pingHosts(hosts, count);
+
         int errors = 0;
-        /* Check the services */
-        for (Service_T s = servicelist; s && ! interrupt(); s = s->next) {
-                // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle => let check program always run the test (to be refactored with new scheduler)
-                if (! _doScheduledAction(s) && s->monitor && (s->type == Service_Program || ! _checkSkip(s))) {
-                        _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
-                        if (s->monitor) {
-                                State_Type state = s->check(s);
-                                if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
-                                        s->monitor = Monitor_Yes;
-                                if (state == State_Failed)
-                                        errors++;
-                        }
-                        gettimeofday(&s->collected, NULL);
+        if (Run.parallel > 1) {
+                errors = _validateParallel();
+        } else {
+                /* Check the services */
+                for (Service_T s = servicelist; s && ! interrupt(); s = s->next)
+                        if (_validateService(s) == State_Failed)
+                                errors++;
+        }
+        _pingHostsDone(hosts, count);
+        _scheduleBuild();
+        return errors;
+}
+
+
+/**
+ * Check the services with their own check interval which are due now. Called by the daemon
+ * between the poll cycles, when the time returned by validate_deadline() was reached.
+ * @return The number of failed services
+ */
+int validate_due() {
+        int count = 0;
+        time_t now = Time_now();
+        Service_T due[_schedule.count + 1];
+        while (_schedule.count > 0 && _schedule.services[0]->every.spec.interval.next <= now)
+                due[count++] = _schedulePop();
+        if (count == 0)
+                return 0;
+        // Refresh the shared data only if some due service needs it
+        boolean_t processes = false, filesystems = false;
+        for (int i = 0; i < count; i++) {
+                if (due[i]->type == Service_Process)
+                        processes = true;
+                else if (due[i]->type == Service_Filesystem)
+                        filesystems = true;
+                else if (due[i]->type == Service_System) {
+                        update_system_info();
+                        gettimeofday(&systeminfo.collected, NULL);
                 }
         }
+        if (processes)
+                ProcessTree_initCycle(ProcessEngine_None);
+        if (filesystems)
+                Filesystem_initCycle();
+        _pingHosts(due, count);
+        int errors = 0;
+        for (int i = 0; i < count; i++) {
+                Service_T s = due[i];
+                if (! interrupt() && _validateService(s) == State_Failed)
+                        errors++;
+                // The service may be skipped (e.g. because of a failed dependency) => make sure it doesn't spin
+                if (s->every.spec.interval.next <= now)
+                        s->every.spec.interval.next = now + s->every.spec.interval.seconds;
+                if (s->monitor != Monitor_Not)
+                        _schedulePush(s);
+        }
+        _pingHostsDone(due, count);
         return errors;
 }
 
 
+/**
+ * Check the watched services which changed since their last test. Called by the daemon between the poll cycles, when the file change
+ * notification descriptor is readable. The services with the "every" statement are left to their schedule.
+ * @return The number of failed services
+ */
+int validate_changed() {
+        int errors = 0;
+        if (Watch_process()) {
+                for (Service_T s = servicelist; s && ! interrupt(); s = s->next)
+                        if (s->every.type == Every_Cycle && Watch_getStatus(s) == Watch_Changed && _validateService(s) == State_Failed)
+                                errors++;
+        }
+        return errors;
+}
+
+
+/**
+ * @return The time when the next service with its own check interval is due or 0 if there is no such service
+ */
+time_t validate_deadline() {
+        return _schedule.count > 0 ? _schedule.services[0]->every.spec.interval.next : 0;
+}
+
+
 /**
  * Validate a given process service s. Events are posted according to
  * its configuration. In case of a fatal event false is returned.
@@ -1363,6 +2009,8 @@ State_Type check_process(Service_T s) {
                                 rv = State_Failed;
         }
         int64_t uptimeMilli = (int64_t)(s->inf.process->uptime) * 1000LL;
+        if (! s->start || uptimeMilli > s->start->timeout)
+                _connectPorts(s->portlist, s->socketlist);
         for (Port_T pp = s->portlist; pp; pp = pp->next) {
                 //FIXME: instead of pause, try to test, but ignore any errors in the start timeout timeframe ... will allow to display the port response time as soon as available, instead of waiting for 30+ seconds
                 /* pause port tests in the start timeout timeframe while the process is starting (it may take some time to the process before it starts accepting connections) */
@@ -1456,6 +2104,7 @@ State_Type check_file(Service_T s) {
                         s->inf.file->inode_prev = stat_buf.st_ino;
                 }
                 s->inf.file->inode = stat_buf.st_ino;
+                s->inf.file->device = stat_buf.st_dev;
                 s->inf.file->uid = stat_buf.st_uid;
                 s->inf.file->gid = stat_buf.st_gid;
                 s->inf.file->size = stat_buf.st_size;
@@ -1477,7 +2126,7 @@ State_Type check_file(Service_T s) {
                 Event_post(s, Event_Invalid, State_Succeeded, s->action_INVALID, "is a regular %s",
                            S_ISSOCK(s->inf.file->mode) ? "socket" : "file");
         }
-        if (_checkChecksum(s) == State_Failed)
+        if (_checkChecksum(s, &stat_buf) == State_Failed)
                 rv = State_Failed;
         if (_checkPerm(s, s->inf.file->mode) == State_Failed)
                 rv = State_Failed;
@@ -1541,6 +2190,8 @@ State_Type check_directory(Service_T s) {
                 rv = State_Failed;
         if (_checkTimestamps(s, s->inf.directory->timestamp.access, s->inf.directory->timestamp.change, s->inf.directory->timestamp.modify) == State_Failed)
                 rv = State_Failed;
+        if (s->treelist && _checkTree(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
@@ -1687,7 +2338,15 @@ State_Type check_remote_host(Service_T s) {
         for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
                 switch (icmp->type) {
                         case ICMP_ECHO:
-                                icmp->response = icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+                                if (icmp->echo.started) {
+                                        // The host was pinged together with the other hosts due in this cycle
+                                        icmp->echo.started = false;
+                                        icmp->response = icmp->echo.response;
+                                } else {
+                                        _blockingBegin();
+                                        icmp->response = icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+                                        _blockingEnd();
+                                }
                                 if (icmp->response == -2) {
                                         icmp->is_available = Connection_Init;
 #ifdef SOLARIS
@@ -1716,6 +2375,7 @@ State_Type check_remote_host(Service_T s) {
                 return State_Failed;
         }
         /* Test each host:port and protocol in the service's portlist */
+        _connectPorts(s->portlist, NULL);
         for (Port_T p = s->portlist; p; p = p->next)
                 if (_checkConnection(s, p) == State_Failed)
                         rv = State_Failed;
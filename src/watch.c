@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "monit.h"
+#include "device.h"
+#include "watch.h"
+
+// libmonit
+#include "io/File.h"
+
+
+/**
+ * Implementation of the file change notification using inotify. Each service
+ * watches its path and the parent directory, so the replacement (such as log
+ * rotation), removal and creation of the path are noticed too.
+ *
+ * @file
+ */
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+// The watches are added with IN_MASK_ADD: the path of one service may be the parent directory of another service (or the same path), both
+// share one watch descriptor and its mask must cover both
+#define WATCH_SELF   (IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_MASK_ADD)
+#define WATCH_PARENT (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR | IN_MASK_ADD)
+
+
+typedef struct WatchEntry_T {
+        Service_T service;
+        int self;                            /**< Watch descriptor of the path, -1 = none */
+        int parent;               /**< Watch descriptor of the parent directory, -1 = none */
+        const char *name;                  /**< The path base name (in the parent) */
+        boolean_t changed;
+        boolean_t polled;  /**< The filesystem doesn't report the changes => test each cycle */
+} WatchEntry_T;
+
+
+/* The filesystems which don't report all changes by inotify: the pseudo filesystems and the network/userspace filesystems, which don't
+ * see the changes made by the kernel or by other hosts */
+static const char *_unsupported[] = {"proc", "sysfs", "debugfs", "tracefs", "securityfs", "configfs", "cgroup", "cgroup2", "nfs", "nfs4", "cifs", "smb3", "smbfs", "9p", "ceph", "afs", "lustre", "gpfs", "gfs2", "ocfs2", NULL};
+
+
+static struct {
+        int fd;
+        int count;
+        WatchEntry_T *entries;
+} _watch = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static WatchEntry_T *_getEntry(Service_T s) {
+        for (int i = 0; i < _watch.count; i++)
+                if (_watch.entries[i].service == s)
+                        return &_watch.entries[i];
+        return NULL;
+}
+
+
+/**
+ * Test if the filesystem of the service path (or of its parent directory if the path doesn't exist) reports the changes by inotify. If
+ * the filesystem type is unknown, the service is polled
+ */
+static boolean_t _notifies(Service_T s) {
+        struct stat buf;
+        if (stat(s->path, &buf) != 0) {
+                char parent[PATH_MAX];
+                snprintf(parent, sizeof(parent), "%s", s->path);
+                if (stat(File_dirname(parent), &buf) != 0)
+                        return true; // The watch setup will report the error
+        }
+        const char *type = Filesystem_typeById(buf.st_dev);
+        if (! type || Str_startsWith(type, "fuse"))
+                return false;
+        for (int i = 0; _unsupported[i]; i++)
+                if (IS(type, _unsupported[i]))
+                        return false;
+        return true;
+}
+
+
+static void _addParent(WatchEntry_T *e) {
+        char parent[PATH_MAX];
+        snprintf(parent, sizeof(parent), "%s", e->service->path);
+        e->parent = inotify_add_watch(_watch.fd, File_dirname(parent), WATCH_PARENT);
+}
+
+
+static void _addSelf(WatchEntry_T *e) {
+        e->self = inotify_add_watch(_watch.fd, e->service->path, WATCH_SELF);
+        if (e->self == -1)
+                DEBUG("'%s' cannot watch %s -- %s\n", e->service->name, e->service->path, STRERROR);
+}
+
+
+static void _free() {
+        if (_watch.fd != -1) {
+                close(_watch.fd);
+                _watch.fd = -1;
+        }
+        FREE(_watch.entries);
+        _watch.count = 0;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Watch_init() {
+        _free();
+        if (! Run.inotify)
+                return;
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_File || s->type == Service_Fifo || s->type == Service_Directory)
+                        count++;
+        if (! count)
+                return;
+        if ((_watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+                LogError("Cannot initialize the file change notification -- %s\n", STRERROR);
+                return;
+        }
+        _watch.entries = CALLOC(count, sizeof(WatchEntry_T));
+        for (Service_T s = servicelist; s; s = s->next) {
+                if (s->type == Service_File || s->type == Service_Fifo || s->type == Service_Directory) {
+                        WatchEntry_T *e = &_watch.entries[_watch.count++];
+                        e->service = s;
+                        e->changed = true;
+                        e->name = File_basename(s->path);
+                        if (! _notifies(s)) {
+                                DEBUG("'%s' the filesystem doesn't report the changes of %s -- the service is tested each cycle\n", s->name, s->path);
+                                e->self = e->parent = -1;
+                                e->polled = true;
+                                continue;
+                        }
+                        _addParent(e);
+                        _addSelf(e);
+                        if (e->parent == -1 && e->self == -1)
+                                LogWarning("'%s' file change notification is not available -- %s\n", s->name, STRERROR);
+                }
+        }
+        DEBUG("Watching %d services for changes\n", _watch.count);
+}
+
+
+int Watch_getDescriptor() {
+        return _watch.fd;
+}
+
+
+boolean_t Watch_process() {
+        if (_watch.fd == -1)
+                return false;
+        boolean_t changed = false;
+        char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t n;
+        while ((n = read(_watch.fd, buffer, sizeof(buffer))) > 0) {
+                for (char *p = buffer; p < buffer + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+                        struct inotify_event *event = (struct inotify_event *)p;
+                        if (event->mask & IN_Q_OVERFLOW) {
+                                DEBUG("File change notification queue overflow\n");
+                                for (int i = 0; i < _watch.count; i++)
+                                        _watch.entries[i].changed = true;
+                                changed = true;
+                                continue;
+                        }
+                        for (int i = 0; i < _watch.count; i++) {
+                                WatchEntry_T *e = &_watch.entries[i];
+                                if (event->wd == e->self) {
+                                        if (event->mask & IN_IGNORED) {
+                                                // The path was removed or replaced => the watch was removed
+                                                e->self = -1;
+                                        }
+                                        e->changed = changed = true;
+                                } else if (event->wd == e->parent && event->len && IS(event->name, e->name)) {
+                                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                                                // The path was (re)created
+                                                if (e->self != -1)
+                                                        inotify_rm_watch(_watch.fd, e->self);
+                                                _addSelf(e);
+                                        }
+                                        e->changed = changed = true;
+                                }
+                        }
+                }
+        }
+        if (n == -1 && errno != EAGAIN && errno != EINTR)
+                LogError("File change notification read error -- %s\n", STRERROR);
+        return changed;
+}
+
+
+Watch_Status Watch_getStatus(Service_T s) {
+        WatchEntry_T *e = _getEntry(s);
+        if (! e || e->polled || (e->self == -1 && e->parent == -1))
+                return Watch_None;
+        return e->changed ? Watch_Changed : Watch_Idle;
+}
+
+
+void Watch_setChecked(Service_T s) {
+        WatchEntry_T *e = _getEntry(s);
+        if (e) {
+                e->changed = false;
+                // The path may have been mounted over since the watch was set up => test the filesystem type again
+                if (! _notifies(s)) {
+                        if (! e->polled) {
+                                DEBUG("'%s' the filesystem doesn't report the changes of %s -- the service is tested each cycle\n", s->name, s->path);
+                                // The watch descriptors are not removed, the parent directory watch may be shared with other services
+                                e->self = e->parent = -1;
+                                e->polled = true;
+                        }
+                } else if (e->polled) {
+                        e->polled = false;
+                        e->changed = true;
+                        _addParent(e);
+                        _addSelf(e);
+                } else if (e->self == -1) {
+                        _addSelf(e);
+                }
+        }
+}
+
+
+#else
+
+
+void Watch_init() {
+        if (Run.inotify)
+                LogWarning("The file change notification is not supported on this platform\n");
+}
+
+
+int Watch_getDescriptor() {
+        return -1;
+}
+
+
+boolean_t Watch_process() {
+        return false;
+}
+
+
+Watch_Status Watch_getStatus(Service_T s) {
+        return Watch_None;
+}
+
+
+void Watch_setChecked(Service_T s) {
+}
+
+
+#endif
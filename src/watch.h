@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+#ifndef MONIT_WATCH_H
+#define MONIT_WATCH_H
+
+#include "monit.h"
+
+
+/**
+ * The file change notification: if enabled by the "set inotify" statement,
+ * the file, fifo and directory services are watched with inotify (Linux).
+ * An idle watched service doesn't need to be tested each cycle and the
+ * changed service can be tested as soon as the change is reported.
+ *
+ * @file
+ */
+
+
+typedef enum {
+        Watch_None = 0,                      /**< The service is not watched */
+        Watch_Idle,         /**< No change was reported since the last test */
+        Watch_Changed             /**< The service changed since the last test */
+} __attribute__((__packed__)) Watch_Status;
+
+
+/**
+ * (Re)create the watches for all file, fifo and directory services. Must be
+ * called after the service list was (re)created.
+ */
+void Watch_init(void);
+
+
+/**
+ * @return The file descriptor which is readable when some change is pending
+ * (see Watch_process()) or -1 if the notification is not active
+ */
+int Watch_getDescriptor(void);
+
+
+/**
+ * Read the pending change notifications
+ * @return true if some watched service changed, otherwise false
+ */
+boolean_t Watch_process(void);
+
+
+/**
+ * @param s A service
+ * @return The watch status of the service
+ */
+Watch_Status Watch_getStatus(Service_T s);
+
+
+/**
+ * Mark the service as tested: it will be idle until the next change
+ * @param s A service
+ */
+void Watch_setChecked(Service_T s);
+
+
+#endif